@@ -23,13 +23,13 @@ fi
 
 echo -e "${YELLOW}Step 1/3: Compiling helper modules...${NC}"
 
-# Compile types.c (memory management)
-gcc -c types.c -o types.o `pkg-config --cflags gtk+-3.0` -I.
+# Compile memory.c (memory management)
+gcc -c memory.c -o memory.o `pkg-config --cflags gtk+-3.0` -I.
 if [ $? -ne 0 ]; then
-    echo -e "${RED}Failed to compile types.c${NC}"
+    echo -e "${RED}Failed to compile memory.c${NC}"
     exit 1
 fi
-echo -e "${GREEN}✓ types.o${NC}"
+echo -e "${GREEN}✓ memory.o${NC}"
 
 # Compile lexer.c
 gcc -c lexer.c -o lexer.o `pkg-config --cflags gtk+-3.0` -I.
@@ -47,6 +47,14 @@ if [ $? -ne 0 ]; then
 fi
 echo -e "${GREEN}✓ parser.o${NC}"
 
+# Compile resolver.c
+gcc -c resolver.c -o resolver.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile resolver.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ resolver.o${NC}"
+
 # Compile interpreter.c
 gcc -c interpreter.c -o interpreter.o `pkg-config --cflags gtk+-3.0` -I.
 if [ $? -ne 0 ]; then
@@ -55,6 +63,78 @@ if [ $? -ne 0 ]; then
 fi
 echo -e "${GREEN}✓ interpreter.o${NC}"
 
+# Compile compiler.c
+gcc -c compiler.c -o compiler.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile compiler.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ compiler.o${NC}"
+
+# Compile vm.c
+gcc -c vm.c -o vm.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile vm.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ vm.o${NC}"
+
+# Compile table.c
+gcc -c table.c -o table.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile table.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ table.o${NC}"
+
+# Compile shape.c
+gcc -c shape.c -o shape.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile shape.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ shape.o${NC}"
+
+# Compile iterator.c
+gcc -c iterator.c -o iterator.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile iterator.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ iterator.o${NC}"
+
+# Compile array.c
+gcc -c array.c -o array.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile array.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ array.o${NC}"
+
+# Compile vec.c
+gcc -c vec.c -o vec.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile vec.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ vec.o${NC}"
+
+# Compile cache.c
+gcc -c cache.c -o cache.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile cache.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ cache.o${NC}"
+
+# Compile module.c
+gcc -c module.c -o module.o `pkg-config --cflags gtk+-3.0` -I.
+if [ $? -ne 0 ]; then
+    echo -e "${RED}Failed to compile module.c${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓ module.o${NC}"
+
 echo ""
 echo -e "${YELLOW}Step 2/3: Compiling GUI editor...${NC}"
 
@@ -70,8 +150,8 @@ echo ""
 echo -e "${YELLOW}Step 3/3: Linking executable...${NC}"
 
 # Link everything together
-gcc gui_editor.o types.o lexer.o parser.o interpreter.o \
-    -o kitler-ide `pkg-config --libs gtk+-3.0` -lm
+gcc gui_editor.o memory.o lexer.o parser.o resolver.o interpreter.o compiler.o vm.o table.o shape.o iterator.o array.o vec.o cache.o module.o \
+    -o kitler-ide `pkg-config --libs gtk+-3.0` -lm -pthread
     
 if [ $? -ne 0 ]; then
     echo -e "${RED}Failed to link executable${NC}"
@@ -0,0 +1,581 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "types.h"
+// Typed numeric arrays for Kitler
+// FloatArray, DoubleArray and IntArray keep their elements unboxed in one
+// aligned block, for heightmaps, particle state and audio buffers. Scripts
+// work on a whole array per call (Array.Add, Array.Scale, Array.Sum, ...),
+// and each call runs a kernel from array_kernels.h: AVX2 with FMA when the
+// CPU has it, SSE2 otherwise on x86, and plain C everywhere else.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KT_ARRAY_X86 1
+#else
+#define KT_ARRAY_X86 0
+#endif
+
+#define KT_ARRAY_ALIGN 32           // One AVX register
+#define KT_ARRAY_MAX (INT32_MAX / 8)
+#define KT_ARRAY_SUM_BLOCK 256      // Elements summed in float lanes before adding as double
+
+// Bulk operations on count elements of one kind; a and b have the same kind.
+// Scalars arrive as doubles and are converted to the element type.
+typedef struct {
+    void (*add)(void* a, const void* b, int count);
+    void (*add_scalar)(void* a, double s, int count);
+    void (*mul)(void* a, const void* b, int count);
+    void (*scale)(void* a, double s, int count);
+    void (*fma)(void* a, const void* b, double s, int count);
+    void (*lerp)(void* a, const void* b, double t, int count);
+    void (*clamp)(void* a, double lo, double hi, int count);
+    double (*sum)(const void* a, int count);
+    double (*min)(const void* a, int count);   // count > 0
+    double (*max)(const void* a, int count);   // count > 0
+} ArrayKernels;
+
+// ============================================================================
+// INTEGER HELPERS
+// ============================================================================
+
+// Convert to an element of an IntArray: truncated, saturated, NaN as 0
+static int32_t to_int32(double value) {
+    if (value != value) return 0;
+    if (value >= 2147483647.0) return INT32_MAX;
+    if (value <= -2147483648.0) return INT32_MIN;
+    return (int32_t)value;
+}
+
+// Integer kernels compute in doubles, which hold every sum and product of two
+// elements exactly enough to saturate, so lanes never wrap or overflow
+static void int_array_add(void* va, const void* vb, int n) {
+    int32_t* a = (int32_t*)va;
+    const int32_t* b = (const int32_t*)vb;
+    for (int i = 0; i < n; i++) a[i] = to_int32((double)a[i] + b[i]);
+}
+
+static void int_array_add_scalar(void* va, double s, int n) {
+    int32_t* a = (int32_t*)va;
+    for (int i = 0; i < n; i++) a[i] = to_int32(a[i] + s);
+}
+
+static void int_array_mul(void* va, const void* vb, int n) {
+    int32_t* a = (int32_t*)va;
+    const int32_t* b = (const int32_t*)vb;
+    for (int i = 0; i < n; i++) a[i] = to_int32((double)a[i] * b[i]);
+}
+
+static void int_scale(void* va, double s, int n) {
+    int32_t* a = (int32_t*)va;
+    for (int i = 0; i < n; i++) a[i] = to_int32(a[i] * s);
+}
+
+static void int_fma(void* va, const void* vb, double s, int n) {
+    int32_t* a = (int32_t*)va;
+    const int32_t* b = (const int32_t*)vb;
+    for (int i = 0; i < n; i++) a[i] = to_int32(a[i] + b[i] * s);
+}
+
+static void int_lerp(void* va, const void* vb, double t, int n) {
+    int32_t* a = (int32_t*)va;
+    const int32_t* b = (const int32_t*)vb;
+    for (int i = 0; i < n; i++) a[i] = to_int32(a[i] + ((double)b[i] - a[i]) * t);
+}
+
+static double int_sum(const void* va, int n) {
+    const int32_t* a = (const int32_t*)va;
+    int64_t result = 0;
+    for (int i = 0; i < n; i++) result += a[i];
+    return (double)result;
+}
+
+// ============================================================================
+// KERNELS
+// ============================================================================
+
+// Plain C, for every platform
+#define K_T float
+#define K_V float
+#define K_W 1
+#define K_NAME(op) scalar_f32_##op
+#define K_ATTR
+#define K_LOAD(p) (*(p))
+#define K_STORE(p, v) (*(p) = (v))
+#define K_SET1(x) ((float)(x))
+#define K_ADD(a, b) ((a) + (b))
+#define K_SUB(a, b) ((a) - (b))
+#define K_MUL(a, b) ((a) * (b))
+#define K_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define K_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define K_FMADD(a, b, c) ((a) * (b) + (c))
+#define K_FLOATING
+#include "array_kernels.h"
+
+#define K_T double
+#define K_V double
+#define K_W 1
+#define K_NAME(op) scalar_f64_##op
+#define K_ATTR
+#define K_LOAD(p) (*(p))
+#define K_STORE(p, v) (*(p) = (v))
+#define K_SET1(x) ((double)(x))
+#define K_ADD(a, b) ((a) + (b))
+#define K_SUB(a, b) ((a) - (b))
+#define K_MUL(a, b) ((a) * (b))
+#define K_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define K_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define K_FMADD(a, b, c) ((a) * (b) + (c))
+#define K_FLOATING
+#include "array_kernels.h"
+
+#define K_T int32_t
+#define K_V int32_t
+#define K_W 1
+#define K_NAME(op) scalar_i32_##op
+#define K_ATTR
+#define K_LOAD(p) (*(p))
+#define K_STORE(p, v) (*(p) = (v))
+#define K_SET1(x) ((int32_t)(x))
+#define K_ADD(a, b) ((a) + (b))
+#define K_SUB(a, b) ((a) - (b))
+#define K_MUL(a, b) ((a) * (b))
+#define K_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define K_MAX(a, b) ((a) > (b) ? (a) : (b))
+#include "array_kernels.h"
+
+#if KT_ARRAY_X86
+
+// AVX2 and FMA, chosen at runtime
+#define K_T float
+#define K_V __m256
+#define K_W 8
+#define K_NAME(op) avx2_f32_##op
+#define K_ATTR __attribute__((target("avx2,fma")))
+#define K_LOAD(p) _mm256_loadu_ps(p)
+#define K_STORE(p, v) _mm256_storeu_ps(p, v)
+#define K_SET1(x) _mm256_set1_ps(x)
+#define K_ADD _mm256_add_ps
+#define K_SUB _mm256_sub_ps
+#define K_MUL _mm256_mul_ps
+#define K_MIN _mm256_min_ps
+#define K_MAX _mm256_max_ps
+#define K_FMADD _mm256_fmadd_ps
+#define K_FLOATING
+#include "array_kernels.h"
+
+#define K_T double
+#define K_V __m256d
+#define K_W 4
+#define K_NAME(op) avx2_f64_##op
+#define K_ATTR __attribute__((target("avx2,fma")))
+#define K_LOAD(p) _mm256_loadu_pd(p)
+#define K_STORE(p, v) _mm256_storeu_pd(p, v)
+#define K_SET1(x) _mm256_set1_pd(x)
+#define K_ADD _mm256_add_pd
+#define K_SUB _mm256_sub_pd
+#define K_MUL _mm256_mul_pd
+#define K_MIN _mm256_min_pd
+#define K_MAX _mm256_max_pd
+#define K_FMADD _mm256_fmadd_pd
+#define K_FLOATING
+#include "array_kernels.h"
+
+#define K_T int32_t
+#define K_V __m256i
+#define K_W 8
+#define K_NAME(op) avx2_i32_##op
+#define K_ATTR __attribute__((target("avx2")))
+#define K_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define K_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define K_SET1(x) _mm256_set1_epi32(x)
+#define K_ADD _mm256_add_epi32
+#define K_SUB _mm256_sub_epi32
+#define K_MUL _mm256_mullo_epi32
+#define K_MIN _mm256_min_epi32
+#define K_MAX _mm256_max_epi32
+#include "array_kernels.h"
+
+#endif
+
+#if KT_ARRAY_X86 && defined(__SSE2__)
+
+// SSE2, part of every x86-64 CPU (integer arrays fall back to plain C)
+#define K_T float
+#define K_V __m128
+#define K_W 4
+#define K_NAME(op) sse_f32_##op
+#define K_ATTR
+#define K_LOAD(p) _mm_loadu_ps(p)
+#define K_STORE(p, v) _mm_storeu_ps(p, v)
+#define K_SET1(x) _mm_set1_ps(x)
+#define K_ADD _mm_add_ps
+#define K_SUB _mm_sub_ps
+#define K_MUL _mm_mul_ps
+#define K_MIN _mm_min_ps
+#define K_MAX _mm_max_ps
+#define K_FMADD(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+#define K_FLOATING
+#include "array_kernels.h"
+
+#define K_T double
+#define K_V __m128d
+#define K_W 2
+#define K_NAME(op) sse_f64_##op
+#define K_ATTR
+#define K_LOAD(p) _mm_loadu_pd(p)
+#define K_STORE(p, v) _mm_storeu_pd(p, v)
+#define K_SET1(x) _mm_set1_pd(x)
+#define K_ADD _mm_add_pd
+#define K_SUB _mm_sub_pd
+#define K_MUL _mm_mul_pd
+#define K_MIN _mm_min_pd
+#define K_MAX _mm_max_pd
+#define K_FMADD(a, b, c) _mm_add_pd(_mm_mul_pd(a, b), c)
+#define K_FLOATING
+#include "array_kernels.h"
+
+#endif
+
+// Best kernels this CPU runs for an element type
+static const ArrayKernels* kernels_for(ArrayKind kind) {
+#if KT_ARRAY_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        switch (kind) {
+            case ARRAY_FLOAT: return &avx2_f32_kernels;
+            case ARRAY_DOUBLE: return &avx2_f64_kernels;
+            case ARRAY_INT: return &avx2_i32_kernels;
+        }
+    }
+#endif
+#if KT_ARRAY_X86 && defined(__SSE2__)
+    if (kind == ARRAY_FLOAT) return &sse_f32_kernels;
+    if (kind == ARRAY_DOUBLE) return &sse_f64_kernels;
+#endif
+    switch (kind) {
+        case ARRAY_FLOAT: return &scalar_f32_kernels;
+        case ARRAY_DOUBLE: return &scalar_f64_kernels;
+        default: return &scalar_i32_kernels;
+    }
+}
+
+// ============================================================================
+// ARRAY OBJECTS
+// ============================================================================
+
+static const char* kind_names[] = { "FloatArray", "DoubleArray", "IntArray" };
+
+size_t array_element_size(ArrayKind kind) {
+    switch (kind) {
+        case ARRAY_FLOAT: return sizeof(float);
+        case ARRAY_DOUBLE: return sizeof(double);
+        default: return sizeof(int32_t);
+    }
+}
+
+// Give an array object count zero-filled, aligned elements of kind
+void array_init(Obj* array, ArrayKind kind, int count) {
+    size_t bytes = array_element_size(kind) * (size_t)count;
+    char* block = (char*)calloc(1, bytes + KT_ARRAY_ALIGN);
+    
+    array->data.array.block = block;
+    array->data.array.data = block + (KT_ARRAY_ALIGN - (uintptr_t)block % KT_ARRAY_ALIGN);
+    array->data.array.count = count;
+    array->data.array.kind = kind;
+}
+
+// Allocate a zero-filled array of count elements
+Value new_array(Interpreter* interp, ArrayKind kind, int count) {
+    Obj* array = allocate_object(interp, VALUE_ARRAY);
+    array_init(array, kind, count);
+    return OBJ_VAL(array);
+}
+
+// Element index as a number (index must be in range)
+Value array_get(Obj* array, int index) {
+    switch (array->data.array.kind) {
+        case ARRAY_FLOAT: return NUMBER_VAL(((float*)array->data.array.data)[index]);
+        case ARRAY_DOUBLE: return NUMBER_VAL(((double*)array->data.array.data)[index]);
+        default: return INT_VAL(((int32_t*)array->data.array.data)[index]);
+    }
+}
+
+// Store a number as element index, converted to the element type
+static void array_set(Obj* array, int index, double value) {
+    switch (array->data.array.kind) {
+        case ARRAY_FLOAT: ((float*)array->data.array.data)[index] = (float)value; break;
+        case ARRAY_DOUBLE: ((double*)array->data.array.data)[index] = value; break;
+        default: ((int32_t*)array->data.array.data)[index] = to_int32(value); break;
+    }
+}
+
+// Scalar argument as the element type will see it (integer arrays saturate)
+static double element_scalar(Obj* array, double value) {
+    return array->data.array.kind == ARRAY_INT ? to_int32(value) : value;
+}
+
+// ============================================================================
+// BUILTINS
+// ============================================================================
+
+// Array argument of a builtin, or NULL after reporting the error
+static Obj* array_arg(const char* builtin, Value* args, int arg_count, int index) {
+    if (index < arg_count && args[index].type == VALUE_ARRAY) return AS_OBJ(args[index]);
+    
+    fprintf(stderr, "%s expects an array as argument %d\n", builtin, index + 1);
+    return NULL;
+}
+
+// Number argument of a builtin, or false after reporting the error
+static bool number_arg(const char* builtin, Value* args, int arg_count, int index, double* out) {
+    if (index < arg_count && IS_NUMBER(args[index])) {
+        *out = AS_NUMBER(args[index]);
+        return true;
+    }
+    
+    fprintf(stderr, "%s expects a number as argument %d\n", builtin, index + 1);
+    return false;
+}
+
+// Second array of a two-array operation: same element type and length as a
+static Obj* matching_arg(const char* builtin, Obj* a, Value* args, int arg_count, int index) {
+    Obj* b = array_arg(builtin, args, arg_count, index);
+    if (!b) return NULL;
+    
+    if (b->data.array.kind != a->data.array.kind || b->data.array.count != a->data.array.count) {
+        fprintf(stderr, "%s expects arrays of the same type and length (%s[%d], %s[%d])\n",
+            builtin, kind_names[a->data.array.kind], a->data.array.count,
+            kind_names[b->data.array.kind], b->data.array.count);
+        return NULL;
+    }
+    return b;
+}
+
+// FloatArray(count), DoubleArray(count) and IntArray(count), optionally filled with a value
+static Value construct(Interpreter* interp, ArrayKind kind, Value* args, int arg_count) {
+    const char* name = kind_names[kind];
+    double count, fill = 0;
+    
+    if (!number_arg(name, args, arg_count, 0, &count)) return NULL_VAL;
+    if (arg_count > 1 && !number_arg(name, args, arg_count, 1, &fill)) return NULL_VAL;
+    
+    if (count < 0 || count > KT_ARRAY_MAX || count != floor(count)) {
+        fprintf(stderr, "%s length must be a whole number from 0 to %d\n", name, KT_ARRAY_MAX);
+        return NULL_VAL;
+    }
+    
+    Value array = new_array(interp, kind, (int)count);
+    if (fill != 0) {
+        for (int i = 0; i < (int)count; i++) array_set(AS_OBJ(array), i, fill);
+    }
+    return array;
+}
+
+static Value builtin_float_array(Interpreter* interp, Value* args, int arg_count) {
+    return construct(interp, ARRAY_FLOAT, args, arg_count);
+}
+
+static Value builtin_double_array(Interpreter* interp, Value* args, int arg_count) {
+    return construct(interp, ARRAY_DOUBLE, args, arg_count);
+}
+
+static Value builtin_int_array(Interpreter* interp, Value* args, int arg_count) {
+    return construct(interp, ARRAY_INT, args, arg_count);
+}
+
+// Array.Length(a)
+static Value builtin_length(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    Obj* a = array_arg("Array.Length", args, arg_count, 0);
+    return a ? INT_VAL(a->data.array.count) : NULL_VAL;
+}
+
+// Element index of a checked against its length, or -1 after reporting the error
+static int index_arg(const char* builtin, Obj* a, Value* args, int arg_count, int index) {
+    double position;
+    if (!number_arg(builtin, args, arg_count, index, &position)) return -1;
+    
+    if (position < 0 || position >= a->data.array.count) {
+        fprintf(stderr, "%s index %g out of range (length %d)\n", builtin, position, a->data.array.count);
+        return -1;
+    }
+    return (int)position;
+}
+
+// Array.Get(a, i)
+static Value builtin_get(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    Obj* a = array_arg("Array.Get", args, arg_count, 0);
+    if (!a) return NULL_VAL;
+    
+    int index = index_arg("Array.Get", a, args, arg_count, 1);
+    return index >= 0 ? array_get(a, index) : NULL_VAL;
+}
+
+// Array.Set(a, i, value): returns the value as stored
+static Value builtin_set(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double value;
+    Obj* a = array_arg("Array.Set", args, arg_count, 0);
+    if (!a || !number_arg("Array.Set", args, arg_count, 2, &value)) return NULL_VAL;
+    
+    int index = index_arg("Array.Set", a, args, arg_count, 1);
+    if (index < 0) return NULL_VAL;
+    
+    array_set(a, index, value);
+    return array_get(a, index);
+}
+
+// Array.Fill(a, value)
+static Value builtin_fill(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double value;
+    Obj* a = array_arg("Array.Fill", args, arg_count, 0);
+    if (!a || !number_arg("Array.Fill", args, arg_count, 1, &value)) return NULL_VAL;
+    
+    for (int i = 0; i < a->data.array.count; i++) array_set(a, i, value);
+    return args[0];
+}
+
+// Array.Add(a, b) and Array.Add(a, number): a += b, elementwise
+static Value builtin_add(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    Obj* a = array_arg("Array.Add", args, arg_count, 0);
+    if (!a) return NULL_VAL;
+    
+    if (arg_count > 1 && IS_NUMBER(args[1])) {
+        kernels_for(a->data.array.kind)->add_scalar(a->data.array.data,
+            element_scalar(a, AS_NUMBER(args[1])), a->data.array.count);
+        return args[0];
+    }
+    
+    Obj* b = matching_arg("Array.Add", a, args, arg_count, 1);
+    if (!b) return NULL_VAL;
+    
+    kernels_for(a->data.array.kind)->add(a->data.array.data, b->data.array.data, a->data.array.count);
+    return args[0];
+}
+
+// Array.Mul(a, b) and Array.Mul(a, number): a *= b, elementwise
+static Value builtin_mul(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    Obj* a = array_arg("Array.Mul", args, arg_count, 0);
+    if (!a) return NULL_VAL;
+    
+    if (arg_count > 1 && IS_NUMBER(args[1])) {
+        kernels_for(a->data.array.kind)->scale(a->data.array.data, AS_NUMBER(args[1]),
+            a->data.array.count);
+        return args[0];
+    }
+    
+    Obj* b = matching_arg("Array.Mul", a, args, arg_count, 1);
+    if (!b) return NULL_VAL;
+    
+    kernels_for(a->data.array.kind)->mul(a->data.array.data, b->data.array.data, a->data.array.count);
+    return args[0];
+}
+
+// Array.Scale(a, s): a *= s
+static Value builtin_scale(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double s;
+    Obj* a = array_arg("Array.Scale", args, arg_count, 0);
+    if (!a || !number_arg("Array.Scale", args, arg_count, 1, &s)) return NULL_VAL;
+    
+    kernels_for(a->data.array.kind)->scale(a->data.array.data, s, a->data.array.count);
+    return args[0];
+}
+
+// Array.Fma(a, b, s): a += b * s (e.g. positions += velocities * dt)
+static Value builtin_fma(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double s;
+    Obj* a = array_arg("Array.Fma", args, arg_count, 0);
+    if (!a) return NULL_VAL;
+    
+    Obj* b = matching_arg("Array.Fma", a, args, arg_count, 1);
+    if (!b || !number_arg("Array.Fma", args, arg_count, 2, &s)) return NULL_VAL;
+    
+    kernels_for(a->data.array.kind)->fma(a->data.array.data, b->data.array.data, s,
+        a->data.array.count);
+    return args[0];
+}
+
+// Array.Lerp(a, b, t): a moves fraction t of the way towards b
+static Value builtin_lerp(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double t;
+    Obj* a = array_arg("Array.Lerp", args, arg_count, 0);
+    if (!a) return NULL_VAL;
+    
+    Obj* b = matching_arg("Array.Lerp", a, args, arg_count, 1);
+    if (!b || !number_arg("Array.Lerp", args, arg_count, 2, &t)) return NULL_VAL;
+    
+    kernels_for(a->data.array.kind)->lerp(a->data.array.data, b->data.array.data, t,
+        a->data.array.count);
+    return args[0];
+}
+
+// Array.Clamp(a, lo, hi)
+static Value builtin_clamp(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double lo, hi;
+    Obj* a = array_arg("Array.Clamp", args, arg_count, 0);
+    if (!a || !number_arg("Array.Clamp", args, arg_count, 1, &lo) ||
+        !number_arg("Array.Clamp", args, arg_count, 2, &hi)) {
+        return NULL_VAL;
+    }
+    
+    kernels_for(a->data.array.kind)->clamp(a->data.array.data, element_scalar(a, lo),
+        element_scalar(a, hi), a->data.array.count);
+    return args[0];
+}
+
+// Array.Sum(a)
+static Value builtin_sum(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    Obj* a = array_arg("Array.Sum", args, arg_count, 0);
+    if (!a) return NULL_VAL;
+    
+    return NUMBER_VAL(kernels_for(a->data.array.kind)->sum(a->data.array.data, a->data.array.count));
+}
+
+// Array.Min(a), null for an empty array
+static Value builtin_min(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    Obj* a = array_arg("Array.Min", args, arg_count, 0);
+    if (!a || a->data.array.count == 0) return NULL_VAL;
+    
+    return NUMBER_VAL(kernels_for(a->data.array.kind)->min(a->data.array.data, a->data.array.count));
+}
+
+// Array.Max(a), null for an empty array
+static Value builtin_max(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    Obj* a = array_arg("Array.Max", args, arg_count, 0);
+    if (!a || a->data.array.count == 0) return NULL_VAL;
+    
+    return NUMBER_VAL(kernels_for(a->data.array.kind)->max(a->data.array.data, a->data.array.count));
+}
+
+// Register the array constructors and Array.* builtins
+void register_array_builtins(Interpreter* interp) {
+    define_native(interp, "FloatArray", builtin_float_array);
+    define_native(interp, "DoubleArray", builtin_double_array);
+    define_native(interp, "IntArray", builtin_int_array);
+    define_native(interp, "Array.Length", builtin_length);
+    define_native(interp, "Array.Get", builtin_get);
+    define_native(interp, "Array.Set", builtin_set);
+    define_native(interp, "Array.Fill", builtin_fill);
+    define_native(interp, "Array.Add", builtin_add);
+    define_native(interp, "Array.Mul", builtin_mul);
+    define_native(interp, "Array.Scale", builtin_scale);
+    define_native(interp, "Array.Fma", builtin_fma);
+    define_native(interp, "Array.Lerp", builtin_lerp);
+    define_native(interp, "Array.Clamp", builtin_clamp);
+    define_native(interp, "Array.Sum", builtin_sum);
+    define_native(interp, "Array.Min", builtin_min);
+    define_native(interp, "Array.Max", builtin_max);
+}
@@ -0,0 +1,177 @@
+// Bulk kernels for typed arrays, written once and instantiated by array.c for
+// each element type and instruction set. The includer defines:
+//   K_T             element type
+//   K_V, K_W        vector type and its lane count (K_W == 1 for scalar code)
+//   K_NAME(op)      name of one kernel
+//   K_ATTR          function attributes (target instruction set)
+//   K_LOAD, K_STORE, K_SET1, K_ADD, K_SUB, K_MUL, K_MIN, K_MAX, K_FMADD
+//   K_FLOATING      defined for float and double; integer arrays only take
+//                   clamp, min and max from here
+// and this file undefines them again at the end.
+// Every kernel runs the vector body over whole vectors and finishes the tail
+// one element at a time. Storage is 32-byte aligned, and the unaligned
+// load and store forms cost nothing extra on aligned addresses.
+
+K_ATTR static void K_NAME(clamp)(void* va, double vlo, double vhi, int n) {
+    K_T* a = (K_T*)va;
+    K_T lo = (K_T)vlo, hi = (K_T)vhi;
+    K_V lov = K_SET1(lo), hiv = K_SET1(hi);
+    int i = 0;
+    for (; i + K_W <= n; i += K_W) K_STORE(a + i, K_MIN(K_MAX(K_LOAD(a + i), lov), hiv));
+    for (; i < n; i++) a[i] = a[i] < lo ? lo : (a[i] > hi ? hi : a[i]);
+}
+
+K_ATTR static double K_NAME(min)(const void* va, int n) {
+    const K_T* a = (const K_T*)va;
+    K_T result = a[0];
+    int i = 0;
+    
+    if (n >= K_W) {
+        K_V acc = K_LOAD(a);
+        for (i = K_W; i + K_W <= n; i += K_W) acc = K_MIN(acc, K_LOAD(a + i));
+        
+        K_T lanes[K_W];
+        K_STORE(lanes, acc);
+        for (int lane = 0; lane < K_W; lane++) {
+            if (lanes[lane] < result) result = lanes[lane];
+        }
+    }
+    for (; i < n; i++) {
+        if (a[i] < result) result = a[i];
+    }
+    return (double)result;
+}
+
+K_ATTR static double K_NAME(max)(const void* va, int n) {
+    const K_T* a = (const K_T*)va;
+    K_T result = a[0];
+    int i = 0;
+    
+    if (n >= K_W) {
+        K_V acc = K_LOAD(a);
+        for (i = K_W; i + K_W <= n; i += K_W) acc = K_MAX(acc, K_LOAD(a + i));
+        
+        K_T lanes[K_W];
+        K_STORE(lanes, acc);
+        for (int lane = 0; lane < K_W; lane++) {
+            if (lanes[lane] > result) result = lanes[lane];
+        }
+    }
+    for (; i < n; i++) {
+        if (a[i] > result) result = a[i];
+    }
+    return (double)result;
+}
+
+#ifdef K_FLOATING
+
+K_ATTR static void K_NAME(add)(void* va, const void* vb, int n) {
+    K_T* a = (K_T*)va;
+    const K_T* b = (const K_T*)vb;
+    int i = 0;
+    for (; i + K_W <= n; i += K_W) K_STORE(a + i, K_ADD(K_LOAD(a + i), K_LOAD(b + i)));
+    for (; i < n; i++) a[i] = a[i] + b[i];
+}
+
+K_ATTR static void K_NAME(add_scalar)(void* va, double vs, int n) {
+    K_T* a = (K_T*)va;
+    K_T s = (K_T)vs;
+    K_V sv = K_SET1(s);
+    int i = 0;
+    for (; i + K_W <= n; i += K_W) K_STORE(a + i, K_ADD(K_LOAD(a + i), sv));
+    for (; i < n; i++) a[i] = a[i] + s;
+}
+
+K_ATTR static void K_NAME(mul)(void* va, const void* vb, int n) {
+    K_T* a = (K_T*)va;
+    const K_T* b = (const K_T*)vb;
+    int i = 0;
+    for (; i + K_W <= n; i += K_W) K_STORE(a + i, K_MUL(K_LOAD(a + i), K_LOAD(b + i)));
+    for (; i < n; i++) a[i] = a[i] * b[i];
+}
+
+K_ATTR static void K_NAME(scale)(void* va, double vs, int n) {
+    K_T* a = (K_T*)va;
+    K_T s = (K_T)vs;
+    K_V sv = K_SET1(s);
+    int i = 0;
+    for (; i + K_W <= n; i += K_W) K_STORE(a + i, K_MUL(K_LOAD(a + i), sv));
+    for (; i < n; i++) a[i] = a[i] * s;
+}
+
+// a += b * s
+K_ATTR static void K_NAME(fma)(void* va, const void* vb, double vs, int n) {
+    K_T* a = (K_T*)va;
+    const K_T* b = (const K_T*)vb;
+    K_T s = (K_T)vs;
+    K_V sv = K_SET1(s);
+    int i = 0;
+    for (; i + K_W <= n; i += K_W) K_STORE(a + i, K_FMADD(K_LOAD(b + i), sv, K_LOAD(a + i)));
+    for (; i < n; i++) a[i] = a[i] + b[i] * s;
+}
+
+// a += (b - a) * t
+K_ATTR static void K_NAME(lerp)(void* va, const void* vb, double vt, int n) {
+    K_T* a = (K_T*)va;
+    const K_T* b = (const K_T*)vb;
+    K_T t = (K_T)vt;
+    K_V tv = K_SET1(t);
+    int i = 0;
+    for (; i + K_W <= n; i += K_W) {
+        K_V av = K_LOAD(a + i);
+        K_STORE(a + i, K_FMADD(K_SUB(K_LOAD(b + i), av), tv, av));
+    }
+    for (; i < n; i++) a[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+// Summed in vector lanes a block at a time, with block totals added as
+// doubles, so long float arrays do not lose precision
+K_ATTR static double K_NAME(sum)(const void* va, int n) {
+    const K_T* a = (const K_T*)va;
+    double result = 0;
+    int i = 0;
+    
+    while (i + K_W <= n) {
+        int block_end = n - i > KT_ARRAY_SUM_BLOCK ? i + KT_ARRAY_SUM_BLOCK : n;
+        K_V acc = K_SET1(0);
+        for (; i + K_W <= block_end; i += K_W) acc = K_ADD(acc, K_LOAD(a + i));
+        
+        K_T lanes[K_W];
+        K_STORE(lanes, acc);
+        for (int lane = 0; lane < K_W; lane++) result += lanes[lane];
+    }
+    for (; i < n; i++) result += a[i];
+    return result;
+}
+
+static const ArrayKernels K_NAME(kernels) = {
+    K_NAME(add), K_NAME(add_scalar), K_NAME(mul), K_NAME(scale), K_NAME(fma),
+    K_NAME(lerp), K_NAME(clamp), K_NAME(sum), K_NAME(min), K_NAME(max)
+};
+
+#else
+
+// Integer arrays do their arithmetic through doubles and saturate (see
+// array.c); only clamp, min and max, which cannot overflow, are vectorised
+static const ArrayKernels K_NAME(kernels) = {
+    int_array_add, int_array_add_scalar, int_array_mul, int_scale, int_fma,
+    int_lerp, K_NAME(clamp), int_sum, K_NAME(min), K_NAME(max)
+};
+
+#endif
+
+#undef K_T
+#undef K_V
+#undef K_W
+#undef K_NAME
+#undef K_ATTR
+#undef K_LOAD
+#undef K_STORE
+#undef K_SET1
+#undef K_ADD
+#undef K_SUB
+#undef K_MUL
+#undef K_MIN
+#undef K_MAX
+#undef K_FMADD
+#undef K_FLOATING
@@ -0,0 +1,1420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// Compiled script cache (.ktc) for Kitler
+// A .ktc file next to the source holds everything compile_program produced:
+// every function's bytecode, line table and constants, the class layouts and
+// the global slot order the bytecode was compiled against. It is keyed by a
+// hash of the source and by the bytecode version, and run_file maps it and
+// executes it without lexing, parsing, resolving or compiling. Code, line
+// tables and capture lists are used in place from the mapping; only
+// constants, inline caches and objects are rebuilt. Anything that does not
+// match exactly makes the load fail, and the caller compiles from source.
+//
+// A heap snapshot (.ktsnap, see snapshot_save) is the same image taken after
+// the top level has run, plus the heap reachable from the globals. It is not
+// keyed by a source file: kt run --snapshot= restores it into a fresh
+// interpreter and goes straight to WhenRan. Objects in it refer to each other,
+// to strings and to prototypes by index, so the image is position-independent.
+//
+// A program image (see program_image) is a .ktc kept in memory instead of a
+// file, for libkitler (kitler.c): compiled once, then loaded into every
+// isolate that runs the program. It is not keyed by a source, and the
+// isolates' chunks point into the one copy of its bytes.
+//
+// Layout, in native byte order, every block padded to 8 bytes:
+//   header
+//   strings     u32 length, then the characters and a NUL
+//   globals     u32 string index per global slot, in slot order
+//   classes     u32 name, field count, method count, then the field keys
+//               and method names as string indices in slot order
+//   functions   u32 name, param, local, upvalue, code, constant, cache and
+//               cache entry counts; the UpvalueRef array, the constants,
+//               the cache entries, the line table and the code. Function 0
+//               is the top-level script.
+//   modules     u32 name, path (none for a native module), function (the
+//               module's top level), slot count, state; u64 source hash
+//               and length; then the module's global slots
+//   objects     (snapshots only) u32 type, count and two operands, then
+//               the contents: count encoded values, or for a typed array
+//               count raw elements
+//   values      (snapshots only) the value of every global slot
+
+#define KTC_MAGIC "KTC4"
+#define KTS_MAGIC "KTS2"
+#define KTP_MAGIC "KTP2"
+#define KTC_NONE 0xffffffffu
+#define KTC_ALIGN 8
+
+typedef struct {
+    char magic[4];
+    uint32_t version;           // KT_BYTECODE_VERSION
+    uint32_t opcode_count;      // KT_OPCODE_COUNT
+    uint32_t value_size;        // sizeof(Value)
+    uint64_t source_hash;
+    uint64_t source_length;
+    uint64_t payload_hash;      // Of everything after the header
+    uint32_t string_count;
+    uint32_t global_count;
+    uint32_t class_count;
+    uint32_t function_count;
+    uint32_t module_count;
+    uint32_t object_count;      // Heap objects (always 0 in a .ktc)
+} KtcHeader;
+
+typedef struct {
+    uint32_t name;
+    uint32_t field_count;
+    uint32_t method_count;
+    uint32_t reserved;
+} KtcClass;
+
+typedef struct {
+    uint32_t name;
+    uint32_t param_count;
+    uint32_t local_count;
+    uint32_t upvalue_count;
+    uint32_t code_count;
+    uint32_t constant_count;
+    uint32_t cache_count;
+    uint32_t entry_count;       // KtcCacheEntry records that follow the constants
+} KtcFunction;
+
+// An inline cache entry whose key is a class layout, such as the ones the
+// resolver seeds for this.field and this.Method(). Shapes and vtables are
+// rebuilt on load, so the key is saved as the class that has it.
+typedef struct {
+    uint32_t cache;
+    uint32_t klass;             // Class index
+    uint32_t method;            // 1: the class's vtable, 0: its shape
+    uint32_t slot;
+} KtcCacheEntry;
+
+typedef struct {
+    uint32_t name;
+    uint32_t path;
+    uint32_t function;
+    uint32_t slot_count;
+    uint32_t state;             // MODULE_PENDING, or MODULE_READY in a snapshot
+    uint32_t reserved;
+    uint64_t source_hash;
+    uint64_t source_length;
+} KtcModule;
+
+// Heap object of a snapshot; what count and the operands mean depends on type
+typedef struct {
+    uint32_t type;      // ValueType
+    uint32_t count;     // Encoded values that follow (array: elements)
+    uint32_t a;         // Closure: function; class: class; instance: field count;
+                        // array: element kind
+    uint32_t reserved;
+} KtcObject;
+
+typedef enum {
+    KTC_NUMBER,
+    KTC_INT,
+    KTC_STRING,         // bits: string index
+    KTC_FUNCTION,       // bits: function index
+    KTC_CLASS,          // bits: class index
+    
+    // Heap values, only in snapshots
+    KTC_UNDEFINED,
+    KTC_NULL,
+    KTC_BOOL,           // bits: 0 or 1
+    KTC_VEC2,           // bits: the x and y lanes
+    KTC_VEC3,           // bits: the x and y lanes; extra: the z lane
+    KTC_COLOR,          // bits: the channels
+    KTC_OBJECT,         // bits: object index
+    KTC_NATIVE          // bits: string index of the native's name
+} KtcTag;
+
+// A constant, or in a snapshot any value
+typedef struct {
+    uint32_t tag;
+    uint32_t extra;
+    uint64_t bits;
+} KtcValue;
+
+// 64-bit FNV-1a hash of the source text or of the cache contents
+uint64_t ktc_hash(const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Cache path for a source file: foo.kt becomes foo.ktc (caller frees)
+char* ktc_path(const char* source_path) {
+    size_t length = strlen(source_path);
+    char* path = (char*)malloc(length + 5);
+    memcpy(path, source_path, length + 1);
+    
+    if (length >= 3 && strcmp(source_path + length - 3, ".kt") == 0) {
+        strcat(path, "c");
+    } else {
+        strcat(path, ".ktc");
+    }
+    return path;
+}
+
+// ============================================================================
+// LOADING
+// ============================================================================
+
+// What an image holds, which decides how it is checked and what is in it
+typedef enum {
+    IMAGE_CACHE,        // .ktc file: keyed by its source, not yet run
+    IMAGE_SNAPSHOT,     // .ktsnap file: run, with its heap
+    IMAGE_PROGRAM       // In memory: not yet run, trusted as built
+} ImageKind;
+
+static const char* image_magic(ImageKind kind) {
+    switch (kind) {
+        case IMAGE_SNAPSHOT: return KTS_MAGIC;
+        case IMAGE_PROGRAM: return KTP_MAGIC;
+        default: return KTC_MAGIC;
+    }
+}
+
+// Bounds-checked cursor over a mapped cache; any overrun clears ok
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+    bool ok;
+} KtcReader;
+
+// Next size bytes, or NULL past the end of the file
+static const void* take(KtcReader* reader, size_t size) {
+    size_t padded = (size + KTC_ALIGN - 1) & ~(size_t)(KTC_ALIGN - 1);
+    if (!reader->ok || padded < size || padded > reader->size - reader->position) {
+        reader->ok = false;
+        return NULL;
+    }
+    
+    const void* block = reader->data + reader->position;
+    reader->position += padded;
+    return block;
+}
+
+// Array of count items of size bytes each, or NULL (an empty array is not an error)
+static const void* take_array(KtcReader* reader, uint32_t count, size_t size) {
+    if (count == 0) return NULL;
+    if ((uint64_t)count * size > reader->size) {
+        reader->ok = false;
+        return NULL;
+    }
+    return take(reader, (size_t)count * size);
+}
+
+// Map (or on Windows read) a whole file; NULL if it cannot be opened
+static void* map_file(const char* path, size_t* size) {
+#ifdef _WIN32
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    void* data = length > 0 ? malloc((size_t)length) : NULL;
+    if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    
+    struct stat info;
+    void* data = NULL;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) data = NULL;
+        *size = (size_t)info.st_size;
+    }
+    close(fd);
+    return data;
+#endif
+}
+
+static void unmap_file(void* data, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    free(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+// Release the cache a load mapped (after its chunks are freed)
+void ktc_release(Interpreter* interp) {
+    if (!interp->cache_map) return;
+    unmap_file(interp->cache_map, interp->cache_map_size);
+    interp->cache_map = NULL;
+    interp->cache_map_size = 0;
+}
+
+// Objects a load has recreated so far, which encoded values refer to by index
+typedef struct {
+    Interpreter* interp;
+    bool snapshot;          // Heap values are allowed
+    Obj** strings;
+    uint32_t string_count;
+    Obj** functions;
+    uint32_t function_count;
+    Obj** classes;
+    uint32_t class_count;
+    Obj** objects;
+    uint32_t object_count;
+} KtcTables;
+
+// String index read from the cache, checked against the string table
+static Obj* string_at(KtcReader* reader, KtcTables* tables, uint32_t index) {
+    if (index >= tables->string_count) {
+        reader->ok = false;
+        return NULL;
+    }
+    return tables->strings[index];
+}
+
+// Native function a snapshot names: the builtin or module native still in
+// the global of that name, or a vector method (UNDEFINED_VAL if neither)
+static Value find_native(Interpreter* interp, Obj* name) {
+    Value slot;
+    if (map_get(interp->global_index, name, &slot)) {
+        Value value = interp->global_scope->values[(int)AS_NUMBER(slot)];
+        if (value.type == VALUE_NATIVE_FUNCTION &&
+            strcmp(AS_OBJ(value)->data.native_function.name, name->data.string.chars) == 0) {
+            return value;
+        }
+    }
+    
+    Obj* vectors = interp->vector_class;
+    for (int i = 0; vectors && i < vectors->data.class_obj.vtable->count; i++) {
+        Value method = vectors->data.class_obj.methods[i];
+        if (strcmp(AS_OBJ(method)->data.native_function.name, name->data.string.chars) == 0) {
+            return method;
+        }
+    }
+    return UNDEFINED_VAL;
+}
+
+// Decode one value; false if it refers to something the image does not have
+static bool decode_value(KtcTables* tables, const KtcValue* encoded, Value* value) {
+    switch (encoded->tag) {
+        case KTC_NUMBER:
+            *value = NUMBER_VAL(0);
+            memcpy(&value->data.number, &encoded->bits, sizeof(double));
+            return true;
+        case KTC_INT:
+            *value = INT_VAL((int64_t)encoded->bits);
+            return true;
+        case KTC_STRING:
+            if (encoded->bits >= tables->string_count) return false;
+            *value = OBJ_VAL(tables->strings[encoded->bits]);
+            return true;
+        case KTC_FUNCTION:
+            if (encoded->bits >= tables->function_count) return false;
+            *value = OBJ_VAL(tables->functions[encoded->bits]);
+            return true;
+        case KTC_CLASS:
+            if (encoded->bits >= tables->class_count) return false;
+            *value = OBJ_VAL(tables->classes[encoded->bits]);
+            return true;
+        default:
+            break;
+    }
+    
+    if (!tables->snapshot) return false;
+    
+    switch (encoded->tag) {
+        case KTC_UNDEFINED:
+            *value = UNDEFINED_VAL;
+            return true;
+        case KTC_NULL:
+            *value = NULL_VAL;
+            return true;
+        case KTC_BOOL:
+            *value = BOOL_VAL(encoded->bits != 0);
+            return true;
+        case KTC_VEC2:
+        case KTC_VEC3:
+        case KTC_COLOR:
+            *value = NULL_VAL;
+            value->type = encoded->tag == KTC_VEC2 ? VALUE_VEC2
+                : encoded->tag == KTC_VEC3 ? VALUE_VEC3 : VALUE_COLOR;
+            memcpy(&value->data, &encoded->bits, sizeof(encoded->bits));
+            memcpy(&value->z, &encoded->extra, sizeof(float));
+            return true;
+        case KTC_OBJECT:
+            if (encoded->bits >= tables->object_count) return false;
+            *value = OBJ_VAL(tables->objects[encoded->bits]);
+            return true;
+        case KTC_NATIVE:
+            if (encoded->bits >= tables->string_count) return false;
+            *value = find_native(tables->interp, tables->strings[encoded->bits]);
+            return !IS_UNDEFINED(*value);
+        default:
+            return false;
+    }
+}
+
+// Rebuild one function's chunk: code, lines and captures stay in the mapping
+static bool load_function(KtcReader* reader, KtcTables* tables, Obj* proto) {
+    const KtcFunction* header = (const KtcFunction*)take(reader, sizeof(KtcFunction));
+    if (!header) return false;
+    
+    Obj* name = string_at(reader, tables, header->name);
+    const UpvalueRef* captures = (const UpvalueRef*)take_array(reader, header->upvalue_count, sizeof(UpvalueRef));
+    const KtcValue* constants = (const KtcValue*)take_array(reader, header->constant_count, sizeof(KtcValue));
+    const KtcCacheEntry* entries = (const KtcCacheEntry*)take_array(reader, header->entry_count, sizeof(KtcCacheEntry));
+    const int* lines = (const int*)take_array(reader, header->code_count, sizeof(int));
+    const uint8_t* code = (const uint8_t*)take_array(reader, header->code_count, 1);
+    if (!reader->ok || header->code_count == 0 || header->cache_count > 0x10000) return false;
+    
+    Chunk* chunk = new_chunk(tables->interp);
+    chunk->mapped = true;
+    chunk->code = (uint8_t*)code;
+    chunk->lines = (int*)lines;
+    chunk->count = chunk->capacity = (int)header->code_count;
+    
+    proto->data.function.name = strdup(name->data.string.chars);
+    proto->data.function.param_count = (int)header->param_count;
+    proto->data.function.local_count = (int)header->local_count;
+    proto->data.function.captures = (UpvalueRef*)captures;
+    proto->data.function.upvalue_count = (int)header->upvalue_count;
+    proto->data.function.chunk = chunk;
+    
+    if (header->constant_count > 0) {
+        chunk->constants = (Value*)malloc(sizeof(Value) * header->constant_count);
+        chunk->constant_capacity = (int)header->constant_count;
+    }
+    for (uint32_t i = 0; i < header->constant_count; i++) {
+        // Constants are never heap values, even in a snapshot
+        if (constants[i].tag > KTC_CLASS) return false;
+        if (!decode_value(tables, &constants[i], &chunk->constants[chunk->constant_count++])) return false;
+    }
+    
+    if (header->cache_count > 0) {
+        chunk->caches = (InlineCache*)calloc(header->cache_count, sizeof(InlineCache));
+        chunk->cache_count = chunk->cache_capacity = (int)header->cache_count;
+    }
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        const KtcCacheEntry* entry = &entries[i];
+        if (entry->cache >= header->cache_count || entry->klass >= tables->class_count) return false;
+        
+        Obj* klass = tables->classes[entry->klass];
+        const void* key = entry->method ? (const void*)klass->data.class_obj.vtable
+                                        : (const void*)klass->data.class_obj.shape;
+        int slot_count = entry->method ? klass->data.class_obj.vtable->count
+                                       : klass->data.class_obj.shape->slot_count;
+        if (entry->slot >= (uint32_t)slot_count) return false;
+        cache_update(&chunk->caches[entry->cache], key, (int)entry->slot);
+    }
+    return true;
+}
+
+// ============================================================================
+// HEAP SNAPSHOT LOADING
+// ============================================================================
+
+// Allocate a snapshot object with everything but its references to other
+// objects. Restored objects are long-lived, so they go straight to the old
+// generation.
+static Obj* create_shell(KtcTables* tables, const KtcObject* entry) {
+    Interpreter* interp = tables->interp;
+    Obj* object = NULL;
+    
+    switch (entry->type) {
+        case VALUE_LIST:
+            object = allocate_tenured(interp, VALUE_LIST);
+            object->data.list.capacity = entry->count > 0 ? (int)entry->count : 1;
+            object->data.list.elements = (Value*)malloc(sizeof(Value) * object->data.list.capacity);
+            return object;
+            
+        case VALUE_MAP:
+            if (entry->count % 2 != 0) return NULL;
+            return allocate_tenured(interp, VALUE_MAP);
+            
+        case VALUE_RANGE:
+            return entry->count == 3 ? allocate_tenured(interp, VALUE_RANGE) : NULL;
+            
+        case VALUE_ARRAY:
+            if (entry->a > ARRAY_INT || entry->count > INT32_MAX) return NULL;
+            object = allocate_tenured(interp, VALUE_ARRAY);
+            array_init(object, (ArrayKind)entry->a, (int)entry->count);
+            return object;
+            
+        case VALUE_UPVALUE:
+            if (entry->count != 1) return NULL;
+            object = allocate_tenured(interp, VALUE_UPVALUE);
+            object->data.upvalue.location = &object->data.upvalue.closed;
+            return object;
+            
+        case VALUE_FUNCTION: {
+            // A closure of one of the image's prototypes
+            if (entry->a >= tables->function_count) return NULL;
+            Obj* proto = tables->functions[entry->a];
+            if ((int)entry->count != proto->data.function.upvalue_count) return NULL;
+            
+            object = allocate_tenured(interp, VALUE_FUNCTION);
+            object->data.function = proto->data.function;     // Shares the chunk, captures and name
+            if (entry->count > 0) {
+                object->data.function.upvalues = (Obj**)calloc(entry->count, sizeof(Obj*));
+            }
+            return object;
+        }
+        
+        case VALUE_CLASS: {
+            // A class declaration that has run, sharing its prototype's layout
+            if (entry->a >= tables->class_count) return NULL;
+            Obj* proto = tables->classes[entry->a];
+            int fields = proto->data.class_obj.shape->slot_count;
+            int methods = proto->data.class_obj.vtable->count;
+            if (entry->count != (uint32_t)(fields + methods)) return NULL;
+            
+            object = allocate_tenured(interp, VALUE_CLASS);
+            object->data.class_obj.name = strdup(proto->data.class_obj.name);
+            object->data.class_obj.shape = proto->data.class_obj.shape;
+            object->data.class_obj.vtable = proto->data.class_obj.vtable;
+            object->data.class_obj.defaults = (Value*)malloc(sizeof(Value) * (fields > 0 ? fields : 1));
+            object->data.class_obj.methods = (Value*)malloc(sizeof(Value) * (methods > 0 ? methods : 1));
+            return object;
+        }
+        
+        case VALUE_INSTANCE: {
+            // The class, the field names in slot order, then the field values
+            if (entry->count != 1 + 2 * entry->a || entry->a > 0x10000) return NULL;
+            int capacity = entry->a > 0 ? (int)entry->a : 1;
+            
+            object = allocate_tenured(interp, VALUE_INSTANCE);
+            object->data.instance.slots = (Value*)malloc(sizeof(Value) * capacity);
+            object->data.instance.slot_capacity = capacity;
+            return object;
+        }
+        
+        default:
+            return NULL;
+    }
+}
+
+// Decode a value that one object stores in another
+static bool decode_field(KtcTables* tables, Obj* owner, const KtcValue* encoded, Value* value) {
+    if (!decode_value(tables, encoded, value) || IS_UNDEFINED(*value)) return false;
+    gc_write_barrier(tables->interp, owner, *value);
+    return true;
+}
+
+// Fill in a snapshot object's contents
+static bool fill_object(KtcTables* tables, Obj* object, const KtcObject* entry, const void* contents) {
+    const KtcValue* values = (const KtcValue*)contents;
+    Value value;
+    
+    switch (entry->type) {
+        case VALUE_LIST:
+            for (uint32_t i = 0; i < entry->count; i++) {
+                if (!decode_field(tables, object, &values[i], &object->data.list.elements[i])) return false;
+                object->data.list.count++;
+            }
+            return true;
+            
+        case VALUE_MAP:
+            for (uint32_t i = 0; i < entry->count; i += 2) {
+                Value key;
+                if (!decode_value(tables, &values[i], &key) || !IS_STRING(key)) return false;
+                if (!decode_field(tables, object, &values[i + 1], &value)) return false;
+                map_set(object, AS_OBJ(key), value);
+            }
+            return true;
+            
+        case VALUE_RANGE: {
+            Value* bounds[3] = { &object->data.range.start, &object->data.range.end, &object->data.range.step };
+            for (int i = 0; i < 3; i++) {
+                if (!decode_value(tables, &values[i], bounds[i]) || !IS_NUMBER(*bounds[i])) return false;
+            }
+            return true;
+        }
+        
+        case VALUE_ARRAY:
+            if (entry->count > 0) {
+                memcpy(object->data.array.data, contents,
+                    array_element_size(object->data.array.kind) * entry->count);
+            }
+            return true;
+            
+        case VALUE_UPVALUE:
+            return decode_field(tables, object, &values[0], &object->data.upvalue.closed);
+            
+        case VALUE_FUNCTION:
+            for (uint32_t i = 0; i < entry->count; i++) {
+                if (!decode_value(tables, &values[i], &value) || value.type != VALUE_UPVALUE) return false;
+                object->data.function.upvalues[i] = AS_OBJ(value);
+            }
+            return true;
+            
+        case VALUE_CLASS: {
+            int methods = object->data.class_obj.vtable->count;
+            for (int i = 0; i < methods; i++) {
+                if (!decode_field(tables, object, &values[i], &object->data.class_obj.methods[i])) return false;
+            }
+            for (uint32_t i = methods; i < entry->count; i++) {
+                if (!decode_field(tables, object, &values[i], &object->data.class_obj.defaults[i - methods])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        
+        case VALUE_INSTANCE: {
+            if (!decode_value(tables, &values[0], &value) || value.type != VALUE_CLASS) return false;
+            object->data.instance.class_ref = AS_OBJ(value);
+            gc_write_barrier(tables->interp, object, value);
+            
+            // Adding the fields in slot order reaches the same shape again
+            Shape* shape = tables->interp->root_shape;
+            for (uint32_t i = 0; i < entry->a; i++) {
+                Value key;
+                if (!decode_value(tables, &values[1 + i], &key) || !IS_STRING(key)) return false;
+                shape = shape_add(shape, AS_OBJ(key));
+                if (!decode_field(tables, object, &values[1 + entry->a + i], &object->data.instance.slots[i])) {
+                    return false;
+                }
+            }
+            if (shape->slot_count != (int)entry->a) return false;
+            object->data.instance.shape = shape;
+            return true;
+        }
+        
+        default:
+            return false;
+    }
+}
+
+// Size of one item of a snapshot object's contents
+static size_t item_size(const KtcObject* entry) {
+    return entry->type == VALUE_ARRAY ? array_element_size((ArrayKind)entry->a) : sizeof(KtcValue);
+}
+
+// Recreate a snapshot's heap, then set every global to its saved value. All
+// objects are allocated before any is filled in, so references between them,
+// cycles included, resolve by index.
+static bool load_heap(KtcReader* reader, KtcTables* tables, uint32_t global_count) {
+    size_t start = reader->position;
+    
+    for (uint32_t i = 0; i < tables->object_count; i++) {
+        const KtcObject* entry = (const KtcObject*)take(reader, sizeof(KtcObject));
+        if (!entry) return false;
+        take_array(reader, entry->count, item_size(entry));
+        if (!reader->ok) return false;
+        
+        tables->objects[i] = create_shell(tables, entry);
+        if (!tables->objects[i]) return false;
+    }
+    
+    reader->position = start;
+    for (uint32_t i = 0; i < tables->object_count; i++) {
+        const KtcObject* entry = (const KtcObject*)take(reader, sizeof(KtcObject));
+        const void* contents = take_array(reader, entry->count, item_size(entry));
+        if (!fill_object(tables, tables->objects[i], entry, contents)) return false;
+    }
+    
+    // Natives are looked up by name in the globals, so these are all decoded
+    // before any global changes
+    const KtcValue* encoded = (const KtcValue*)take_array(reader, global_count, sizeof(KtcValue));
+    if (!reader->ok) return false;
+    
+    Value* values = (Value*)malloc(sizeof(Value) * (global_count + 1));
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < global_count; i++) {
+        ok = decode_value(tables, &encoded[i], &values[i]);
+    }
+    if (ok) memcpy(tables->interp->global_scope->values, values, sizeof(Value) * global_count);
+    free(values);
+    return ok;
+}
+
+// ============================================================================
+// LOADING IMAGES
+// ============================================================================
+
+// Load an image of kind from data, which must stay alive as long as the
+// interpreter because chunks point into it. A cache must have been compiled
+// from exactly source. Returns the top-level script, or NULL when the image
+// is stale or damaged. Builtins must already be registered. A failed load may
+// leave globals and prototypes behind, so the caller should start again in a
+// fresh interpreter.
+static Obj* load_image(Interpreter* interp, ImageKind kind, const uint8_t* data, size_t size,
+                       const char* source, size_t source_length) {
+    bool snapshot = kind == IMAGE_SNAPSHOT;
+    KtcReader reader = { data, size, 0, true };
+    const KtcHeader* header = (const KtcHeader*)take(&reader, sizeof(KtcHeader));
+    if (!header || memcmp(header->magic, image_magic(kind), 4) != 0 ||
+        header->version != KT_BYTECODE_VERSION ||
+        header->opcode_count != KT_OPCODE_COUNT ||
+        header->value_size != sizeof(Value) ||
+        (kind == IMAGE_CACHE && (header->source_length != source_length ||
+                                 header->source_hash != ktc_hash(source, source_length))) ||
+        (!snapshot && header->object_count != 0) ||
+        (kind != IMAGE_PROGRAM &&
+         header->payload_hash != ktc_hash(header + 1, size - sizeof(KtcHeader))) ||
+        header->function_count == 0 ||
+        header->string_count > size || header->global_count > size ||
+        header->class_count > size || header->function_count > size ||
+        header->module_count > size || header->object_count > size) {
+        return NULL;
+    }
+    
+    KtcTables tables = {0};
+    tables.interp = interp;
+    tables.snapshot = snapshot;
+    tables.strings = (Obj**)calloc(header->string_count + 1, sizeof(Obj*));
+    tables.classes = (Obj**)calloc(header->class_count + 1, sizeof(Obj*));
+    tables.functions = (Obj**)calloc(header->function_count, sizeof(Obj*));
+    tables.objects = (Obj**)calloc(header->object_count + 1, sizeof(Obj*));
+    tables.object_count = header->object_count;
+    Obj* script = NULL;
+    
+    for (uint32_t i = 0; i < header->string_count; i++) {
+        const uint32_t* length = (const uint32_t*)take(&reader, sizeof(uint32_t));
+        const char* chars = length ? (const char*)take(&reader, (size_t)*length + 1) : NULL;
+        if (!chars || chars[*length] != '\0' || strlen(chars) != *length) goto done;
+        tables.strings[i] = constant_string(interp, chars);
+        tables.string_count++;
+    }
+    
+    // The bytecode addresses globals by slot, so the builtins and the
+    // program's globals must land in exactly the slots they were compiled for
+    const uint32_t* globals = (const uint32_t*)take_array(&reader, header->global_count, sizeof(uint32_t));
+    if (!reader.ok) goto done;
+    for (uint32_t i = 0; i < header->global_count; i++) {
+        Obj* name = string_at(&reader, &tables, globals[i]);
+        if (!name || global_slot(interp, name->data.string.chars) != (int)i) goto done;
+    }
+    if (interp->global_scope->count != (int)header->global_count) goto done;
+    
+    for (uint32_t i = 0; i < header->class_count; i++) {
+        const KtcClass* entry = (const KtcClass*)take(&reader, sizeof(KtcClass));
+        if (!entry) goto done;
+        const uint32_t* fields = (const uint32_t*)take_array(&reader, entry->field_count, sizeof(uint32_t));
+        const uint32_t* methods = (const uint32_t*)take_array(&reader, entry->method_count, sizeof(uint32_t));
+        Obj* name = string_at(&reader, &tables, entry->name);
+        if (!reader.ok) goto done;
+        
+        Shape* shape = interp->root_shape;
+        for (uint32_t f = 0; f < entry->field_count; f++) {
+            Obj* key = string_at(&reader, &tables, fields[f]);
+            if (!key) goto done;
+            shape = shape_add(shape, key);
+        }
+        
+        VTable* vtable = vtable_create(interp);
+        for (uint32_t m = 0; m < entry->method_count; m++) {
+            Obj* key = string_at(&reader, &tables, methods[m]);
+            if (!key) goto done;
+            vtable_add(vtable, key);
+        }
+        if (shape->slot_count != (int)entry->field_count ||
+            vtable->count != (int)entry->method_count) goto done;
+        
+        Obj* proto = allocate_permanent(interp, VALUE_CLASS);
+        proto->data.class_obj.name = strdup(name->data.string.chars);
+        proto->data.class_obj.shape = shape;
+        proto->data.class_obj.vtable = vtable;
+        tables.classes[i] = proto;
+        tables.class_count++;
+    }
+    
+    // Every prototype exists before any constant refers to it
+    for (uint32_t i = 0; i < header->function_count; i++) {
+        tables.functions[i] = allocate_permanent(interp, VALUE_FUNCTION);
+    }
+    tables.function_count = header->function_count;
+    for (uint32_t i = 0; i < header->function_count; i++) {
+        if (!load_function(&reader, &tables, tables.functions[i])) goto done;
+    }
+    
+    // Included modules: from a cache each is still pending until its first
+    // use; a snapshot records which ones have already run
+    for (uint32_t i = 0; i < header->module_count; i++) {
+        const KtcModule* entry = (const KtcModule*)take(&reader, sizeof(KtcModule));
+        if (!entry) goto done;
+        const uint32_t* slots = (const uint32_t*)take_array(&reader, entry->slot_count, sizeof(uint32_t));
+        Obj* name = string_at(&reader, &tables, entry->name);
+        Obj* source_path = entry->path == KTC_NONE ? NULL : string_at(&reader, &tables, entry->path);
+        if (!reader.ok || entry->slot_count > header->global_count) goto done;
+        if (entry->function != KTC_NONE && entry->function >= header->function_count) goto done;
+        if (!snapshot && entry->state != MODULE_PENDING) goto done;
+        
+        int* module_slots = (int*)malloc(sizeof(int) * (entry->slot_count + 1));
+        bool valid = true;
+        for (uint32_t s = 0; s < entry->slot_count; s++) {
+            valid = valid && slots[s] < header->global_count;
+            module_slots[s] = (int)slots[s];
+        }
+        valid = valid && module_restore(interp, name->data.string.chars,
+            source_path ? source_path->data.string.chars : NULL,
+            entry->source_hash, (size_t)entry->source_length,
+            entry->function == KTC_NONE ? NULL : tables.functions[entry->function],
+            module_slots, (int)entry->slot_count, (ModuleState)entry->state,
+            kind == IMAGE_CACHE);
+        free(module_slots);
+        if (!valid) goto done;
+    }
+    
+    if (snapshot && !load_heap(&reader, &tables, header->global_count)) goto done;
+    if (reader.position == size) script = tables.functions[0];
+
+done:
+    free(tables.strings);
+    free(tables.classes);
+    free(tables.functions);
+    free(tables.objects);
+    return script;
+}
+
+// Map the image file at path and load it; the interpreter owns the mapping
+// from then on, whether or not the load succeeds
+static Obj* load_file(Interpreter* interp, ImageKind kind, const char* path,
+                      const char* source, size_t source_length) {
+    size_t size = 0;
+    void* data = map_file(path, &size);
+    if (!data) return NULL;
+    
+    interp->cache_map = data;
+    interp->cache_map_size = size;
+    return load_image(interp, kind, (const uint8_t*)data, size, source, source_length);
+}
+
+// Load the compiled script cached for source, or return NULL when the cache
+// is missing, stale or damaged (see load_image)
+Obj* ktc_load(Interpreter* interp, const char* path, const char* source, size_t source_length) {
+    return load_file(interp, IMAGE_CACHE, path, source, source_length);
+}
+
+// Restore a heap snapshot into a fresh interpreter with its builtins
+// registered: code, modules, heap and globals. Returns the top-level script,
+// which has already run, or NULL if the snapshot cannot be used.
+Obj* snapshot_load(Interpreter* interp, const char* path) {
+    return load_file(interp, IMAGE_SNAPSHOT, path, NULL, 0);
+}
+
+// Load a program image built by program_image into a fresh interpreter with
+// its builtins registered. The bytes are borrowed: they must outlive the
+// interpreter. Returns the top-level script, which has not run yet.
+Obj* program_load(Interpreter* interp, const uint8_t* bytes, size_t size) {
+    return load_image(interp, IMAGE_PROGRAM, bytes, size, NULL, 0);
+}
+
+// ============================================================================
+// SAVING
+// ============================================================================
+
+// Objects and strings gathered for one image, and the file being built
+typedef struct {
+    uint8_t* bytes;
+    size_t size;
+    size_t capacity;
+    bool ok;
+    bool snapshot;          // Heap values are allowed
+    Obj* string_index;      // Map from interned string to its index
+    Obj** strings;
+    int string_count;
+    int string_capacity;
+    Obj** functions;
+    int function_count;
+    int function_capacity;
+    Obj** classes;
+    int class_count;
+    int class_capacity;
+    Obj** objects;          // Heap objects of a snapshot, in the order they are saved
+    int object_count;
+    int object_capacity;
+    int* object_table;      // Open-addressed object -> index (-1 empty)
+    int object_table_capacity;
+} KtcWriter;
+
+// Append size bytes, padded with zeros to the block alignment
+static void put(KtcWriter* writer, const void* data, size_t size) {
+    size_t padded = (size + KTC_ALIGN - 1) & ~(size_t)(KTC_ALIGN - 1);
+    
+    if (writer->size + padded > writer->capacity) {
+        while (writer->size + padded > writer->capacity) {
+            writer->capacity = writer->capacity < 4096 ? 4096 : writer->capacity * 2;
+        }
+        writer->bytes = (uint8_t*)realloc(writer->bytes, writer->capacity);
+    }
+    
+    if (size > 0) memcpy(writer->bytes + writer->size, data, size);
+    memset(writer->bytes + writer->size + size, 0, padded - size);
+    writer->size += padded;
+}
+
+// Append object to a list unless it is already there; returns its index
+static int add_unique(Obj*** list, int* count, int* capacity, Obj* object) {
+    for (int i = 0; i < *count; i++) {
+        if ((*list)[i] == object) return i;
+    }
+    
+    if (*count >= *capacity) {
+        *capacity = *capacity < 16 ? 16 : *capacity * 2;
+        *list = (Obj**)realloc(*list, sizeof(Obj*) * *capacity);
+    }
+    (*list)[*count] = object;
+    return (*count)++;
+}
+
+// Index of an interned string in the cache's string table, adding it if new
+static uint32_t string_index(KtcWriter* writer, Obj* string) {
+    Value index;
+    if (map_get(writer->string_index, string, &index)) return (uint32_t)AS_INT(index);
+    
+    if (writer->string_count >= writer->string_capacity) {
+        writer->string_capacity = writer->string_capacity < 64 ? 64 : writer->string_capacity * 2;
+        writer->strings = (Obj**)realloc(writer->strings, sizeof(Obj*) * writer->string_capacity);
+    }
+    writer->strings[writer->string_count] = string;
+    map_set(writer->string_index, string, INT_VAL(writer->string_count));
+    return (uint32_t)writer->string_count++;
+}
+
+static uint32_t name_index(KtcWriter* writer, Interpreter* interp, const char* name) {
+    return string_index(writer, constant_string(interp, name));
+}
+
+// Slot of object in the writer's object table: where it is, or the empty
+// slot where it belongs
+static int object_slot(KtcWriter* writer, Obj* object) {
+    uint32_t mask = (uint32_t)writer->object_table_capacity - 1;
+    uint32_t slot = (uint32_t)(((uintptr_t)object >> 4) * 2654435761u) & mask;
+    
+    while (writer->object_table[slot] >= 0 && writer->objects[writer->object_table[slot]] != object) {
+        slot = (slot + 1) & mask;
+    }
+    return (int)slot;
+}
+
+// Index of a heap object in the snapshot, queueing it to be saved if new.
+// Objects are numbered as they are first reached, so saving them in order
+// while the queue grows walks the whole reachable heap.
+static uint32_t object_index(KtcWriter* writer, Obj* object) {
+    if ((writer->object_count + 1) * 2 > writer->object_table_capacity) {
+        free(writer->object_table);
+        writer->object_table_capacity = writer->object_table_capacity < 256 ? 256 : writer->object_table_capacity * 2;
+        writer->object_table = (int*)malloc(sizeof(int) * writer->object_table_capacity);
+        memset(writer->object_table, -1, sizeof(int) * writer->object_table_capacity);
+        for (int i = 0; i < writer->object_count; i++) {
+            writer->object_table[object_slot(writer, writer->objects[i])] = i;
+        }
+    }
+    
+    int slot = object_slot(writer, object);
+    if (writer->object_table[slot] >= 0) return (uint32_t)writer->object_table[slot];
+    
+    if (writer->object_count >= writer->object_capacity) {
+        writer->object_capacity = writer->object_capacity < 64 ? 64 : writer->object_capacity * 2;
+        writer->objects = (Obj**)realloc(writer->objects, sizeof(Obj*) * writer->object_capacity);
+    }
+    writer->objects[writer->object_count] = object;
+    writer->object_table[slot] = writer->object_count;
+    return (uint32_t)writer->object_count++;
+}
+
+// Encode one value. Prototypes, class layouts and strings become indices
+// into their tables; in a snapshot other objects become indices into the
+// heap and natives are saved by name.
+static KtcValue encode_value(KtcWriter* writer, Interpreter* interp, Value value) {
+    KtcValue encoded = {0};
+    
+    switch (value.type) {
+        case VALUE_NUMBER:
+            encoded.tag = KTC_NUMBER;
+            memcpy(&encoded.bits, &value.data.number, sizeof(double));
+            return encoded;
+        case VALUE_INT:
+            encoded.tag = KTC_INT;
+            encoded.bits = (uint64_t)value.data.integer;
+            return encoded;
+        case VALUE_STRING:
+            encoded.tag = KTC_STRING;
+            encoded.bits = string_index(writer, AS_OBJ(value));
+            return encoded;
+        case VALUE_FUNCTION:
+            if (!AS_OBJ(value)->is_permanent) break;
+            encoded.tag = KTC_FUNCTION;
+            encoded.bits = (uint64_t)add_unique(&writer->functions, &writer->function_count,
+                &writer->function_capacity, AS_OBJ(value));
+            return encoded;
+        case VALUE_CLASS:
+            if (!AS_OBJ(value)->is_permanent) break;
+            encoded.tag = KTC_CLASS;
+            encoded.bits = (uint64_t)add_unique(&writer->classes, &writer->class_count,
+                &writer->class_capacity, AS_OBJ(value));
+            return encoded;
+        default:
+            break;
+    }
+    
+    // The compiler emits no other constants; refuse rather than guess
+    if (!writer->snapshot) {
+        writer->ok = false;
+        return encoded;
+    }
+    
+    switch (value.type) {
+        case VALUE_UNDEFINED:
+            encoded.tag = KTC_UNDEFINED;
+            break;
+        case VALUE_NULL:
+            encoded.tag = KTC_NULL;
+            break;
+        case VALUE_BOOL:
+            encoded.tag = KTC_BOOL;
+            encoded.bits = value.data.boolean ? 1 : 0;
+            break;
+        case VALUE_VEC2:
+        case VALUE_VEC3:
+        case VALUE_COLOR:
+            encoded.tag = value.type == VALUE_VEC2 ? KTC_VEC2 : value.type == VALUE_VEC3 ? KTC_VEC3 : KTC_COLOR;
+            memcpy(&encoded.bits, &value.data, sizeof(encoded.bits));
+            if (value.type == VALUE_VEC3) memcpy(&encoded.extra, &value.z, sizeof(float));
+            break;
+        case VALUE_ROPE:
+            encoded.tag = KTC_STRING;
+            encoded.bits = string_index(writer, string_flatten(interp, AS_OBJ(value)));
+            break;
+        case VALUE_NATIVE_FUNCTION:
+            encoded.tag = KTC_NATIVE;
+            encoded.bits = name_index(writer, interp, AS_OBJ(value)->data.native_function.name);
+            break;
+        case VALUE_LIST:
+        case VALUE_MAP:
+        case VALUE_RANGE:
+        case VALUE_ARRAY:
+        case VALUE_FUNCTION:
+        case VALUE_UPVALUE:
+        case VALUE_CLASS:
+        case VALUE_INSTANCE:
+            encoded.tag = KTC_OBJECT;
+            encoded.bits = object_index(writer, AS_OBJ(value));
+            break;
+        default:
+            // Sprites and components hold native resources that cannot be saved
+            writer->ok = false;
+            break;
+    }
+    return encoded;
+}
+
+// Index of the prototype a closure or class object was made from, or -1
+static int find_proto(Obj** protos, int count, Obj* object) {
+    for (int i = 0; i < count; i++) {
+        if (object->type == VALUE_FUNCTION
+            ? protos[i]->data.function.chunk == object->data.function.chunk
+            : protos[i]->data.class_obj.vtable == object->data.class_obj.vtable) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Encode one heap object of a snapshot into heap, queueing what it refers to
+static void encode_object(KtcWriter* writer, Interpreter* interp, KtcWriter* heap, Obj* object) {
+    KtcObject entry = {0};
+    entry.type = (uint32_t)object->type;
+    
+    Value* values = NULL;
+    int count = 0;
+    Value* extra = NULL;
+    int extra_count = 0;
+    
+    switch (object->type) {
+        case VALUE_LIST:
+            values = object->data.list.elements;
+            count = object->data.list.count;
+            break;
+            
+        case VALUE_MAP: {
+            // Saved as key, value pairs without the deleted entries
+            KtcValue* pairs = (KtcValue*)malloc(sizeof(KtcValue) * (object->data.map.live * 2 + 1));
+            int pair_count = 0;
+            for (int i = 0; i < object->data.map.count; i++) {
+                MapEntry* map_entry = &object->data.map.entries[i];
+                if (!map_entry->key) continue;
+                pairs[pair_count++] = encode_value(writer, interp, OBJ_VAL(map_entry->key));
+                pairs[pair_count++] = encode_value(writer, interp, map_entry->value);
+            }
+            entry.count = (uint32_t)pair_count;
+            put(heap, &entry, sizeof(entry));
+            put(heap, pairs, sizeof(KtcValue) * pair_count);
+            free(pairs);
+            return;
+        }
+        
+        case VALUE_RANGE:
+            values = &object->data.range.start;
+            count = 3;
+            break;
+            
+        case VALUE_ARRAY:
+            entry.count = (uint32_t)object->data.array.count;
+            entry.a = (uint32_t)object->data.array.kind;
+            put(heap, &entry, sizeof(entry));
+            put(heap, object->data.array.data, array_element_size(object->data.array.kind) * entry.count);
+            return;
+            
+        case VALUE_UPVALUE:
+            // Only calls still in progress keep upvalues open, and none are
+            if (object->data.upvalue.location != &object->data.upvalue.closed) writer->ok = false;
+            values = &object->data.upvalue.closed;
+            count = 1;
+            break;
+            
+        case VALUE_FUNCTION: {
+            int proto = find_proto(writer->functions, writer->function_count, object);
+            if (proto < 0) writer->ok = false;
+            entry.a = (uint32_t)proto;
+            
+            count = object->data.function.upvalue_count;
+            KtcValue* upvalues = (KtcValue*)malloc(sizeof(KtcValue) * (count + 1));
+            for (int i = 0; i < count; i++) {
+                upvalues[i] = encode_value(writer, interp, OBJ_VAL(object->data.function.upvalues[i]));
+            }
+            entry.count = (uint32_t)count;
+            put(heap, &entry, sizeof(entry));
+            put(heap, upvalues, sizeof(KtcValue) * count);
+            free(upvalues);
+            return;
+        }
+        
+        case VALUE_CLASS: {
+            int proto = find_proto(writer->classes, writer->class_count, object);
+            if (proto < 0) writer->ok = false;
+            entry.a = (uint32_t)proto;
+            values = object->data.class_obj.methods;
+            count = object->data.class_obj.vtable->count;
+            extra = object->data.class_obj.defaults;
+            extra_count = object->data.class_obj.shape->slot_count;
+            break;
+        }
+        
+        case VALUE_INSTANCE: {
+            // The class, the field names in slot order, then the field values
+            Shape* shape = object->data.instance.shape;
+            entry.a = (uint32_t)shape->slot_count;
+            entry.count = 1 + 2 * entry.a;
+            
+            KtcValue* fields = (KtcValue*)malloc(sizeof(KtcValue) * entry.count);
+            fields[0] = encode_value(writer, interp, OBJ_VAL(object->data.instance.class_ref));
+            for (int i = 0; i < shape->slot_count; i++) {
+                fields[1 + i] = encode_value(writer, interp, OBJ_VAL(shape->keys[i]));
+                fields[1 + shape->slot_count + i] = encode_value(writer, interp, object->data.instance.slots[i]);
+            }
+            put(heap, &entry, sizeof(entry));
+            put(heap, fields, sizeof(KtcValue) * entry.count);
+            free(fields);
+            return;
+        }
+        
+        default:
+            writer->ok = false;
+            return;
+    }
+    
+    entry.count = (uint32_t)(count + extra_count);
+    KtcValue* encoded = (KtcValue*)malloc(sizeof(KtcValue) * (entry.count + 1));
+    for (int i = 0; i < count; i++) encoded[i] = encode_value(writer, interp, values[i]);
+    for (int i = 0; i < extra_count; i++) encoded[count + i] = encode_value(writer, interp, extra[i]);
+    put(heap, &entry, sizeof(entry));
+    put(heap, encoded, sizeof(KtcValue) * entry.count);
+    free(encoded);
+}
+
+// The inline cache entries of chunk keyed by a saved class's shape or
+// vtable, as a malloc'd array; any other entry is left to be relearned
+static KtcCacheEntry* encode_caches(KtcWriter* writer, Chunk* chunk, uint32_t* count) {
+    KtcCacheEntry* entries = (KtcCacheEntry*)malloc(sizeof(KtcCacheEntry) * (chunk->cache_count * KT_IC_WAYS + 1));
+    *count = 0;
+    
+    for (int c = 0; c < chunk->cache_count; c++) {
+        InlineCache* cache = &chunk->caches[c];
+        for (int e = 0; e < cache->count; e++) {
+            for (int k = 0; k < writer->class_count; k++) {
+                Obj* klass = writer->classes[k];
+                bool shape = cache->keys[e] == (const void*)klass->data.class_obj.shape;
+                bool method = cache->keys[e] == (const void*)klass->data.class_obj.vtable;
+                if (!shape && !method) continue;
+                
+                KtcCacheEntry* entry = &entries[(*count)++];
+                entry->cache = (uint32_t)c;
+                entry->klass = (uint32_t)k;
+                entry->method = method ? 1 : 0;
+                entry->slot = (uint32_t)cache->slots[e];
+                break;
+            }
+        }
+    }
+    return entries;
+}
+
+// Replace path with size bytes: written to a temporary file and renamed into
+// place, so a reader never sees half a cache
+static bool write_file(const char* path, const void* bytes, size_t size) {
+    size_t temp_length = strlen(path) + 5;
+    char* temp_path = (char*)malloc(temp_length);
+    snprintf(temp_path, temp_length, "%s.tmp", path);
+    
+    bool ok = false;
+    FILE* file = fopen(temp_path, "wb");
+    if (file) {
+        ok = fwrite(bytes, 1, size, file) == size;
+        if (fclose(file) != 0) ok = false;
+#ifdef _WIN32
+        if (ok) remove(path);
+#endif
+        if (ok && rename(temp_path, path) != 0) ok = false;
+        if (!ok) remove(temp_path);
+    }
+    free(temp_path);
+    return ok;
+}
+
+// Build the image of kind for a compiled script: a cache keyed by source,
+// or once the script has run a snapshot. On success *bytes is a malloc'd
+// image the caller frees; false if any of it cannot be saved.
+static bool build_image(Interpreter* interp, ImageKind kind, Obj* script,
+                        const char* source, size_t source_length,
+                        uint8_t** bytes, size_t* size) {
+    KtcWriter writer = {0};
+    writer.ok = true;
+    writer.snapshot = kind == IMAGE_SNAPSHOT;
+    writer.string_index = create_object(VALUE_MAP);
+    add_unique(&writer.functions, &writer.function_count, &writer.function_capacity, script);
+    
+    // Compiled script modules are saved with the program that includes them.
+    // A module that failed to load would not report it again from the cache.
+    int module_count = 0;
+    for (Module* module = interp->modules; module; module = module->next) {
+        if (module->state == MODULE_FAILED) writer.ok = false;
+        if (module->state != MODULE_PENDING && module->state != MODULE_READY) continue;
+        
+        module_count++;
+        name_index(&writer, interp, module->name);
+        if (module->path) name_index(&writer, interp, module->path);
+        if (module->script) {
+            add_unique(&writer.functions, &writer.function_count, &writer.function_capacity, module->script);
+        }
+    }
+    
+    // Encode every function, which discovers the functions, classes and
+    // strings they refer to; the list grows while it is walked
+    KtcValue** encoded = NULL;
+    for (int i = 0; i < writer.function_count; i++) {
+        Chunk* chunk = writer.functions[i]->data.function.chunk;
+        encoded = (KtcValue**)realloc(encoded, sizeof(KtcValue*) * (i + 1));
+        encoded[i] = (KtcValue*)malloc(sizeof(KtcValue) * (chunk->constant_count + 1));
+        
+        name_index(&writer, interp, writer.functions[i]->data.function.name);
+        for (int c = 0; c < chunk->constant_count; c++) {
+            encoded[i][c] = encode_value(&writer, interp, chunk->constants[c]);
+        }
+    }
+    
+    Scope* globals = interp->global_scope;
+    uint32_t* global_names = (uint32_t*)malloc(sizeof(uint32_t) * (globals->count + 1));
+    for (int i = 0; i < globals->count; i++) {
+        global_names[i] = name_index(&writer, interp, globals->names[i]);
+    }
+    
+    // A snapshot's heap: everything reachable from the globals, encoded
+    // before the tables are written because it adds strings to them
+    KtcWriter heap = {0};
+    if (writer.snapshot) {
+        KtcValue* values = (KtcValue*)malloc(sizeof(KtcValue) * (globals->count + 1));
+        for (int i = 0; i < globals->count; i++) {
+            values[i] = encode_value(&writer, interp, globals->values[i]);
+        }
+        for (int i = 0; i < writer.object_count; i++) {
+            encode_object(&writer, interp, &heap, writer.objects[i]);
+        }
+        put(&heap, values, sizeof(KtcValue) * globals->count);
+        free(values);
+    }
+    
+    for (int i = 0; i < writer.class_count; i++) {
+        Obj* klass = writer.classes[i];
+        name_index(&writer, interp, klass->data.class_obj.name);
+        for (int f = 0; f < klass->data.class_obj.shape->slot_count; f++) {
+            string_index(&writer, klass->data.class_obj.shape->keys[f]);
+        }
+        for (int m = 0; m < klass->data.class_obj.vtable->count; m++) {
+            string_index(&writer, klass->data.class_obj.vtable->names[m]);
+        }
+    }
+    
+    bool built = false;
+    if (writer.ok) {
+        KtcHeader header = {0};
+        memcpy(header.magic, image_magic(kind), 4);
+        header.version = KT_BYTECODE_VERSION;
+        header.opcode_count = KT_OPCODE_COUNT;
+        header.value_size = sizeof(Value);
+        if (source) {
+            header.source_hash = ktc_hash(source, source_length);
+            header.source_length = source_length;
+        }
+        header.string_count = (uint32_t)writer.string_count;
+        header.global_count = (uint32_t)globals->count;
+        header.class_count = (uint32_t)writer.class_count;
+        header.function_count = (uint32_t)writer.function_count;
+        header.module_count = (uint32_t)module_count;
+        header.object_count = (uint32_t)writer.object_count;
+        put(&writer, &header, sizeof(header));
+        
+        for (int i = 0; i < writer.string_count; i++) {
+            uint32_t length = (uint32_t)writer.strings[i]->data.string.length;
+            put(&writer, &length, sizeof(length));
+            put(&writer, writer.strings[i]->data.string.chars, length + 1);
+        }
+        
+        put(&writer, global_names, sizeof(uint32_t) * globals->count);
+        
+        for (int i = 0; i < writer.class_count; i++) {
+            Obj* klass = writer.classes[i];
+            Shape* shape = klass->data.class_obj.shape;
+            VTable* vtable = klass->data.class_obj.vtable;
+            KtcClass entry = {0};
+            entry.name = name_index(&writer, interp, klass->data.class_obj.name);
+            entry.field_count = (uint32_t)shape->slot_count;
+            entry.method_count = (uint32_t)vtable->count;
+            put(&writer, &entry, sizeof(entry));
+            
+            uint32_t* keys = (uint32_t*)malloc(sizeof(uint32_t) * (shape->slot_count + vtable->count + 1));
+            for (int f = 0; f < shape->slot_count; f++) keys[f] = string_index(&writer, shape->keys[f]);
+            put(&writer, keys, sizeof(uint32_t) * shape->slot_count);
+            for (int m = 0; m < vtable->count; m++) keys[m] = string_index(&writer, vtable->names[m]);
+            put(&writer, keys, sizeof(uint32_t) * vtable->count);
+            free(keys);
+        }
+        
+        for (int i = 0; i < writer.function_count; i++) {
+            Obj* function = writer.functions[i];
+            Chunk* chunk = function->data.function.chunk;
+            KtcFunction entry = {0};
+            entry.name = name_index(&writer, interp, function->data.function.name);
+            entry.param_count = (uint32_t)function->data.function.param_count;
+            entry.local_count = (uint32_t)function->data.function.local_count;
+            entry.upvalue_count = (uint32_t)function->data.function.upvalue_count;
+            entry.code_count = (uint32_t)chunk->count;
+            entry.constant_count = (uint32_t)chunk->constant_count;
+            entry.cache_count = (uint32_t)chunk->cache_count;
+            KtcCacheEntry* entries = encode_caches(&writer, chunk, &entry.entry_count);
+            put(&writer, &entry, sizeof(entry));
+            
+            // Copied field by field so the padding in the file is zero
+            UpvalueRef* captures = (UpvalueRef*)calloc(entry.upvalue_count + 1, sizeof(UpvalueRef));
+            for (uint32_t u = 0; u < entry.upvalue_count; u++) {
+                captures[u].is_local = function->data.function.captures[u].is_local;
+                captures[u].index = function->data.function.captures[u].index;
+            }
+            put(&writer, captures, sizeof(UpvalueRef) * entry.upvalue_count);
+            free(captures);
+            
+            put(&writer, encoded[i], sizeof(KtcValue) * entry.constant_count);
+            put(&writer, entries, sizeof(KtcCacheEntry) * entry.entry_count);
+            free(entries);
+            put(&writer, chunk->lines, sizeof(int) * entry.code_count);
+            put(&writer, chunk->code, entry.code_count);
+        }
+        
+        for (Module* module = interp->modules; module; module = module->next) {
+            if (module->state != MODULE_PENDING && module->state != MODULE_READY) continue;
+            
+            KtcModule entry = {0};
+            entry.name = name_index(&writer, interp, module->name);
+            entry.path = module->native ? KTC_NONE : name_index(&writer, interp, module->path);
+            entry.function = KTC_NONE;
+            for (int i = 0; module->script && i < writer.function_count; i++) {
+                if (writer.functions[i] == module->script) entry.function = (uint32_t)i;
+            }
+            entry.slot_count = (uint32_t)module->slot_count;
+            entry.state = (uint32_t)module->state;
+            entry.source_hash = module->source_hash;
+            entry.source_length = module->source_length;
+            put(&writer, &entry, sizeof(entry));
+            
+            uint32_t* slots = (uint32_t*)malloc(sizeof(uint32_t) * (module->slot_count + 1));
+            for (int i = 0; i < module->slot_count; i++) slots[i] = (uint32_t)module->slots[i];
+            put(&writer, slots, sizeof(uint32_t) * module->slot_count);
+            free(slots);
+        }
+        
+        if (heap.size > 0) put(&writer, heap.bytes, heap.size);
+        
+        KtcHeader* image = (KtcHeader*)writer.bytes;
+        image->payload_hash = ktc_hash(image + 1, writer.size - sizeof(KtcHeader));
+        *bytes = writer.bytes;
+        *size = writer.size;
+        writer.bytes = NULL;
+        built = true;
+    }
+    
+    for (int i = 0; i < writer.function_count; i++) free(encoded[i]);
+    free(encoded);
+    free(global_names);
+    free(heap.bytes);
+    free(writer.bytes);
+    free(writer.strings);
+    free(writer.functions);
+    free(writer.classes);
+    free(writer.objects);
+    free(writer.object_table);
+    free_object(writer.string_index);
+    return built;
+}
+
+// Build an image and write it to path; false, writing nothing, on failure
+static bool save_image(Interpreter* interp, ImageKind kind, const char* path, Obj* script,
+                       const char* source, size_t source_length) {
+    uint8_t* bytes = NULL;
+    size_t size = 0;
+    if (!build_image(interp, kind, script, source, source_length, &bytes, &size)) return false;
+    
+    bool written = write_file(path, bytes, size);
+    free(bytes);
+    return written;
+}
+
+// Write the cache for a freshly compiled script; any failure just leaves no
+// cache behind
+void ktc_save(Interpreter* interp, const char* path, Obj* script,
+              const char* source, size_t source_length) {
+    save_image(interp, IMAGE_CACHE, path, script, source, source_length);
+}
+
+// Write a heap snapshot of an interpreter whose script has run: its code,
+// modules, globals and every object they reach. False if the heap holds
+// something that cannot be saved (a sprite, a component, a module that
+// failed to load) or the file cannot be written.
+bool snapshot_save(Interpreter* interp, const char* path, Obj* script) {
+    return save_image(interp, IMAGE_SNAPSHOT, path, script, NULL, 0);
+}
+
+// Build the in-memory image of a freshly compiled script for program_load
+// (*bytes is malloc'd); false if it includes a module that failed to load
+bool program_image(Interpreter* interp, Obj* script, uint8_t** bytes, size_t* size) {
+    return build_image(interp, IMAGE_PROGRAM, script, NULL, 0, bytes, size);
+}
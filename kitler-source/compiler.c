@@ -0,0 +1,621 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+// Bytecode compiler for Kitler
+// Lowers the AST from parser_parse into one Chunk per function body.
+
+typedef struct {
+    Interpreter* interp;
+    Chunk* chunk;
+    int* constant_index;    // Open-addressing table of constant slots (-1 empty)
+    int index_capacity;
+    bool had_error;         // A limit was exceeded, so the chunk must never run
+} Compiler;
+
+// Forward declarations
+static void compile_statement(Compiler* compiler, ASTNode* node);
+static void compile_expression(Compiler* compiler, ASTNode* node);
+
+// ============================================================================
+// CHUNK WRITING
+// ============================================================================
+
+// Append one byte to the chunk
+static void emit_byte(Compiler* compiler, uint8_t byte, int line) {
+    Chunk* chunk = compiler->chunk;
+    
+    if (chunk->count >= chunk->capacity) {
+        chunk->capacity = chunk->capacity < 64 ? 64 : chunk->capacity * 2;
+        chunk->code = (uint8_t*)realloc(chunk->code, chunk->capacity);
+        chunk->lines = (int*)realloc(chunk->lines, sizeof(int) * chunk->capacity);
+    }
+    
+    chunk->code[chunk->count] = byte;
+    chunk->lines[chunk->count] = line;
+    chunk->count++;
+}
+
+// Append an opcode with a 16-bit operand
+static void emit_op_short(Compiler* compiler, OpCode op, int operand, int line) {
+    emit_byte(compiler, (uint8_t)op, line);
+    emit_byte(compiler, (uint8_t)((operand >> 8) & 0xff), line);
+    emit_byte(compiler, (uint8_t)(operand & 0xff), line);
+}
+
+// Hash a constant by its exact bits, so 0 and -0 stay distinct
+static uint32_t hash_constant(Value value) {
+    uint64_t bits = 0;
+    if (IS_OBJ(value)) {
+        bits = (uint64_t)(uintptr_t)AS_OBJ(value);
+    } else {
+        memcpy(&bits, &value.data.number, sizeof(double));
+    }
+    
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits ^ (uint32_t)value.type;
+}
+
+static bool same_constant(Value a, Value b) {
+    if (a.type != b.type) return false;
+    if (IS_OBJ(a)) return AS_OBJ(a) == AS_OBJ(b);
+    return memcmp(&a.data.number, &b.data.number, sizeof(double)) == 0;
+}
+
+// Find the slot of an equal constant already in the pool, or -1; *index is
+// left at the table position where it belongs
+static int find_constant(Compiler* compiler, Value value, uint32_t* index) {
+    uint32_t mask = (uint32_t)compiler->index_capacity - 1;
+    
+    for (*index = hash_constant(value) & mask;
+         compiler->constant_index[*index] >= 0;
+         *index = (*index + 1) & mask) {
+        int slot = compiler->constant_index[*index];
+        if (same_constant(compiler->chunk->constants[slot], value)) return slot;
+    }
+    return -1;
+}
+
+// Rebuild the constant index with room for twice as many entries
+static void grow_constant_index(Compiler* compiler) {
+    int capacity = compiler->index_capacity < 16 ? 16 : compiler->index_capacity * 2;
+    free(compiler->constant_index);
+    compiler->constant_index = (int*)malloc(sizeof(int) * capacity);
+    compiler->index_capacity = capacity;
+    
+    for (int i = 0; i < capacity; i++) compiler->constant_index[i] = -1;
+    
+    for (int slot = 0; slot < compiler->chunk->constant_count; slot++) {
+        uint32_t index;
+        find_constant(compiler, compiler->chunk->constants[slot], &index);
+        compiler->constant_index[index] = slot;
+    }
+}
+
+// Add a value to the constant pool and return its index (equal constants share one slot)
+static int add_constant(Compiler* compiler, Value value) {
+    Chunk* chunk = compiler->chunk;
+    
+    if ((chunk->constant_count + 1) * 2 > compiler->index_capacity) {
+        grow_constant_index(compiler);
+    }
+    
+    uint32_t index;
+    int existing = find_constant(compiler, value, &index);
+    if (existing >= 0) return existing;
+    
+    if (chunk->constant_count >= chunk->constant_capacity) {
+        chunk->constant_capacity = chunk->constant_capacity < 8 ? 8 : chunk->constant_capacity * 2;
+        chunk->constants = (Value*)realloc(chunk->constants,
+            sizeof(Value) * chunk->constant_capacity);
+    }
+    
+    if (chunk->constant_count > 0xffff) {
+        fprintf(stderr, "Compile error: too many constants in one function\n");
+        compiler->had_error = true;
+        return 0;
+    }
+    
+    chunk->constants[chunk->constant_count] = value;
+    compiler->constant_index[index] = chunk->constant_count;
+    return chunk->constant_count++;
+}
+
+// Reserve an inline cache for one field access site and return its index
+static int add_cache(Compiler* compiler) {
+    Chunk* chunk = compiler->chunk;
+    
+    if (chunk->cache_count > 0xffff) {
+        fprintf(stderr, "Compile error: too many field accesses in one function\n");
+        compiler->had_error = true;
+        return 0;
+    }
+    
+    if (chunk->cache_count >= chunk->cache_capacity) {
+        chunk->cache_capacity = chunk->cache_capacity < 8 ? 8 : chunk->cache_capacity * 2;
+        chunk->caches = (InlineCache*)realloc(chunk->caches,
+            sizeof(InlineCache) * chunk->cache_capacity);
+    }
+    
+    memset(&chunk->caches[chunk->cache_count], 0, sizeof(InlineCache));
+    return chunk->cache_count++;
+}
+
+// Emit a field access or method call op: name constant, then an inline cache
+// that starts with whatever slots the resolver already knew
+static void emit_field_op(Compiler* compiler, OpCode op, ASTNode* access, int line) {
+    emit_op_short(compiler, op,
+        add_constant(compiler, OBJ_VAL(access->data.member_access.key)), line);
+    int cache = add_cache(compiler);
+    compiler->chunk->caches[cache] = *access->data.member_access.cache;
+    emit_byte(compiler, (uint8_t)((cache >> 8) & 0xff), line);
+    emit_byte(compiler, (uint8_t)(cache & 0xff), line);
+}
+
+// Emit a local or upvalue op: the short form with a u8 operand when the
+// slot fits, else the long form with a u16 one
+static void emit_slot_op(Compiler* compiler, OpCode op, OpCode long_op, int slot, int line) {
+    if (slot <= 0xff) {
+        emit_byte(compiler, (uint8_t)op, line);
+        emit_byte(compiler, (uint8_t)slot, line);
+        return;
+    }
+    
+    if (slot > 0xffff) {
+        fprintf(stderr, "Compile error at line %d: too many variables in one function\n", line);
+        compiler->had_error = true;
+    }
+    emit_op_short(compiler, long_op, slot, line);
+}
+
+// Emit a load of a resolved variable
+static void emit_get(Compiler* compiler, int depth, int slot, int line) {
+    if (depth < 0) {
+        emit_op_short(compiler, OP_GET_GLOBAL, slot, line);
+    } else if (depth == 0) {
+        emit_slot_op(compiler, OP_GET_LOCAL, OP_GET_LOCAL_LONG, slot, line);
+    } else {
+        emit_slot_op(compiler, OP_GET_UPVALUE, OP_GET_UPVALUE_LONG, slot, line);
+    }
+}
+
+// Emit a store to a resolved variable (value stays on the stack)
+static void emit_set(Compiler* compiler, int depth, int slot, int line) {
+    if (depth < 0) {
+        emit_op_short(compiler, OP_SET_GLOBAL, slot, line);
+    } else if (depth == 0) {
+        emit_slot_op(compiler, OP_SET_LOCAL, OP_SET_LOCAL_LONG, slot, line);
+    } else {
+        emit_slot_op(compiler, OP_SET_UPVALUE, OP_SET_UPVALUE_LONG, slot, line);
+    }
+}
+
+// Emit a declaration binding (pops the value)
+static void emit_define(Compiler* compiler, int depth, int slot, int line) {
+    if (depth < 0) {
+        emit_op_short(compiler, OP_DEFINE_GLOBAL, slot, line);
+    } else {
+        emit_set(compiler, depth, slot, line);
+        emit_byte(compiler, OP_POP, line);
+    }
+}
+
+// Emit a forward jump and return the offset of its operand
+static int emit_jump(Compiler* compiler, OpCode op, int line) {
+    emit_op_short(compiler, op, 0xffff, line);
+    return compiler->chunk->count - 2;
+}
+
+// Point a forward jump at the current end of the chunk
+static void patch_jump(Compiler* compiler, int offset) {
+    int jump = compiler->chunk->count - offset - 2;
+    
+    if (jump > 0xffff) {
+        fprintf(stderr, "Compile error: jump too large\n");
+        compiler->had_error = true;
+        return;
+    }
+    
+    compiler->chunk->code[offset] = (uint8_t)((jump >> 8) & 0xff);
+    compiler->chunk->code[offset + 1] = (uint8_t)(jump & 0xff);
+}
+
+// Emit a backward jump to loop_start
+static void emit_loop(Compiler* compiler, int loop_start, int line) {
+    int offset = compiler->chunk->count - loop_start + 3;
+    
+    if (offset > 0xffff) {
+        fprintf(stderr, "Compile error: loop body too large\n");
+        compiler->had_error = true;
+    }
+    
+    emit_op_short(compiler, OP_LOOP, offset, line);
+}
+
+// ============================================================================
+// EXPRESSIONS
+// ============================================================================
+
+// Compile literal into a constant load
+static void compile_literal(Compiler* compiler, ASTNode* node) {
+    Value value = NULL_VAL;
+    
+    switch (node->data.literal.literal_type) {
+        case LITERAL_NUMBER:
+            value = NUMBER_VAL(node->data.literal.literal_value.number);
+            break;
+        case LITERAL_INT:
+            value = INT_VAL(node->data.literal.literal_value.integer);
+            break;
+        case LITERAL_STRING:
+            // Permanent constant shared with the tree walker
+            value = OBJ_VAL(node->data.literal.constant);
+            break;
+        case LITERAL_BOOL:
+            emit_byte(compiler, node->data.literal.literal_value.boolean ? OP_TRUE : OP_FALSE,
+                node->line);
+            return;
+        case LITERAL_NULL:
+            emit_byte(compiler, OP_NULL, node->line);
+            return;
+    }
+    
+    emit_op_short(compiler, OP_CONSTANT, add_constant(compiler, value), node->line);
+}
+
+// Map a binary operator token to its opcode
+static OpCode binary_opcode(TokenType op) {
+    switch (op) {
+        case TOKEN_PLUS: return OP_ADD;
+        case TOKEN_MINUS: return OP_SUBTRACT;
+        case TOKEN_STAR: return OP_MULTIPLY;
+        case TOKEN_SLASH: return OP_DIVIDE;
+        case TOKEN_PERCENT: return OP_MODULO;
+        case TOKEN_EQUAL: return OP_EQUAL;
+        case TOKEN_NOT_EQUAL: return OP_NOT_EQUAL;
+        case TOKEN_LESS: return OP_LESS;
+        case TOKEN_LESS_EQUAL: return OP_LESS_EQUAL;
+        case TOKEN_GREATER: return OP_GREATER;
+        case TOKEN_GREATER_EQUAL: return OP_GREATER_EQUAL;
+        case TOKEN_AND: return OP_AND;
+        case TOKEN_OR: return OP_OR;
+        default: return OP_ADD;
+    }
+}
+
+// Compile function call: callee, then arguments, then OP_CALL. A method call
+// pushes the receiver in the callee's place and uses OP_INVOKE instead.
+static void compile_call(Compiler* compiler, ASTNode* node) {
+    if (node->data.call.arg_count > 255) {
+        fprintf(stderr, "Compile error at line %d: too many arguments\n", node->line);
+        compiler->had_error = true;
+    }
+    
+    ASTNode* callee = node->data.call.callee;
+    if (callee->type == NODE_MEMBER_ACCESS) {
+        compile_expression(compiler, callee->data.member_access.object);
+        for (int i = 0; i < node->data.call.arg_count; i++) {
+            compile_expression(compiler, node->data.call.args[i]);
+        }
+        
+        emit_field_op(compiler, OP_INVOKE, callee, node->line);
+        emit_byte(compiler, (uint8_t)node->data.call.arg_count, node->line);
+        return;
+    }
+    
+    compile_expression(compiler, callee);
+    for (int i = 0; i < node->data.call.arg_count; i++) {
+        compile_expression(compiler, node->data.call.args[i]);
+    }
+    
+    emit_byte(compiler, OP_CALL, node->line);
+    emit_byte(compiler, (uint8_t)node->data.call.arg_count, node->line);
+}
+
+// Compile instantiation: class, then arguments, then OP_NEW
+static void compile_new_instance(Compiler* compiler, ASTNode* node) {
+    if (node->data.new_instance.arg_count > 255) {
+        fprintf(stderr, "Compile error at line %d: too many arguments\n", node->line);
+        compiler->had_error = true;
+    }
+    
+    compile_expression(compiler, node->data.new_instance.class_ref);
+    for (int i = 0; i < node->data.new_instance.arg_count; i++) {
+        compile_expression(compiler, node->data.new_instance.args[i]);
+    }
+    
+    emit_byte(compiler, OP_NEW, node->line);
+    emit_byte(compiler, (uint8_t)node->data.new_instance.arg_count, node->line);
+}
+
+// Compile expression (leaves exactly one value on the stack)
+static void compile_expression(Compiler* compiler, ASTNode* node) {
+    if (!node) {
+        emit_byte(compiler, OP_NULL, 0);
+        return;
+    }
+    
+    switch (node->type) {
+        case NODE_LITERAL:
+            compile_literal(compiler, node);
+            break;
+            
+        case NODE_IDENTIFIER:
+            emit_get(compiler, node->data.identifier.depth, node->data.identifier.slot,
+                node->line);
+            break;
+            
+        case NODE_BINARY_OP:
+            compile_expression(compiler, node->data.binary_op.left);
+            compile_expression(compiler, node->data.binary_op.right);
+            emit_byte(compiler, binary_opcode(node->data.binary_op.operator), node->line);
+            break;
+            
+        case NODE_CALL:
+            compile_call(compiler, node);
+            break;
+            
+        case NODE_MEMBER_ACCESS:
+            compile_expression(compiler, node->data.member_access.object);
+            emit_field_op(compiler, OP_GET_FIELD, node, node->line);
+            break;
+            
+        case NODE_NEW_INSTANCE:
+            compile_new_instance(compiler, node);
+            break;
+            
+        case NODE_ASSIGN:
+            if (node->data.assignment.target->type == NODE_MEMBER_ACCESS) {
+                ASTNode* target = node->data.assignment.target;
+                compile_expression(compiler, target->data.member_access.object);
+                compile_expression(compiler, node->data.assignment.value);
+                emit_field_op(compiler, OP_SET_FIELD, target, node->line);
+                break;
+            }
+            
+            compile_expression(compiler, node->data.assignment.value);
+            if (node->data.assignment.target->type == NODE_IDENTIFIER) {
+                ASTNode* target = node->data.assignment.target;
+                emit_set(compiler, target->data.identifier.depth, target->data.identifier.slot,
+                    node->line);
+            }
+            break;
+            
+        default:
+            // Not supported by the runtime yet; evaluates to null like eval_expression
+            emit_byte(compiler, OP_NULL, node->line);
+            break;
+    }
+}
+
+// ============================================================================
+// STATEMENTS
+// ============================================================================
+
+static Obj* compile_function(Compiler* enclosing, ASTNode* node, ASTNode* body);
+
+// Compile class declaration: OP_CLASS, then each field default and method
+// into its slot
+static void compile_class(Compiler* compiler, ASTNode* node) {
+    // The prototype carries the name, shape and vtable; OP_CLASS copies them
+    Obj* proto = allocate_permanent(compiler->interp, VALUE_CLASS);
+    proto->data.class_obj.name = strdup(node->data.class_decl.name);
+    proto->data.class_obj.shape = node->data.class_decl.shape;
+    proto->data.class_obj.vtable = node->data.class_decl.vtable;
+    emit_op_short(compiler, OP_CLASS, add_constant(compiler, OBJ_VAL(proto)), node->line);
+    
+    for (int i = 0; i < node->data.class_decl.member_count; i++) {
+        ASTNode* field = node->data.class_decl.members[i];
+        
+        if (field->type == NODE_FUNCDECL) {
+            if (field->data.func_decl.slot > 255) {
+                fprintf(stderr, "Compile error at line %d: too many methods in class %s\n",
+                    field->line, node->data.class_decl.name);
+                compiler->had_error = true;
+                continue;
+            }
+            
+            Obj* method = compile_function(compiler, field, field->data.func_decl.body);
+            emit_op_short(compiler, OP_FUNCTION, add_constant(compiler, OBJ_VAL(method)), field->line);
+            emit_byte(compiler, OP_METHOD, field->line);
+            emit_byte(compiler, (uint8_t)field->data.func_decl.slot, field->line);
+            continue;
+        }
+        
+        if (field->data.var_decl.slot > 255) {
+            fprintf(stderr, "Compile error at line %d: too many fields in class %s\n",
+                field->line, node->data.class_decl.name);
+            compiler->had_error = true;
+            continue;
+        }
+        
+        compile_expression(compiler, field->data.var_decl.initializer);
+        emit_byte(compiler, OP_CLASS_FIELD, field->line);
+        emit_byte(compiler, (uint8_t)field->data.var_decl.slot, field->line);
+    }
+    
+    emit_define(compiler, node->data.class_decl.depth, node->data.class_decl.slot, node->line);
+}
+
+// Compile if statement
+static void compile_if(Compiler* compiler, ASTNode* node) {
+    compile_expression(compiler, node->data.if_stmt.condition);
+    int then_jump = emit_jump(compiler, OP_JUMP_IF_FALSE, node->line);
+    
+    compile_statement(compiler, node->data.if_stmt.then_branch);
+    
+    if (node->data.if_stmt.else_branch) {
+        int else_jump = emit_jump(compiler, OP_JUMP, node->line);
+        patch_jump(compiler, then_jump);
+        compile_statement(compiler, node->data.if_stmt.else_branch);
+        patch_jump(compiler, else_jump);
+    } else {
+        patch_jump(compiler, then_jump);
+    }
+}
+
+// Compile while loop
+static void compile_while(Compiler* compiler, ASTNode* node) {
+    int loop_start = compiler->chunk->count;
+    
+    compile_expression(compiler, node->data.while_loop.condition);
+    int exit_jump = emit_jump(compiler, OP_JUMP_IF_FALSE, node->line);
+    
+    compile_statement(compiler, node->data.while_loop.body);
+    emit_loop(compiler, loop_start, node->line);
+    
+    patch_jump(compiler, exit_jump);
+}
+
+// Compile for/foreach. The loop state sits on the stack under the body: a
+// Range(...) header becomes [counter, end, step] and a counted loop with no
+// range object; any other iterable becomes [iterable, cursor].
+static void compile_for(Compiler* compiler, ASTNode* node) {
+    ASTNode* iterable = node->data.for_loop.iterable;
+    OpCode next = OP_ITER_NEXT;
+    int state = 2;
+    
+    if (node->data.for_loop.counted) {
+        for (int i = 0; i < iterable->data.call.arg_count; i++) {
+            compile_expression(compiler, iterable->data.call.args[i]);
+        }
+        emit_byte(compiler, OP_RANGE_INIT, node->line);
+        emit_byte(compiler, (uint8_t)iterable->data.call.arg_count, node->line);
+        next = OP_RANGE_NEXT;
+        state = 3;
+    } else {
+        compile_expression(compiler, iterable);
+        emit_byte(compiler, OP_ITER_INIT, node->line);
+    }
+    
+    int loop_start = compiler->chunk->count;
+    int exit_jump = emit_jump(compiler, next, node->line);
+    emit_define(compiler, node->data.for_loop.depth, node->data.for_loop.slot, node->line);
+    
+    compile_statement(compiler, node->data.for_loop.body);
+    emit_loop(compiler, loop_start, node->line);
+    
+    patch_jump(compiler, exit_jump);
+    for (int i = 0; i < state; i++) {
+        emit_byte(compiler, OP_POP, node->line);
+    }
+}
+
+// Compile statement (leaves the stack balanced)
+static void compile_statement(Compiler* compiler, ASTNode* node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case NODE_PROGRAM:
+        case NODE_BLOCK:
+            for (int i = 0; i < node->data.block.statement_count; i++) {
+                compile_statement(compiler, node->data.block.statements[i]);
+            }
+            break;
+            
+        case NODE_VARDECL:
+            compile_expression(compiler, node->data.var_decl.initializer);
+            emit_define(compiler, node->data.var_decl.depth, node->data.var_decl.slot,
+                node->line);
+            break;
+            
+        case NODE_FUNCDECL: {
+            Obj* proto = compile_function(compiler, node, node->data.func_decl.body);
+            emit_op_short(compiler, OP_FUNCTION, add_constant(compiler, OBJ_VAL(proto)), node->line);
+            emit_define(compiler, node->data.func_decl.depth, node->data.func_decl.slot,
+                node->line);
+            break;
+        }
+        
+        case NODE_CLASSDECL:
+            compile_class(compiler, node);
+            break;
+            
+        case NODE_INCLUDING:
+            // Included by the resolver; the module runs when first used
+            break;
+            
+        case NODE_IF:
+            compile_if(compiler, node);
+            break;
+            
+        case NODE_WHILE:
+            compile_while(compiler, node);
+            break;
+            
+        case NODE_FOR:
+            compile_for(compiler, node);
+            break;
+            
+        case NODE_RETURN:
+            compile_expression(compiler, node->data.return_stmt.value);
+            emit_byte(compiler, OP_RETURN, node->line);
+            break;
+            
+        default:
+            compile_expression(compiler, node);
+            emit_byte(compiler, OP_POP, node->line);
+            break;
+    }
+}
+
+// ============================================================================
+// FUNCTIONS
+// ============================================================================
+
+// Register a new chunk with the interpreter that owns it
+Chunk* new_chunk(Interpreter* interp) {
+    if (interp->chunk_count >= interp->chunk_capacity) {
+        interp->chunk_capacity *= 2;
+        interp->chunks = (Chunk**)realloc(interp->chunks,
+            sizeof(Chunk*) * interp->chunk_capacity);
+    }
+    
+    Chunk* chunk = create_chunk();
+    interp->chunks[interp->chunk_count++] = chunk;
+    return chunk;
+}
+
+// Compile a function body into a prototype (node is NULL for the top-level
+// script). An error in it is also an error of the enclosing function.
+static Obj* compile_function(Compiler* enclosing, ASTNode* node, ASTNode* body) {
+    Interpreter* interp = enclosing->interp;
+    Compiler compiler;
+    compiler.interp = interp;
+    compiler.chunk = new_chunk(interp);
+    compiler.constant_index = NULL;
+    compiler.index_capacity = 0;
+    compiler.had_error = false;
+    
+    compile_statement(&compiler, body);
+    
+    // Implicit 'return null' at the end of every body
+    emit_byte(&compiler, OP_NULL, 0);
+    emit_byte(&compiler, OP_RETURN, 0);
+    free(compiler.constant_index);
+    if (compiler.had_error) enclosing->had_error = true;
+    
+    // Prototypes are only reachable through chunk constants, which are permanent
+    Obj* proto = allocate_permanent(interp, VALUE_FUNCTION);
+    proto->data.function.name = strdup(node ? node->data.func_decl.name : "<script>");
+    if (node) {
+        proto->data.function.params = node->data.func_decl.params;
+        proto->data.function.param_count = node->data.func_decl.param_count;
+        proto->data.function.local_count = node->data.func_decl.local_count;
+        proto->data.function.captures = node->data.func_decl.upvalues;
+        proto->data.function.upvalue_count = node->data.func_decl.upvalue_count;
+    }
+    proto->data.function.body = body;
+    proto->data.function.chunk = compiler.chunk;
+    return proto;
+}
+
+// Compile a whole program into the top-level script function, or return
+// NULL if any part of it could not be compiled (the errors are reported)
+Obj* compile_program(Interpreter* interp, ASTNode* program) {
+    Compiler program_compiler = { interp, NULL, NULL, 0, false };
+    Obj* script = compile_function(&program_compiler, NULL, program);
+    return program_compiler.had_error ? NULL : script;
+}
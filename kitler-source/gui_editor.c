@@ -2,7 +2,9 @@
  * Kitler IDE - Complete Modern Editor with Syntax Highlighting
  * Visual Studio 2026 Style with Build System Integration
  * 
- * Build: gcc kitler_ide.c lexer.c parser.c interpreter.c types.c -o kitler-ide `pkg-config --cflags --libs gtk+-3.0` -lm
+ * Build: ./Build.sh, which amounts to
+ *   gcc gui_editor.c memory.c lexer.c parser.c resolver.c interpreter.c compiler.c vm.c table.c shape.c iterator.c array.c vec.c cache.c module.c -o kitler-ide `pkg-config --cflags --libs gtk+-3.0` -lm -pthread
+ * (keep this list in step with the script)
  */
 
 #include <gtk/gtk.h>
@@ -15,8 +17,7 @@
 
 // External functions from your interpreter
 extern int run_source(const char* source);
-extern Token** lexer_tokenize(const char* source, int* token_count);
-extern void free_token(Token* token);
+extern Token* lexer_tokenize(const char* source, int* token_count);
 
 // Application state
 typedef struct {
@@ -195,47 +196,25 @@ void apply_syntax_highlighting() {
     
     // Tokenize for syntax highlighting
     int token_count = 0;
-    Token** tokens = lexer_tokenize(text, &token_count);
+    Token* tokens = lexer_tokenize(text, &token_count);
     
     for (int i = 0; i < token_count; i++) {
-        Token* token = tokens[i];
+        Token* token = &tokens[i];
         
         // Find the token position in buffer
         GtkTextIter token_start, token_end;
         gtk_text_buffer_get_iter_at_line(g_ide.buffer, &token_start, token->line - 1);
         gtk_text_iter_forward_chars(&token_start, token->column - 1);
         token_end = token_start;
-        gtk_text_iter_forward_chars(&token_end, strlen(token->lexeme));
+        gtk_text_iter_forward_chars(&token_end, token->length);
         
         GtkTextTag* tag = NULL;
         
         switch (token->type) {
-            case TOKEN_NEWVAR:
-            case TOKEN_NEWFUNC:
-            case TOKEN_NEWCLASS:
-            case TOKEN_NEWEVENT:
-            case TOKEN_NEWASYNC:
-            case TOKEN_IF:
-            case TOKEN_ELSE:
-            case TOKEN_WHILE:
-            case TOKEN_FOR:
-            case TOKEN_FOREACH:
-            case TOKEN_IN:
-            case TOKEN_SWITCH:
-            case TOKEN_CASE:
-            case TOKEN_DEFAULT:
-            case TOKEN_BREAK:
-            case TOKEN_RETURN:
-            case TOKEN_RUN:
-            case TOKEN_END:
-            case TOKEN_WHEN:
-            case TOKEN_THIS:
-            case TOKEN_NEW:
-            case TOKEN_AWAIT:
-            case TOKEN_INCLUDING:
-            case TOKEN_PROJECTSPACE:
-            case TOKEN_TRUE:
-            case TOKEN_FALSE:
+            // Every reserved word in the shared keyword table
+#define KEYWORD_CASE(token, spelling, first, last) case token:
+            KT_KEYWORDS(KEYWORD_CASE)
+#undef KEYWORD_CASE
                 tag = g_ide.tag_keyword;
                 break;
                 
@@ -244,6 +223,7 @@ void apply_syntax_highlighting() {
                 break;
                 
             case TOKEN_NUMBER:
+            case TOKEN_INTEGER:
                 tag = g_ide.tag_number;
                 break;
                 
@@ -263,8 +243,6 @@ void apply_syntax_highlighting() {
             case TOKEN_LESS_EQUAL:
             case TOKEN_GREATER:
             case TOKEN_GREATER_EQUAL:
-            case TOKEN_AND:
-            case TOKEN_OR:
             case TOKEN_NOT:
                 tag = g_ide.tag_operator;
                 break;
@@ -276,8 +254,6 @@ void apply_syntax_highlighting() {
         if (tag) {
             gtk_text_buffer_apply_tag(g_ide.buffer, tag, &token_start, &token_end);
         }
-        
-        free_token(token);
     }
     
     free(tokens);
@@ -366,18 +342,18 @@ void on_build_project(GtkWidget* widget, gpointer data) {
     char* source = gtk_text_buffer_get_text(g_ide.buffer, &start, &end, FALSE);
     
     int token_count = 0;
-    Token** tokens = lexer_tokenize(source, &token_count);
+    Token* tokens = lexer_tokenize(source, &token_count);
     
     bool has_errors = false;
     for (int i = 0; i < token_count; i++) {
-        if (tokens[i]->type == TOKEN_ERROR) {
+        if (tokens[i].type == TOKEN_ERROR) {
             char error_msg[256];
             snprintf(error_msg, sizeof(error_msg), 
-                "  ✗ Error at line %d: %s\n", tokens[i]->line, tokens[i]->lexeme);
+                "  ✗ Error at line %d: %s: %.*s\n", tokens[i].line, tokens[i].value.message,
+                tokens[i].length, source + tokens[i].start);
             append_output(error_msg, true);
             has_errors = true;
         }
-        free_token(tokens[i]);
     }
     free(tokens);
     g_free(source);
@@ -2,31 +2,27 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <inttypes.h>
 #include "types.h"
 // interpreter.c for Kitler
 
 // Forward declarations
-static Value* eval_node(Interpreter* interp, ASTNode* node);
-static Value* eval_expression(Interpreter* interp, ASTNode* node);
+static Value eval_node(Interpreter* interp, ASTNode* node);
+static Value eval_expression(Interpreter* interp, ASTNode* node);
 
 // ============================================================================
 // SCOPE HELPER FUNCTIONS
-// (create_scope is NOT here; it is in types.c)
+// (create_scope is NOT here; it is in memory.c)
+// Name-based lookup is only used for the global table (builtins, resolver);
+// resolved code indexes slots directly.
 // ============================================================================
 
-void scope_define(Scope* scope, const char* name, Value* value) {
-    // Check if already defined in current scope
-    for (int i = 0; i < scope->count; i++) {
-        if (strcmp(scope->names[i], name) == 0) {
-            scope->values[i] = value;
-            return;
-        }
-    }
-    
+// Add a new named slot to the end of a scope
+static void scope_append(Scope* scope, const char* name, Value value) {
     if (scope->count >= scope->capacity) {
         scope->capacity *= 2;
         scope->names = (char**)realloc(scope->names, sizeof(char*) * scope->capacity);
-        scope->values = (Value**)realloc(scope->values, sizeof(Value*) * scope->capacity);
+        scope->values = (Value*)realloc(scope->values, sizeof(Value) * scope->capacity);
     }
     
     scope->names[scope->count] = strdup(name);
@@ -34,9 +30,21 @@ void scope_define(Scope* scope, const char* name, Value* value) {
     scope->count++;
 }
 
-Value* scope_get(Scope* scope, const char* name) {
-    // Search current scope
+void scope_define(Scope* scope, const char* name, Value value) {
+    // Check if already defined in current scope
     for (int i = 0; i < scope->count; i++) {
+        if (strcmp(scope->names[i], name) == 0) {
+            scope->values[i] = value;
+            return;
+        }
+    }
+    
+    scope_append(scope, name, value);
+}
+
+Value scope_get(Scope* scope, const char* name) {
+    // Search current scope (function scopes are unnamed slot arrays)
+    for (int i = 0; scope->names && i < scope->count; i++) {
         if (strcmp(scope->names[i], name) == 0) {
             return scope->values[i];
         }
@@ -47,12 +55,12 @@ Value* scope_get(Scope* scope, const char* name) {
         return scope_get(scope->parent, name);
     }
     
-    return NULL;
+    return UNDEFINED_VAL;
 }
 
-void scope_set(Scope* scope, const char* name, Value* value) {
-    // Search current scope
-    for (int i = 0; i < scope->count; i++) {
+void scope_set(Scope* scope, const char* name, Value value) {
+    // Search current scope (function scopes are unnamed slot arrays)
+    for (int i = 0; scope->names && i < scope->count; i++) {
         if (strcmp(scope->names[i], name) == 0) {
             scope->values[i] = value;
             return;
@@ -65,6 +73,31 @@ void scope_set(Scope* scope, const char* name, Value* value) {
     }
 }
 
+// Fixed global table index for name, reserving an empty slot if undeclared
+int global_slot(Interpreter* interp, const char* name) {
+    Scope* globals = interp->global_scope;
+    Obj* key = constant_string(interp, name);
+    Value slot;
+    
+    if (map_get(interp->global_index, key, &slot)) {
+        return (int)AS_NUMBER(slot);
+    }
+    
+    scope_append(globals, name, UNDEFINED_VAL);
+    map_set(interp->global_index, key, NUMBER_VAL(globals->count - 1));
+    return globals->count - 1;
+}
+
+// Slot of a resolved variable: a global, a local of the running call, or one
+// of its upvalues (depth 1)
+static inline Value* resolved_slot(Interpreter* interp, int depth, int slot) {
+    if (depth < 0) return &interp->global_scope->values[slot];
+    if (depth == 0) return &interp->current_scope->values[slot];
+    
+    Obj* function = interp->frames[interp->frame_count - 1].function;
+    return function->data.function.upvalues[slot]->data.upvalue.location;
+}
+
 // ============================================================================
 // INTERPRETER CORE
 // ============================================================================
@@ -72,44 +105,303 @@ void scope_set(Scope* scope, const char* name, Value* value) {
 // Initialize interpreter
 Interpreter* interpreter_init() {
     Interpreter* interp = (Interpreter*)malloc(sizeof(Interpreter));
-    interp->global_scope = create_scope(NULL); // Calls function from types.c
+    interp->global_scope = create_scope(NULL); // Calls function from memory.c
     interp->current_scope = interp->global_scope;
     interp->gc_capacity = 256;
-    interp->gc_objects = (Value**)malloc(sizeof(Value*) * interp->gc_capacity);
+    interp->gc_objects = (Obj**)malloc(sizeof(Obj*) * interp->gc_capacity);
     interp->gc_count = 0;
     interp->should_exit = false;
-    interp->return_value = NULL;
+    interp->nursery = (Obj*)malloc(sizeof(Obj) * KT_NURSERY_OBJECTS);
+    interp->nursery_used = 0;
+    interp->remembered = NULL;
+    interp->remembered_count = 0;
+    interp->remembered_capacity = 0;
+    interp->open_upvalues = NULL;
+    interp->gc_next_major = KT_GC_MIN_MAJOR;
+    interp->gc_requested = false;
+    interp->gc_phase = GC_IDLE;
+    interp->gray_stack = NULL;
+    interp->gray_count = 0;
+    interp->gray_capacity = 0;
+    interp->revived = NULL;
+    interp->revived_count = 0;
+    interp->revived_capacity = 0;
+    interp->sweep_cursor = 0;
+    interp->sweep_alive = 0;
+    interp->gc_step_budget_ms = KT_GC_STEP_BUDGET_MS;
+    interp->gc_step_work = KT_GC_STEP_WORK;
+    interp->permanent = NULL;
+    interp->permanent_count = 0;
+    interp->permanent_capacity = 0;
+    interp->strings = NULL;
+    interp->string_count = 0;
+    interp->string_capacity = 0;
+    interp->global_index = create_object(VALUE_MAP);
+    interp->root_shape = shape_create_root();
+    interp->vtables = NULL;
+    interp->vector_class = NULL;
+    interp->returning = false;
+    interp->failed = false;
+    interp->return_value = NULL_VAL;
+    
+    interp->use_tree_walker = false;
+    interp->stack = (Value*)malloc(sizeof(Value) * KT_STACK_MAX);
+    interp->stack_top = interp->stack;
+    interp->locals = (Value*)malloc(sizeof(Value) * KT_STACK_MAX);
+    interp->locals_top = interp->locals;
+    interp->frames = (CallFrame*)malloc(sizeof(CallFrame) * KT_FRAMES_MAX);
+    interp->frame_count = 0;
+    interp->chunk_capacity = 8;
+    interp->chunks = (Chunk**)malloc(sizeof(Chunk*) * interp->chunk_capacity);
+    interp->chunk_count = 0;
+    interp->cache_map = NULL;
+    interp->cache_map_size = 0;
+    interp->modules = NULL;
+    interp->module_dir = NULL;
+    interp->native_callee = NULL;
+    interp->embedder = NULL;
     return interp;
 }
 
-// Register value for garbage collection
-void gc_register(Interpreter* interp, Value* value) {
-    if (interp->gc_count >= interp->gc_capacity) {
-        interp->gc_capacity *= 2;
-        interp->gc_objects = (Value**)realloc(
-            interp->gc_objects, sizeof(Value*) * interp->gc_capacity);
+// Intern a malloc'd C string (ownership moves to the GC)
+Value new_string(Interpreter* interp, char* owned_chars) {
+    Obj* string = intern_owned_string(interp, owned_chars, (int)strlen(owned_chars));
+    return OBJ_VAL(string);
+}
+
+// Truthiness used by conditions in both the tree walker and the VM
+bool value_is_truthy(Value value) {
+    switch (value.type) {
+        case VALUE_BOOL:
+            return value.data.boolean;
+        case VALUE_NUMBER:
+            return value.data.number != 0;
+        case VALUE_INT:
+            return value.data.integer != 0;
+        case VALUE_NULL:
+        case VALUE_UNDEFINED:
+            return false;
+        default:
+            return true;
+    }
+}
+
+// Equality for == and != (heap objects compare by identity; strings are
+// interned, so that is content equality once ropes are flattened). An
+// integer equals the double with the same value.
+bool values_equal(Interpreter* interp, Value a, Value b) {
+    if (IS_NUMBER(a) && IS_NUMBER(b)) return NUMBER_COMPARE(a, ==, b);
+    
+    if (IS_ROPE(a)) {
+        Obj* flat = string_flatten(interp, AS_OBJ(a));
+        a = OBJ_VAL(flat);
+    }
+    if (IS_ROPE(b)) {
+        Obj* flat = string_flatten(interp, AS_OBJ(b));
+        b = OBJ_VAL(flat);
+    }
+    
+    if (a.type != b.type) return false;
+    
+    switch (a.type) {
+        case VALUE_BOOL:
+            return a.data.boolean == b.data.boolean;
+        case VALUE_VEC2:
+        case VALUE_VEC3:
+        case VALUE_COLOR:
+            return vectors_equal(a, b);
+        case VALUE_NULL:
+        case VALUE_UNDEFINED:
+            return true;
+        default:
+            return a.data.obj == b.data.obj;
+    }
+}
+
+// ============================================================================
+// STRING CONCATENATION
+// '+' with a string operand builds a rope: an O(1) node that holds both
+// operands. Numbers, booleans and null stay in the rope as values and are
+// formatted straight into the buffer when it is flattened. Flattening happens
+// the first time a flat string is needed (printing, equality) and is cached.
+// ============================================================================
+
+#define KT_ROPE_MIN 32          // Shorter concatenations of flat strings are built flat
+#define KT_NUMBER_TEXT_MAX 32   // Longest "%g" output
+
+// Growable character buffer used while flattening
+typedef struct {
+    char* chars;
+    int length;
+    int capacity;
+} TextBuffer;
+
+static void buffer_append(TextBuffer* buffer, const char* chars, int count) {
+    if (buffer->length + count + 1 > buffer->capacity) {
+        while (buffer->length + count + 1 > buffer->capacity) buffer->capacity *= 2;
+        buffer->chars = (char*)realloc(buffer->chars, buffer->capacity);
+    }
+    
+    memcpy(buffer->chars + buffer->length, chars, count);
+    buffer->length += count;
+}
+
+// Append the text of a non-rope value, as Console.Write prints it
+static void buffer_append_value(TextBuffer* buffer, Value value) {
+    switch (value.type) {
+        case VALUE_STRING:
+            buffer_append(buffer, AS_STRING(value), AS_OBJ(value)->data.string.length);
+            break;
+        case VALUE_NUMBER: {
+            char number[KT_NUMBER_TEXT_MAX];
+            int count = snprintf(number, sizeof(number), "%g", AS_NUMBER(value));
+            buffer_append(buffer, number, count);
+            break;
+        }
+        case VALUE_INT: {
+            char number[KT_NUMBER_TEXT_MAX];
+            int count = snprintf(number, sizeof(number), "%" PRId64, AS_INT(value));
+            buffer_append(buffer, number, count);
+            break;
+        }
+        case VALUE_BOOL:
+            buffer_append(buffer, AS_BOOL(value) ? "true" : "false", AS_BOOL(value) ? 4 : 5);
+            break;
+        case VALUE_NULL:
+        case VALUE_UNDEFINED:
+            buffer_append(buffer, "null", 4);
+            break;
+        case VALUE_VEC2:
+        case VALUE_VEC3:
+        case VALUE_COLOR: {
+            char text[KT_VECTOR_TEXT_MAX];
+            int count = format_vector(value, text, sizeof(text));
+            buffer_append(buffer, text, count);
+            break;
+        }
+        default:
+            buffer_append(buffer, "<object>", 8);
+            break;
+    }
+}
+
+// Estimated characters a value adds to a rope
+static int text_length_hint(Value value) {
+    switch (value.type) {
+        case VALUE_STRING:
+            return AS_OBJ(value)->data.string.length;
+        case VALUE_ROPE:
+            return AS_OBJ(value)->data.rope.length_hint;
+        default:
+            return 8;
     }
-    interp->gc_objects[interp->gc_count++] = value;
+}
+
+// Flat interned string for a rope, built on first use without recursion
+Obj* string_flatten(Interpreter* interp, Obj* rope) {
+    if (rope->data.rope.flat) return rope->data.rope.flat;
+    
+    TextBuffer buffer;
+    buffer.capacity = rope->data.rope.length_hint + 1 > 16 ? rope->data.rope.length_hint + 1 : 16;
+    buffer.chars = (char*)malloc(buffer.capacity);
+    buffer.length = 0;
+    
+    // Depth-first, left to right; the pending stack only grows along the left spine
+    int pending_capacity = 64;
+    Value* pending = (Value*)malloc(sizeof(Value) * pending_capacity);
+    int pending_count = 0;
+    pending[pending_count++] = OBJ_VAL(rope);
+    
+    while (pending_count > 0) {
+        Value value = pending[--pending_count];
+        
+        if (!IS_ROPE(value)) {
+            buffer_append_value(&buffer, value);
+            continue;
+        }
+        
+        Obj* node = AS_OBJ(value);
+        if (node->data.rope.flat) {
+            buffer_append_value(&buffer, OBJ_VAL(node->data.rope.flat));
+            continue;
+        }
+        
+        if (pending_count + 2 > pending_capacity) {
+            pending_capacity *= 2;
+            pending = (Value*)realloc(pending, sizeof(Value) * pending_capacity);
+        }
+        pending[pending_count++] = node->data.rope.right;
+        pending[pending_count++] = node->data.rope.left;
+    }
+    free(pending);
+    
+    buffer.chars[buffer.length] = '\0';
+    Obj* flat = intern_owned_string(interp, buffer.chars, buffer.length);
+    
+    // Keep only the result; the pieces can now be collected
+    gc_write_barrier(interp, rope, OBJ_VAL(flat));
+    rope->data.rope.flat = flat;
+    rope->data.rope.left = NULL_VAL;
+    rope->data.rope.right = NULL_VAL;
+    return flat;
+}
+
+// String concatenation for TOKEN_PLUS (at least one side is a string or rope)
+Value value_concat(Interpreter* interp, Value left, Value right) {
+    int length = text_length_hint(left) + text_length_hint(right);
+    
+    // Small joins of flat strings are cheaper to build directly
+    if (IS_STRING(left) && IS_STRING(right) && length <= KT_ROPE_MIN) {
+        char* chars = (char*)malloc(length + 1);
+        memcpy(chars, AS_STRING(left), AS_OBJ(left)->data.string.length);
+        memcpy(chars + AS_OBJ(left)->data.string.length, AS_STRING(right),
+            AS_OBJ(right)->data.string.length);
+        chars[length] = '\0';
+        
+        Obj* string = intern_owned_string(interp, chars, length);
+        return OBJ_VAL(string);
+    }
+    
+    Obj* rope = allocate_object(interp, VALUE_ROPE);
+    rope->data.rope.left = left;
+    rope->data.rope.right = right;
+    rope->data.rope.length_hint = length;
+    rope->data.rope.flat = NULL;
+    return OBJ_VAL(rope);
 }
 
 // Built-in functions
-static Value* builtin_print(Value** args, int arg_count) {
+static Value builtin_print(Interpreter* interp, Value* args, int arg_count) {
     for (int i = 0; i < arg_count; i++) {
-        Value* arg = args[i];
+        Value arg = args[i];
         
-        switch (arg->type) {
+        switch (arg.type) {
             case VALUE_NUMBER:
-                printf("%g", arg->data.number);
+                printf("%g", AS_NUMBER(arg));
+                break;
+            case VALUE_INT:
+                printf("%" PRId64, AS_INT(arg));
                 break;
             case VALUE_STRING:
-                printf("%s", arg->data.string);
+                printf("%s", AS_STRING(arg));
+                break;
+            case VALUE_ROPE:
+                printf("%s", string_flatten(interp, AS_OBJ(arg))->data.string.chars);
                 break;
             case VALUE_BOOL:
-                printf("%s", arg->data.boolean ? "true" : "false");
+                printf("%s", AS_BOOL(arg) ? "true" : "false");
                 break;
             case VALUE_NULL:
                 printf("null");
                 break;
+            case VALUE_VEC2:
+            case VALUE_VEC3:
+            case VALUE_COLOR: {
+                char text[KT_VECTOR_TEXT_MAX];
+                format_vector(arg, text, sizeof(text));
+                printf("%s", text);
+                break;
+            }
             default:
                 printf("<object>");
                 break;
@@ -119,216 +411,273 @@ static Value* builtin_print(Value** args, int arg_count) {
     }
     printf("\n");
     
-    Value* result = create_value(VALUE_NULL);
-    return result;
+    return NULL_VAL;
 }
 
-static Value* builtin_max(Value** args, int arg_count) {
-    if (arg_count == 0) return create_value(VALUE_NULL);
+static Value builtin_max(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    if (arg_count == 0) return NULL_VAL;
     
-    double max_val = args[0]->data.number;
+    // The winning argument itself, so integers stay integers
+    Value max_val = args[0];
     for (int i = 1; i < arg_count; i++) {
-        if (args[i]->data.number > max_val) {
-            max_val = args[i]->data.number;
+        if (NUMBER_COMPARE(args[i], >, max_val)) {
+            max_val = args[i];
         }
     }
     
-    Value* result = create_value(VALUE_NUMBER);
-    result->data.number = max_val;
-    return result;
+    return max_val;
 }
 
-static Value* builtin_min(Value** args, int arg_count) {
-    if (arg_count == 0) return create_value(VALUE_NULL);
+static Value builtin_min(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    if (arg_count == 0) return NULL_VAL;
     
-    double min_val = args[0]->data.number;
+    Value min_val = args[0];
     for (int i = 1; i < arg_count; i++) {
-        if (args[i]->data.number < min_val) {
-            min_val = args[i]->data.number;
+        if (NUMBER_COMPARE(args[i], <, min_val)) {
+            min_val = args[i];
         }
     }
     
-    Value* result = create_value(VALUE_NUMBER);
-    result->data.number = min_val;
-    return result;
+    return min_val;
+}
+
+// Range(end), Range(start, end) or Range(start, end, step): a lazy counter
+static Value builtin_range(Interpreter* interp, Value* args, int arg_count) {
+    Value start, end, step;
+    if (!range_args(args, arg_count, &start, &end, &step)) return NULL_VAL;
+    
+    return new_range(interp, start, end, step);
+}
+
+// Bind a native function to a global name (dotted names like Console.Write included)
+void define_native(Interpreter* interp, const char* name, NativeFn function) {
+    Obj* native = allocate_object(interp, VALUE_NATIVE_FUNCTION);
+    native->data.native_function.name = strdup(name);
+    native->data.native_function.native_fn = function;
+    
+    // Look the slot up first: adding a global may move the value array
+    int slot = global_slot(interp, name);
+    interp->global_scope->values[slot] = OBJ_VAL(native);
 }
 
 // Register built-in functions
 void register_builtins(Interpreter* interp) {
-    // Console.Write
-    Value* print_fn = create_value(VALUE_NATIVE_FUNCTION);
-    print_fn->data.native_function.name = strdup("Console.Write");
-    print_fn->data.native_function.native_fn = builtin_print;
-    scope_define(interp->global_scope, "Console.Write", print_fn);
-    gc_register(interp, print_fn);
-    
-    // Max
-    Value* max_fn = create_value(VALUE_NATIVE_FUNCTION);
-    max_fn->data.native_function.name = strdup("Max");
-    max_fn->data.native_function.native_fn = builtin_max;
-    scope_define(interp->global_scope, "Max", max_fn);
-    gc_register(interp, max_fn);
-    
-    // Min
-    Value* min_fn = create_value(VALUE_NATIVE_FUNCTION);
-    min_fn->data.native_function.name = strdup("Min");
-    min_fn->data.native_function.native_fn = builtin_min;
-    scope_define(interp->global_scope, "Min", min_fn);
-    gc_register(interp, min_fn);
-}
-
-// Evaluate literal
-static Value* eval_literal(Interpreter* interp, ASTNode* node) {
-    Value* value = create_value(VALUE_NULL);
+    define_native(interp, "Console.Write", builtin_print);
+    define_native(interp, "Max", builtin_max);
+    define_native(interp, "Min", builtin_min);
+    define_native(interp, "Range", builtin_range);
+    register_array_builtins(interp);
+    register_vector_builtins(interp);
+}
+
+// Evaluate literal (only strings allocate)
+static Value eval_literal(Interpreter* interp, ASTNode* node) {
+    (void)interp;
     
     switch (node->data.literal.literal_type) {
         case LITERAL_NUMBER:
-            value->type = VALUE_NUMBER;
-            value->data.number = node->data.literal.literal_value.number;
-            break;
+            return NUMBER_VAL(node->data.literal.literal_value.number);
+        case LITERAL_INT:
+            return INT_VAL(node->data.literal.literal_value.integer);
         case LITERAL_STRING:
-            value->type = VALUE_STRING;
-            value->data.string = strdup(node->data.literal.literal_value.string);
-            break;
+            // Shared constant from the resolver: no allocation per evaluation
+            return OBJ_VAL(node->data.literal.constant);
         case LITERAL_BOOL:
-            value->type = VALUE_BOOL;
-            value->data.boolean = node->data.literal.literal_value.boolean;
-            break;
+            return BOOL_VAL(node->data.literal.literal_value.boolean);
         case LITERAL_NULL:
-            value->type = VALUE_NULL;
-            break;
+        default:
+            return NULL_VAL;
     }
-    
-    gc_register(interp, value);
-    return value;
 }
 
 // Evaluate identifier
-static Value* eval_identifier(Interpreter* interp, ASTNode* node) {
-    Value* value = scope_get(interp->current_scope, node->data.identifier.name);
+static Value eval_identifier(Interpreter* interp, ASTNode* node) {
+    int depth = node->data.identifier.depth;
+    Value value = *resolved_slot(interp, depth, node->data.identifier.slot);
+    
+    // The first use of an included module's global initialises the module
+    if (IS_UNDEFINED(value) && depth < 0 && module_touch(interp, node->data.identifier.slot)) {
+        value = *resolved_slot(interp, depth, node->data.identifier.slot);
+    }
     
-    if (!value) {
+    if (IS_UNDEFINED(value)) {
         fprintf(stderr, "Undefined variable: %s\n", node->data.identifier.name);
-        return create_value(VALUE_NULL);
+        return NULL_VAL;
     }
     
     return value;
 }
 
 // Evaluate binary operation
-static Value* eval_binary_op(Interpreter* interp, ASTNode* node) {
-    Value* left = eval_expression(interp, node->data.binary_op.left);
-    Value* right = eval_expression(interp, node->data.binary_op.right);
-    
-    Value* result = create_value(VALUE_NUMBER);
-    gc_register(interp, result);
+static Value eval_binary_op(Interpreter* interp, ASTNode* node) {
+    // Keep left on the stack so a collection inside right can see it
+    *interp->stack_top++ = eval_expression(interp, node->data.binary_op.left);
+    Value right = eval_expression(interp, node->data.binary_op.right);
+    Value left = *--interp->stack_top;
     
     switch (node->data.binary_op.operator) {
         case TOKEN_PLUS:
-            if (left->type == VALUE_STRING || right->type == VALUE_STRING) {
-                result->type = VALUE_STRING;
-                char buffer[1024];
-                snprintf(buffer, 1024, "%s%s", 
-                    left->type == VALUE_STRING ? left->data.string : "",
-                    right->type == VALUE_STRING ? right->data.string : "");
-                result->data.string = strdup(buffer);
-            } else {
-                result->data.number = left->data.number + right->data.number;
+            if (IS_TEXT(left) || IS_TEXT(right)) {
+                return value_concat(interp, left, right);
             }
-            break;
+            if (IS_INT(left) && IS_INT(right)) return int_add(AS_INT(left), AS_INT(right));
+            if (IS_VECTOR(left) || IS_VECTOR(right)) return vector_add(left, right);
+            return NUMBER_VAL(AS_NUMBER(left) + AS_NUMBER(right));
         case TOKEN_MINUS:
-            result->data.number = left->data.number - right->data.number;
-            break;
+            if (IS_INT(left) && IS_INT(right)) return int_subtract(AS_INT(left), AS_INT(right));
+            if (IS_VECTOR(left) || IS_VECTOR(right)) return vector_subtract(left, right);
+            return NUMBER_VAL(AS_NUMBER(left) - AS_NUMBER(right));
         case TOKEN_STAR:
-            result->data.number = left->data.number * right->data.number;
-            break;
+            if (IS_INT(left) && IS_INT(right)) return int_multiply(AS_INT(left), AS_INT(right));
+            if (IS_VECTOR(left) || IS_VECTOR(right)) return vector_multiply(left, right);
+            return NUMBER_VAL(AS_NUMBER(left) * AS_NUMBER(right));
         case TOKEN_SLASH:
-            result->data.number = left->data.number / right->data.number;
-            break;
+            if (IS_INT(left) && IS_INT(right)) return int_divide(AS_INT(left), AS_INT(right));
+            if (IS_VECTOR(left) || IS_VECTOR(right)) return vector_divide(left, right);
+            return NUMBER_VAL(AS_NUMBER(left) / AS_NUMBER(right));
         case TOKEN_PERCENT:
-            result->data.number = fmod(left->data.number, right->data.number);
-            break;
+            if (IS_INT(left) && IS_INT(right)) return int_modulo(AS_INT(left), AS_INT(right));
+            return NUMBER_VAL(fmod(AS_NUMBER(left), AS_NUMBER(right)));
         case TOKEN_EQUAL:
-            result->type = VALUE_BOOL;
-            result->data.boolean = (left->data.number == right->data.number);
-            break;
+            return BOOL_VAL(values_equal(interp, left, right));
         case TOKEN_NOT_EQUAL:
-            result->type = VALUE_BOOL;
-            result->data.boolean = (left->data.number != right->data.number);
-            break;
+            return BOOL_VAL(!values_equal(interp, left, right));
         case TOKEN_LESS:
-            result->type = VALUE_BOOL;
-            result->data.boolean = (left->data.number < right->data.number);
-            break;
+            return BOOL_VAL(NUMBER_COMPARE(left, <, right));
         case TOKEN_LESS_EQUAL:
-            result->type = VALUE_BOOL;
-            result->data.boolean = (left->data.number <= right->data.number);
-            break;
+            return BOOL_VAL(NUMBER_COMPARE(left, <=, right));
         case TOKEN_GREATER:
-            result->type = VALUE_BOOL;
-            result->data.boolean = (left->data.number > right->data.number);
-            break;
+            return BOOL_VAL(NUMBER_COMPARE(left, >, right));
         case TOKEN_GREATER_EQUAL:
-            result->type = VALUE_BOOL;
-            result->data.boolean = (left->data.number >= right->data.number);
-            break;
+            return BOOL_VAL(NUMBER_COMPARE(left, >=, right));
         case TOKEN_AND:
-            result->type = VALUE_BOOL;
-            result->data.boolean = left->data.boolean && right->data.boolean;
-            break;
+            return BOOL_VAL(value_is_truthy(left) && value_is_truthy(right));
         case TOKEN_OR:
-            result->type = VALUE_BOOL;
-            result->data.boolean = left->data.boolean || right->data.boolean;
-            break;
+            return BOOL_VAL(value_is_truthy(left) || value_is_truthy(right));
         default:
-            break;
+            return NULL_VAL;
     }
-    
-    return result;
 }
 
 // Evaluate function call
-static Value* eval_call(Interpreter* interp, ASTNode* node) {
-    Value* callee = eval_expression(interp, node->data.call.callee);
+static Value eval_call(Interpreter* interp, ASTNode* node) {
+    // Callee and arguments live on the stack, where the GC sees them
+    Value* callee = interp->stack_top;
+    ASTNode* target = node->data.call.callee;
+    int arg_count = node->data.call.arg_count;
+    
+    if (target->type == NODE_MEMBER_ACCESS) {
+        // Method call: the receiver is passed as the first argument, bound to 'this'
+        *interp->stack_top++ = NULL_VAL;
+        *interp->stack_top++ = eval_expression(interp, target->data.member_access.object);
+        *callee = find_method(interp, callee[1], target->data.member_access.key,
+            target->data.member_access.cache);
+        
+        if (IS_UNDEFINED(*callee)) {
+            // Not a method: call the field's value, without a receiver
+            *callee = get_field(interp, callee[1], target->data.member_access.key, NULL);
+            interp->stack_top--;
+        } else {
+            arg_count++;
+        }
+    } else {
+        *interp->stack_top++ = eval_expression(interp, target);
+    }
     
     // Evaluate arguments
-    Value** args = (Value**)malloc(sizeof(Value*) * node->data.call.arg_count);
     for (int i = 0; i < node->data.call.arg_count; i++) {
-        args[i] = eval_expression(interp, node->data.call.args[i]);
+        *interp->stack_top++ = eval_expression(interp, node->data.call.args[i]);
     }
     
-    Value* result = NULL;
+    Value* args = callee + 1;
+    Value result = NULL_VAL;
+    
+    // Nothing more is called while a runtime error unwinds
+    if (interp->failed) {
+        interp->stack_top = callee;
+        return NULL_VAL;
+    }
     
     if (callee->type == VALUE_NATIVE_FUNCTION) {
-        result = callee->data.native_function.native_fn(args, node->data.call.arg_count);
+        interp->native_callee = AS_OBJ(*callee);
+        result = AS_OBJ(*callee)->data.native_function.native_fn(interp, args, arg_count);
     } else if (callee->type == VALUE_FUNCTION) {
-        // Create new scope for function
-        Scope* func_scope = create_scope(callee->data.function.closure);
+        Obj* function = AS_OBJ(*callee);
+        
+        // The frame keeps the function and its scope rooted during the body
+        CallFrame* frame = &interp->frames[interp->frame_count];
+        Scope* func_scope = interp->frame_count < KT_WALKER_FRAMES_MAX
+            ? enter_frame_scope(interp, frame, function->data.function.local_count)
+            : NULL;
+        
+        if (!func_scope) {
+            fprintf(stderr, "Stack overflow in %s\n", function->data.function.name);
+            interp->failed = true;
+            interp->returning = true;
+            interp->stack_top = callee;
+            return NULL_VAL;
+        }
         
-        // Bind parameters
-        for (int i = 0; i < callee->data.function.param_count && i < node->data.call.arg_count; i++) {
-            scope_define(func_scope, callee->data.function.params[i], args[i]);
+        // Bind parameters to the first slots
+        for (int i = 0; i < function->data.function.param_count && i < arg_count; i++) {
+            func_scope->values[i] = args[i];
         }
         
+        frame->function = function;
+        frame->ip = NULL;
+        frame->slots = callee;
+        interp->frame_count++;
+        
         // Execute function body
         Scope* prev_scope = interp->current_scope;
         interp->current_scope = func_scope;
         
-        eval_node(interp, callee->data.function.body);
+        eval_node(interp, function->data.function.body);
         
-        result = interp->return_value ? interp->return_value : create_value(VALUE_NULL);
-        interp->return_value = NULL;
+        if (interp->returning) result = interp->return_value;
+        interp->returning = interp->failed;
+        interp->return_value = NULL_VAL;
         
         interp->current_scope = prev_scope;
-        free_scope(func_scope);
+        interp->frame_count--;
+        leave_frame_scope(interp, frame);
     }
     
-    free(args);
-    return result ? result : create_value(VALUE_NULL);
+    interp->stack_top = callee;
+    return result;
+}
+
+// Evaluate instantiation: New ClassName(args)
+static Value eval_new_instance(Interpreter* interp, ASTNode* node) {
+    Value* klass = interp->stack_top;
+    *interp->stack_top++ = eval_expression(interp, node->data.new_instance.class_ref);
+    
+    // Classes have no constructors yet: arguments are evaluated for their effects only
+    for (int i = 0; i < node->data.new_instance.arg_count; i++) {
+        eval_expression(interp, node->data.new_instance.args[i]);
+    }
+    
+    Value instance = new_instance(interp, *klass);
+    interp->stack_top = klass;
+    return instance;
+}
+
+// Evaluate field read: a monomorphic cache hit is one compare and one load
+static Value eval_member_access(Interpreter* interp, ASTNode* node) {
+    Value object = eval_expression(interp, node->data.member_access.object);
+    InlineCache* cache = node->data.member_access.cache;
+    
+    if (object.type == VALUE_INSTANCE && AS_OBJ(object)->data.instance.shape == cache->keys[0]) {
+        return AS_OBJ(object)->data.instance.slots[cache->slots[0]];
+    }
+    
+    return get_field(interp, object, node->data.member_access.key, cache);
 }
 
 // Evaluate expression
-static Value* eval_expression(Interpreter* interp, ASTNode* node) {
+static Value eval_expression(Interpreter* interp, ASTNode* node) {
     switch (node->type) {
         case NODE_LITERAL:
             return eval_literal(interp, node);
@@ -338,89 +687,219 @@ static Value* eval_expression(Interpreter* interp, ASTNode* node) {
             return eval_binary_op(interp, node);
         case NODE_CALL:
             return eval_call(interp, node);
+        case NODE_MEMBER_ACCESS:
+            return eval_member_access(interp, node);
+        case NODE_NEW_INSTANCE:
+            return eval_new_instance(interp, node);
         default:
-            return create_value(VALUE_NULL);
+            return NULL_VAL;
     }
 }
 
 // Evaluate variable declaration
-static Value* eval_var_decl(Interpreter* interp, ASTNode* node) {
-    Value* value = node->data.var_decl.initializer 
+static Value eval_var_decl(Interpreter* interp, ASTNode* node) {
+    Value value = node->data.var_decl.initializer
         ? eval_expression(interp, node->data.var_decl.initializer)
-        : create_value(VALUE_NULL);
+        : NULL_VAL;
     
-    scope_define(interp->current_scope, node->data.var_decl.name, value);
+    *resolved_slot(interp, node->data.var_decl.depth, node->data.var_decl.slot) = value;
     return value;
 }
 
-// Evaluate function declaration
-static Value* eval_func_decl(Interpreter* interp, ASTNode* node) {
-    Value* func = create_value(VALUE_FUNCTION);
-    func->data.function.name = strdup(node->data.func_decl.name);
+// Create a function object for a declaration, capturing the variables it uses
+// from the running call (its locals, or upvalues the call itself captured)
+static Obj* make_function(Interpreter* interp, ASTNode* node) {
+    Obj* func = allocate_object(interp, VALUE_FUNCTION);
+    func->data.function.name = node->data.func_decl.name;
     func->data.function.params = node->data.func_decl.params;
     func->data.function.param_count = node->data.func_decl.param_count;
+    func->data.function.local_count = node->data.func_decl.local_count;
     func->data.function.body = node->data.func_decl.body;
-    func->data.function.closure = interp->current_scope;
-    
-    scope_define(interp->current_scope, node->data.func_decl.name, func);
-    gc_register(interp, func);
+    func->data.function.captures = node->data.func_decl.upvalues;
+    func->data.function.upvalue_count = node->data.func_decl.upvalue_count;
     
+    int count = node->data.func_decl.upvalue_count;
+    if (count > 0) {
+        Obj* enclosing = interp->frames[interp->frame_count - 1].function;
+        func->data.function.upvalues = (Obj**)malloc(sizeof(Obj*) * count);
+        
+        for (int i = 0; i < count; i++) {
+            UpvalueRef* ref = &node->data.func_decl.upvalues[i];
+            func->data.function.upvalues[i] = ref->is_local
+                ? capture_upvalue(interp, &interp->current_scope->values[ref->index])
+                : enclosing->data.function.upvalues[ref->index];
+        }
+    }
     return func;
 }
 
+// Evaluate function declaration
+static Value eval_func_decl(Interpreter* interp, ASTNode* node) {
+    Obj* func = make_function(interp, node);
+    
+    *resolved_slot(interp, node->data.func_decl.depth, node->data.func_decl.slot) = OBJ_VAL(func);
+    
+    return OBJ_VAL(func);
+}
+
+// Evaluate class declaration: field defaults are evaluated once, here, and
+// each method is stored in its vtable slot
+static Value eval_class_decl(Interpreter* interp, ASTNode* node) {
+    Obj* klass = new_class(interp, node->data.class_decl.name, node->data.class_decl.shape,
+        node->data.class_decl.vtable);
+    Value* rooted = interp->stack_top;
+    *interp->stack_top++ = OBJ_VAL(klass);
+    
+    for (int i = 0; i < node->data.class_decl.member_count; i++) {
+        ASTNode* member = node->data.class_decl.members[i];
+        
+        if (member->type == NODE_FUNCDECL) {
+            Obj* method = make_function(interp, member);
+            klass = AS_OBJ(*rooted);
+            gc_write_barrier(interp, klass, OBJ_VAL(method));
+            klass->data.class_obj.methods[member->data.func_decl.slot] = OBJ_VAL(method);
+            continue;
+        }
+        
+        Value value = member->data.var_decl.initializer
+            ? eval_expression(interp, member->data.var_decl.initializer)
+            : NULL_VAL;
+        
+        // The class may have been promoted while the initializer ran
+        klass = AS_OBJ(*rooted);
+        gc_write_barrier(interp, klass, value);
+        klass->data.class_obj.defaults[member->data.var_decl.slot] = value;
+    }
+    
+    Value result = *rooted;
+    interp->stack_top = rooted;
+    
+    *resolved_slot(interp, node->data.class_decl.depth, node->data.class_decl.slot) = result;
+    return result;
+}
+
 // Evaluate if statement
-static Value* eval_if(Interpreter* interp, ASTNode* node) {
-    Value* condition = eval_expression(interp, node->data.if_stmt.condition);
+static Value eval_if(Interpreter* interp, ASTNode* node) {
+    Value condition = eval_expression(interp, node->data.if_stmt.condition);
     
-    if (condition->data.boolean) {
+    if (value_is_truthy(condition)) {
         return eval_node(interp, node->data.if_stmt.then_branch);
     } else if (node->data.if_stmt.else_branch) {
         return eval_node(interp, node->data.if_stmt.else_branch);
     }
     
-    return create_value(VALUE_NULL);
+    return NULL_VAL;
 }
 
 // Evaluate while loop
-static Value* eval_while(Interpreter* interp, ASTNode* node) {
+static Value eval_while(Interpreter* interp, ASTNode* node) {
     while (true) {
-        Value* condition = eval_expression(interp, node->data.while_loop.condition);
-        if (!condition->data.boolean) break;
+        Value condition = eval_expression(interp, node->data.while_loop.condition);
+        if (!value_is_truthy(condition)) break;
         
         eval_node(interp, node->data.while_loop.body);
+        if (interp->returning) break;
     }
     
-    return create_value(VALUE_NULL);
+    return NULL_VAL;
+}
+
+// Evaluate for/foreach loop. A Range(...) header counts in a C local; any
+// other iterable stays rooted on the stack next to a cursor, so no iteration allocates.
+static Value eval_for(Interpreter* interp, ASTNode* node) {
+    int depth = node->data.for_loop.depth;
+    int slot = node->data.for_loop.slot;
+    
+    if (node->data.for_loop.counted) {
+        ASTNode* range = node->data.for_loop.iterable;
+        Value* args = interp->stack_top;
+        for (int i = 0; i < range->data.call.arg_count; i++) {
+            *interp->stack_top++ = eval_expression(interp, range->data.call.args[i]);
+        }
+        
+        Value counter, end, step, item;
+        bool valid = range_args(args, range->data.call.arg_count, &counter, &end, &step);
+        interp->stack_top = args;
+        if (!valid) return NULL_VAL;
+        
+        while (range_next(&counter, end, step, &item)) {
+            *resolved_slot(interp, depth, slot) = item;
+            eval_node(interp, node->data.for_loop.body);
+            if (interp->returning) break;
+        }
+        return NULL_VAL;
+    }
+    
+    Value* iterable = interp->stack_top;
+    *interp->stack_top++ = eval_expression(interp, node->data.for_loop.iterable);
+    Value cursor = iterator_start(interp, *iterable);
+    Value item;
+    
+    while (iterator_next(interp, *iterable, &cursor, &item)) {
+        *resolved_slot(interp, depth, slot) = item;
+        eval_node(interp, node->data.for_loop.body);
+        if (interp->returning) break;
+    }
+    
+    interp->stack_top = iterable;
+    return NULL_VAL;
 }
 
 // Evaluate assignment
-static Value* eval_assignment(Interpreter* interp, ASTNode* node) {
-    Value* value = eval_expression(interp, node->data.assignment.value);
+static Value eval_assignment(Interpreter* interp, ASTNode* node) {
+    ASTNode* target = node->data.assignment.target;
+    
+    if (target->type == NODE_MEMBER_ACCESS) {
+        // Object first (as in the VM), kept rooted while the value runs
+        *interp->stack_top++ = eval_expression(interp, target->data.member_access.object);
+        Value value = eval_expression(interp, node->data.assignment.value);
+        Value object = *--interp->stack_top;
+        
+        return set_field(interp, object, target->data.member_access.key, value,
+            target->data.member_access.cache);
+    }
+    
+    Value value = eval_expression(interp, node->data.assignment.value);
     
-    if (node->data.assignment.target->type == NODE_IDENTIFIER) {
-        scope_set(interp->current_scope, 
-            node->data.assignment.target->data.identifier.name, value);
+    if (target->type == NODE_IDENTIFIER) {
+        int depth = target->data.identifier.depth;
+        Value* slot = resolved_slot(interp, depth, target->data.identifier.slot);
+        if (depth < 0 && IS_UNDEFINED(*slot) && module_touch(interp, target->data.identifier.slot)) {
+            slot = resolved_slot(interp, depth, target->data.identifier.slot);
+        }
+        
+        // Assigning an undeclared global is a no-op, as with scope_set
+        if (depth < 0 && IS_UNDEFINED(*slot)) return value;
+        
+        if (depth > 0) {
+            // A closed upvalue is a heap object that may already be marked
+            Obj* function = interp->frames[interp->frame_count - 1].function;
+            gc_write_barrier(interp, function->data.function.upvalues[target->data.identifier.slot], value);
+        }
+        *slot = value;
     }
     
     return value;
 }
 
 // Evaluate block
-static Value* eval_block(Interpreter* interp, ASTNode* node) {
-    Value* result = create_value(VALUE_NULL);
+static Value eval_block(Interpreter* interp, ASTNode* node) {
+    Value result = NULL_VAL;
     
     for (int i = 0; i < node->data.block.statement_count; i++) {
+        // Statement boundaries are the walker's GC safepoints
+        gc_safepoint(interp);
         result = eval_node(interp, node->data.block.statements[i]);
         
-        if (interp->return_value) break;
+        if (interp->returning) break;
     }
     
     return result;
 }
 
 // Evaluate AST node
-static Value* eval_node(Interpreter* interp, ASTNode* node) {
-    if (!node) return create_value(VALUE_NULL);
+static Value eval_node(Interpreter* interp, ASTNode* node) {
+    if (!node) return NULL_VAL;
     
     switch (node->type) {
         case NODE_PROGRAM:
@@ -430,25 +909,75 @@ static Value* eval_node(Interpreter* interp, ASTNode* node) {
             return eval_var_decl(interp, node);
         case NODE_FUNCDECL:
             return eval_func_decl(interp, node);
+        case NODE_CLASSDECL:
+            return eval_class_decl(interp, node);
         case NODE_IF:
             return eval_if(interp, node);
         case NODE_WHILE:
             return eval_while(interp, node);
+        case NODE_FOR:
+            return eval_for(interp, node);
         case NODE_ASSIGN:
             return eval_assignment(interp, node);
         case NODE_RETURN:
-            interp->return_value = node->data.return_stmt.value 
+            interp->return_value = node->data.return_stmt.value
                 ? eval_expression(interp, node->data.return_stmt.value)
-                : create_value(VALUE_NULL);
+                : NULL_VAL;
+            interp->returning = true;
             return interp->return_value;
         default:
             return eval_expression(interp, node);
     }
 }
 
-// Run interpreter
-void interpreter_run(Interpreter* interp, ASTNode* ast) {
+// Run an included script module's top level with the tree walker
+void interpreter_eval_module(Interpreter* interp, ASTNode* program) {
+    eval_node(interp, program);
+    interp->returning = interp->failed;
+}
+
+// Register the builtins and resolve a program, then compile it into the
+// top-level script function (NULL when the tree walker will run it, or when
+// the program could not be compiled)
+Obj* interpreter_compile(Interpreter* interp, ASTNode* ast) {
     interp->ast = ast;
     register_builtins(interp);
-    eval_node(interp, ast);
-}
\ No newline at end of file
+    resolve_program(interp, ast);
+    
+    if (interp->use_tree_walker) return NULL;
+    return compile_program(interp, ast);
+}
+
+// Run one more program in an interpreter that keeps its state between
+// programs (REPL input). The builtins, globals and modules of earlier runs
+// stay as they are; only the new program is resolved and compiled.
+void interpreter_run_input(Interpreter* interp, ASTNode* ast) {
+    interp->ast = ast;
+    resolve_program(interp, ast);
+    
+    if (interp->use_tree_walker) {
+        eval_node(interp, ast);
+        interp->returning = false;
+        interp->failed = false;
+        return;
+    }
+    
+    Obj* script = compile_program(interp, ast);
+    if (script) vm_run(interp, script);
+}
+
+// Run interpreter (bytecode VM by default, tree walker when requested);
+// false if the program could not be compiled, in which case nothing ran, or
+// if a runtime error stopped it
+bool interpreter_run(Interpreter* interp, ASTNode* ast) {
+    Obj* script = interpreter_compile(interp, ast);
+    
+    if (interp->use_tree_walker) {
+        eval_node(interp, ast);
+        interp->returning = false;
+        return !interp->failed;
+    }
+    
+    if (!script) return false;
+    return vm_run(interp, script);
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+// Iteration protocol for Kitler for/foreach loops
+// A loop keeps its iterable and a cursor next to each other (on the operand
+// stack, or in C locals in the tree walker), so stepping through a range,
+// list, array or map allocates nothing. The cursor is a number: the next
+// value of a range, or the next element or entry index of anything else. A
+// range itself is a lazy counter of three numbers, however many values it
+// yields; when they are all integers, so are the values.
+
+// ============================================================================
+// RANGES
+// ============================================================================
+
+// Read Range(end), Range(start, end) or Range(start, end, step) arguments:
+// integers if every argument is one, doubles otherwise. On bad arguments
+// this reports the error, leaves an empty range and returns false.
+bool range_args(Value* args, int arg_count, Value* start, Value* end, Value* step) {
+    *start = INT_VAL(0);
+    *end = INT_VAL(0);
+    *step = INT_VAL(1);
+    
+    if (arg_count < 1 || arg_count > 3) {
+        fprintf(stderr, "Range expects 1 to 3 arguments, got %d\n", arg_count);
+        return false;
+    }
+    
+    bool integer = true;
+    for (int i = 0; i < arg_count; i++) {
+        if (!IS_NUMBER(args[i])) {
+            fprintf(stderr, "Range expects numbers\n");
+            return false;
+        }
+        integer = integer && IS_INT(args[i]);
+    }
+    
+    if (arg_count == 1) {
+        *end = args[0];
+    } else {
+        *start = args[0];
+        *end = args[1];
+        if (arg_count == 3) *step = args[2];
+    }
+    
+    if (!integer) {
+        *start = NUMBER_VAL(AS_NUMBER(*start));
+        *end = NUMBER_VAL(AS_NUMBER(*end));
+        *step = NUMBER_VAL(AS_NUMBER(*step));
+    }
+    
+    if (AS_NUMBER(*step) == 0) {
+        fprintf(stderr, "Range step cannot be 0\n");
+        *end = *start;
+        *step = integer ? INT_VAL(1) : NUMBER_VAL(1);
+        return false;
+    }
+    
+    return true;
+}
+
+// Allocate a range object (end is exclusive)
+Value new_range(Interpreter* interp, Value start, Value end, Value step) {
+    Obj* range = allocate_object(interp, VALUE_RANGE);
+    range->data.range.start = start;
+    range->data.range.end = end;
+    range->data.range.step = step;
+    return OBJ_VAL(range);
+}
+
+// ============================================================================
+// ITERATION
+// ============================================================================
+
+// First cursor for iterable; anything that cannot be iterated is reported
+// here and then yields nothing
+Value iterator_start(Interpreter* interp, Value iterable) {
+    (void)interp;
+    
+    switch (iterable.type) {
+        case VALUE_RANGE:
+            return AS_OBJ(iterable)->data.range.start;
+        case VALUE_LIST:
+        case VALUE_MAP:
+        case VALUE_ARRAY:
+            return INT_VAL(0);
+        case VALUE_NULL:
+        case VALUE_UNDEFINED:
+            fprintf(stderr, "Cannot iterate over null\n");
+            return INT_VAL(0);
+        default:
+            fprintf(stderr, "Cannot iterate over this value\n");
+            return INT_VAL(0);
+    }
+}
+
+// Store the next item in *item and advance *cursor, or return false at the
+// end. Lists are read at the cursor each time, so elements added during the
+// loop are visited; map entries deleted during the loop are skipped.
+bool iterator_next(Interpreter* interp, Value iterable, Value* cursor, Value* item) {
+    (void)interp;
+    
+    switch (iterable.type) {
+        case VALUE_RANGE: {
+            Obj* range = AS_OBJ(iterable);
+            return range_next(cursor, range->data.range.end, range->data.range.step, item);
+        }
+        
+        case VALUE_LIST: {
+            Obj* list = AS_OBJ(iterable);
+            int index = (int)AS_INT(*cursor);
+            if (index >= list->data.list.count) return false;
+            
+            *item = list->data.list.elements[index];
+            cursor->data.integer = index + 1;
+            return true;
+        }
+        
+        case VALUE_ARRAY: {
+            Obj* array = AS_OBJ(iterable);
+            int index = (int)AS_INT(*cursor);
+            if (index >= array->data.array.count) return false;
+            
+            *item = array_get(array, index);
+            cursor->data.integer = index + 1;
+            return true;
+        }
+        
+        case VALUE_MAP: {
+            // Maps yield their keys in insertion order
+            Obj* map = AS_OBJ(iterable);
+            int index = (int)AS_INT(*cursor);
+            
+            while (index < map->data.map.count && !map->data.map.entries[index].key) {
+                index++;
+            }
+            if (index >= map->data.map.count) return false;
+            
+            Obj* key = map->data.map.entries[index].key;
+            *item = OBJ_VAL(key);
+            cursor->data.integer = index + 1;
+            return true;
+        }
+        
+        default:
+            return false;
+    }
+}
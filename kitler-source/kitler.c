@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "kitler.h"
+// libkitler: embedding Kitler in a host program (API in kitler.h)
+// kt_program_compile runs the normal pipeline once, from lexing to
+// compile_program, and keeps only the in-memory image of the result (see
+// program_image in cache.c) and the names of its global slots. The host's
+// natives are defined first, right after the builtins, so that the resolver
+// sees dotted names such as Host.Log as globals, and they take the same
+// slots in every isolate. Every isolate is a fresh Interpreter that loads
+// that image the way run_file loads a .ktc cache, so creating one costs no
+// parsing or compiling, and its chunks point into the program's one copy of
+// the bytecode. The interpreter keeps no global state, which is what lets
+// isolates run on different threads.
+//
+// Natives the host defines are ordinary native functions that share one
+// NativeFn, call_native; the native_function's data points at the host's
+// definition, which call_native finds through interp->native_callee.
+
+// Arguments a call converts without allocating; more go on the heap
+#define KT_LOCAL_ARGS 8
+
+// External function declarations
+extern Token* lexer_tokenize(const char* source, int* token_count);
+extern Parser* parser_init(const char* source, Token* tokens, int token_count);
+extern ASTNode* parser_parse(Parser* parser);
+
+extern Interpreter* interpreter_init();
+extern void register_builtins(Interpreter* interp);
+extern void interpreter_free(Interpreter* interp);
+
+// A host native: its signature split into the result type and parameter types
+typedef struct {
+    char* name;
+    char result;            // One of "vbinsa"
+    char* params;           // One of "binsa" per parameter
+    int arity;
+    KtNativeFn function;
+    void* user_data;
+} KtNative;
+
+struct KtProgram {
+    uint8_t* image;         // Program image that every isolate's chunks point into (NULL until compiled)
+    size_t image_size;
+    char** globals;         // Global names in slot order, for kt_program_find
+    int global_count;
+    KtNative** natives;     // Separately allocated, since isolates point at them
+    int native_count;
+    int native_capacity;
+};
+
+struct KtIsolate {
+    KtProgram* program;
+    Interpreter* interp;
+    Obj* script;            // Top-level script of the program
+    void* user_data;
+    char* text;             // Copy of the last string handed to the host
+    size_t text_capacity;
+};
+
+// ============================================================================
+// VALUES
+// ============================================================================
+
+static const char* type_letter_name(char letter) {
+    switch (letter) {
+        case 'b': return "a bool";
+        case 'i': return "an int";
+        case 'n': return "a number";
+        case 's': return "a string";
+        default: return "a value";
+    }
+}
+
+// Host view of a script value. A string points into the string object
+// itself unless isolate is given, in which case it is copied to the
+// isolate's text buffer so the object may be collected.
+static KtValue to_host(Interpreter* interp, Value* value, KtIsolate* isolate) {
+    switch (value->type) {
+        case VALUE_UNDEFINED:
+        case VALUE_NULL:
+            return kt_null();
+        case VALUE_BOOL:
+            return kt_bool(AS_BOOL(*value));
+        case VALUE_INT:
+            return kt_int(AS_INT(*value));
+        case VALUE_NUMBER:
+            return kt_number(AS_NUMBER(*value));
+        case VALUE_ROPE:
+            // Flattened in place, so the flat string stays as reachable as the rope was
+            *value = OBJ_VAL(string_flatten(interp, AS_OBJ(*value)));
+            // fall through
+        case VALUE_STRING: {
+            Obj* string = AS_OBJ(*value);
+            size_t length = (size_t)string->data.string.length;
+            if (!isolate) return kt_string_n(string->data.string.chars, length);
+            
+            if (length + 1 > isolate->text_capacity) {
+                isolate->text_capacity = length + 1;
+                isolate->text = (char*)realloc(isolate->text, isolate->text_capacity);
+            }
+            memcpy(isolate->text, string->data.string.chars, length + 1);
+            return kt_string_n(isolate->text, length);
+        }
+        default: {
+            KtValue other = kt_null();
+            other.type = KT_OTHER;
+            return other;
+        }
+    }
+}
+
+// Script value for a host value; false for KT_OTHER or a bad type tag
+static bool from_host(Interpreter* interp, const KtValue* value, Value* out) {
+    switch (value->type) {
+        case KT_NULL:
+            *out = NULL_VAL;
+            return true;
+        case KT_BOOL:
+            *out = BOOL_VAL(value->as.boolean);
+            return true;
+        case KT_INT:
+            *out = INT_VAL(value->as.integer);
+            return true;
+        case KT_NUMBER:
+            *out = NUMBER_VAL(value->as.number);
+            return true;
+        case KT_STRING:
+            if (!value->as.string.chars && value->as.string.length > 0) return false;
+            if (value->as.string.length > (size_t)INT32_MAX) return false;
+            *out = OBJ_VAL(intern_string(interp, value->as.string.chars ? value->as.string.chars : "",
+                                         (int)value->as.string.length));
+            return true;
+        default:
+            *out = NULL_VAL;
+            return false;
+    }
+}
+
+// Whether a host value has the type a signature letter asks for; an int is
+// widened in place where a number is wanted
+static bool matches(char letter, KtValue* value) {
+    switch (letter) {
+        case 'b': return value->type == KT_BOOL;
+        case 'i': return value->type == KT_INT;
+        case 's': return value->type == KT_STRING;
+        case 'a': return value->type != KT_OTHER;
+        case 'n':
+            if (value->type == KT_INT) *value = kt_number((double)value->as.integer);
+            return value->type == KT_NUMBER;
+        default: return false;
+    }
+}
+
+// ============================================================================
+// NATIVES
+// ============================================================================
+
+// The NativeFn behind every host native: check the arguments against the
+// signature, call the host and check what it returns. Errors are reported
+// like a builtin's, and the call evaluates to null.
+static Value call_native(Interpreter* interp, Value* args, int arg_count) {
+    KtNative* native = (KtNative*)interp->native_callee->data.native_function.data;
+    KtIsolate* isolate = (KtIsolate*)interp->embedder;
+    
+    if (arg_count != native->arity) {
+        fprintf(stderr, "%s expects %d arguments, got %d\n", native->name, native->arity, arg_count);
+        return NULL_VAL;
+    }
+    
+    KtValue local[KT_LOCAL_ARGS] = {{0}};
+    KtValue* values = arg_count <= KT_LOCAL_ARGS ? local : (KtValue*)malloc(sizeof(KtValue) * arg_count);
+    for (int i = 0; i < arg_count; i++) {
+        values[i] = to_host(interp, &args[i], NULL);
+        if (!matches(native->params[i], &values[i])) {
+            fprintf(stderr, "%s expects %s as argument %d\n",
+                    native->name, type_letter_name(native->params[i]), i + 1);
+            if (values != local) free(values);
+            return NULL_VAL;
+        }
+    }
+    
+    KtValue returned = native->function(isolate, values, arg_count, native->user_data);
+    if (values != local) free(values);
+    if (native->result == 'v') return NULL_VAL;
+    
+    Value result;
+    if (!matches(native->result, &returned) || !from_host(interp, &returned, &result)) {
+        fprintf(stderr, "%s should return %s\n", native->name, type_letter_name(native->result));
+        return NULL_VAL;
+    }
+    return result;
+}
+
+// Split a signature such as "n(ns)" into native; false if it is malformed
+static bool parse_signature(const char* signature, KtNative* native) {
+    if (!signature || !signature[0] || !strchr("vbinsa", signature[0]) || signature[1] != '(') {
+        return false;
+    }
+    
+    const char* params = signature + 2;
+    int arity = 0;
+    while (params[arity] && params[arity] != ')') {
+        if (!strchr("binsa", params[arity])) return false;
+        arity++;
+    }
+    if (params[arity] != ')' || params[arity + 1] != '\0') return false;
+    
+    native->result = signature[0];
+    native->params = (char*)malloc((size_t)arity + 1);
+    memcpy(native->params, params, (size_t)arity);
+    native->params[arity] = '\0';
+    native->arity = arity;
+    return true;
+}
+
+// ============================================================================
+// PROGRAMS
+// ============================================================================
+
+KtProgram* kt_program_new(void) {
+    return (KtProgram*)calloc(1, sizeof(KtProgram));
+}
+
+void kt_program_free(KtProgram* program) {
+    if (!program) return;
+    
+    for (int i = 0; i < program->global_count; i++) free(program->globals[i]);
+    for (int i = 0; i < program->native_count; i++) {
+        free(program->natives[i]->name);
+        free(program->natives[i]->params);
+        free(program->natives[i]);
+    }
+    free(program->globals);
+    free(program->natives);
+    free(program->image);
+    free(program);
+}
+
+// Add a host native to a program that is not compiled yet
+KtStatus kt_program_define(KtProgram* program, const char* name, const char* signature,
+                           KtNativeFn function, void* user_data) {
+    if (!program || program->image || !name || !name[0] || !function) return KT_ERROR_ARGUMENT;
+    
+    KtNative* native = (KtNative*)calloc(1, sizeof(KtNative));
+    if (!parse_signature(signature, native)) {
+        free(native);
+        return KT_ERROR_ARGUMENT;
+    }
+    native->name = strdup(name);
+    native->function = function;
+    native->user_data = user_data;
+    
+    if (program->native_count == program->native_capacity) {
+        program->native_capacity = program->native_capacity ? program->native_capacity * 2 : 8;
+        program->natives = (KtNative**)realloc(program->natives,
+                                               sizeof(KtNative*) * program->native_capacity);
+    }
+    program->natives[program->native_count++] = native;
+    return KT_OK;
+}
+
+// Define the builtins and then the host's natives, in the slots every
+// interpreter of the program gives them
+static void define_globals(KtProgram* program, Interpreter* interp) {
+    register_builtins(interp);
+    for (int i = 0; i < program->native_count; i++) {
+        KtNative* native = program->natives[i];
+        define_native(interp, native->name, call_native);
+        Value defined = interp->global_scope->values[global_slot(interp, native->name)];
+        AS_OBJ(defined)->data.native_function.data = native;
+    }
+}
+
+// Compile source once into the program's image
+KtStatus kt_program_compile(KtProgram* program, const char* source, const char* path) {
+    if (!program || !source || program->image) return KT_ERROR_ARGUMENT;
+    
+    int token_count = 0;
+    Token* tokens = lexer_tokenize(source, &token_count);
+    
+    Interpreter* interp = interpreter_init();
+    module_set_dir(interp, path);
+    module_preload(interp, source, tokens, token_count);
+    
+    Parser* parser = parser_init(source, tokens, token_count);
+    ASTNode* ast = parser_parse(parser);
+    
+    // Anything but an image of a clean compile, with every module it
+    // includes loaded, is a compile error
+    KtStatus status = KT_ERROR_COMPILE;
+    if (parser->had_error) {
+        fprintf(stderr, "%s: parse errors occurred.\n", path ? path : "kt_program_compile");
+    } else {
+        interp->ast = ast;
+        define_globals(program, interp);
+        resolve_program(interp, ast);
+        Obj* script = compile_program(interp, ast);
+        if (script && program_image(interp, script, &program->image, &program->image_size)) {
+            status = KT_OK;
+        }
+    }
+    
+    if (status == KT_OK) {
+        Scope* globals = interp->global_scope;
+        program->globals = (char**)malloc(sizeof(char*) * (globals->count + 1));
+        for (int i = 0; i < globals->count; i++) program->globals[i] = strdup(globals->names[i]);
+        program->global_count = globals->count;
+    }
+    
+    interpreter_free(interp);
+    free_ast(ast);
+    free(parser);
+    free(tokens);
+    return status;
+}
+
+// Handle of a global by name: its slot, which is the same in every isolate
+KtHandle kt_program_find(const KtProgram* program, const char* name) {
+    if (!program || !name) return KT_NO_HANDLE;
+    
+    for (int i = 0; i < program->global_count; i++) {
+        if (strcmp(program->globals[i], name) == 0) return i;
+    }
+    return KT_NO_HANDLE;
+}
+
+// ============================================================================
+// ISOLATES
+// ============================================================================
+
+// Load the compiled program into a fresh interpreter
+KtIsolate* kt_isolate_new(KtProgram* program, void* user_data) {
+    if (!program || !program->image) return NULL;
+    
+    Interpreter* interp = interpreter_init();
+    define_globals(program, interp);
+    Obj* script = program_load(interp, program->image, program->image_size);
+    if (!script) {
+        interpreter_free(interp);
+        return NULL;
+    }
+    
+    KtIsolate* isolate = (KtIsolate*)calloc(1, sizeof(KtIsolate));
+    isolate->program = program;
+    isolate->interp = interp;
+    isolate->script = script;
+    isolate->user_data = user_data;
+    interp->embedder = isolate;
+    return isolate;
+}
+
+void kt_isolate_free(KtIsolate* isolate) {
+    if (!isolate) return;
+    
+    interpreter_free(isolate->interp);
+    free(isolate->text);
+    free(isolate);
+}
+
+void* kt_isolate_data(const KtIsolate* isolate) {
+    return isolate ? isolate->user_data : NULL;
+}
+
+KtStatus kt_isolate_run(KtIsolate* isolate) {
+    if (!isolate) return KT_ERROR_ARGUMENT;
+    return vm_run(isolate->interp, isolate->script) ? KT_OK : KT_ERROR_RUNTIME;
+}
+
+// Call a function global. A global that an included module exports starts
+// that module first, as reading it from a script would.
+KtStatus kt_call(KtIsolate* isolate, KtHandle handle, const KtValue* args, int arg_count,
+                 KtValue* result) {
+    if (result) *result = kt_null();
+    if (!isolate || arg_count < 0 || arg_count > KT_STACK_MAX / 2 || (arg_count > 0 && !args)) {
+        return KT_ERROR_ARGUMENT;
+    }
+    
+    Interpreter* interp = isolate->interp;
+    Scope* globals = interp->global_scope;
+    if (handle < 0 || handle >= globals->count) return KT_ERROR_ARGUMENT;
+    
+    if (IS_UNDEFINED(globals->values[handle])) module_touch(interp, handle);
+    Value callee = globals->values[handle];
+    if (callee.type != VALUE_NATIVE_FUNCTION &&
+        !(callee.type == VALUE_FUNCTION && AS_OBJ(callee)->data.function.chunk)) {
+        return KT_ERROR_NOT_CALLABLE;
+    }
+    
+    // Converting allocates only in the nursery, and nothing is collected
+    // before vm_call has the arguments on the stack
+    Value local[KT_LOCAL_ARGS];
+    Value* values = arg_count <= KT_LOCAL_ARGS ? local : (Value*)malloc(sizeof(Value) * arg_count);
+    for (int i = 0; i < arg_count; i++) {
+        if (!from_host(interp, &args[i], &values[i])) {
+            if (values != local) free(values);
+            return KT_ERROR_ARGUMENT;
+        }
+    }
+    
+    Value returned;
+    bool finished = vm_call(interp, callee, values, arg_count, &returned);
+    if (values != local) free(values);
+    if (!finished) return KT_ERROR_RUNTIME;
+    
+    if (result) *result = to_host(interp, &returned, isolate);
+    return KT_OK;
+}
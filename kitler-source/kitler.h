@@ -0,0 +1,174 @@
+#ifndef KT_KITLER_H
+#define KT_KITLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// libkitler: the public C API for embedding Kitler (see kitler.c)
+// A host defines its natives on a KtProgram and compiles a script into it
+// once, then creates as many KtIsolates from it as it likes. Each isolate
+// has its own heap, globals and VM, and nothing is shared between isolates
+// but the program's read-only bytecode, so different threads can run
+// different isolates in parallel. One isolate must only be used by one
+// thread at a time.
+//
+// This header is all a host includes; the interpreter's own types stay
+// private to the library.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+    #if defined(KT_BUILD_DLL)
+        #define KT_API __declspec(dllexport)
+    #elif defined(KT_DLL)
+        #define KT_API __declspec(dllimport)
+    #else
+        #define KT_API
+    #endif
+#elif defined(__GNUC__)
+    #define KT_API __attribute__((visibility("default")))
+#else
+    #define KT_API
+#endif
+
+// Bumped whenever a declaration below changes incompatibly
+#define KT_API_VERSION 1
+
+typedef struct KtProgram KtProgram;
+typedef struct KtIsolate KtIsolate;
+
+// A global of a program (a function to call), valid in every isolate of it
+typedef int KtHandle;
+#define KT_NO_HANDLE (-1)
+
+typedef enum {
+    KT_NULL,
+    KT_BOOL,
+    KT_INT,
+    KT_NUMBER,
+    KT_STRING,
+    KT_OTHER            // Any other script value; it cannot cross the API
+} KtType;
+
+// A value passed to or returned from a script. Strings are not copied: one
+// passed in is only read during the call, and one handed out is valid until
+// the next call into the same isolate.
+typedef struct {
+    KtType type;
+    union {
+        bool boolean;
+        int64_t integer;
+        double number;
+        struct {
+            const char* chars;
+            size_t length;
+        } string;
+    } as;
+} KtValue;
+
+typedef enum {
+    KT_OK,
+    KT_ERROR_ARGUMENT,      // Bad handle, signature or arguments, or out of order
+    KT_ERROR_COMPILE,       // The script could not be compiled
+    KT_ERROR_NOT_CALLABLE,  // The handle's global is not a function
+    KT_ERROR_RUNTIME        // The script did not finish
+} KtStatus;
+
+// A native the script can call. It receives the arguments its signature
+// asked for and returns a value of its signature's result type.
+typedef KtValue (*KtNativeFn)(KtIsolate* isolate, const KtValue* args, int arg_count, void* user_data);
+
+// ============================================================================
+// PROGRAMS
+// ============================================================================
+
+// Empty program, ready for its natives and then its script
+KT_API KtProgram* kt_program_new(void);
+
+// Free a program after every isolate created from it
+KT_API void kt_program_free(KtProgram* program);
+
+// Define a native global, such as "Host.Log", before the script is compiled.
+// signature is the result type, then the parameter types in parentheses, one
+// letter each: b bool, i int, n number, s string, a any value, and for the
+// result only v nothing, e.g. "n(ns)".
+KT_API KtStatus kt_program_define(KtProgram* program, const char* name, const char* signature,
+                                  KtNativeFn function, void* user_data);
+
+// Compile source into the program, once. path (may be NULL) names the script
+// in messages and is where its included script modules are looked up.
+KT_API KtStatus kt_program_compile(KtProgram* program, const char* source, const char* path);
+
+// Handle of a global the compiled program defines or uses, or KT_NO_HANDLE
+KT_API KtHandle kt_program_find(const KtProgram* program, const char* name);
+
+// ============================================================================
+// ISOLATES
+// ============================================================================
+
+// New interpreter for a compiled program, with the builtins and natives
+// loaded but the top level not yet run. NULL if the program cannot be loaded.
+KT_API KtIsolate* kt_isolate_new(KtProgram* program, void* user_data);
+KT_API void kt_isolate_free(KtIsolate* isolate);
+KT_API void* kt_isolate_data(const KtIsolate* isolate);
+
+// Run the program's top level, which defines its functions and globals
+KT_API KtStatus kt_isolate_run(KtIsolate* isolate);
+
+// Call the function behind handle; result (may be NULL) receives what it returned
+KT_API KtStatus kt_call(KtIsolate* isolate, KtHandle handle, const KtValue* args, int arg_count,
+                        KtValue* result);
+
+// ============================================================================
+// VALUES
+// ============================================================================
+
+static inline KtValue kt_null(void) {
+    KtValue value;
+    value.type = KT_NULL;
+    value.as.integer = 0;
+    return value;
+}
+
+static inline KtValue kt_bool(bool boolean) {
+    KtValue value;
+    value.type = KT_BOOL;
+    value.as.boolean = boolean;
+    return value;
+}
+
+static inline KtValue kt_int(int64_t integer) {
+    KtValue value;
+    value.type = KT_INT;
+    value.as.integer = integer;
+    return value;
+}
+
+static inline KtValue kt_number(double number) {
+    KtValue value;
+    value.type = KT_NUMBER;
+    value.as.number = number;
+    return value;
+}
+
+static inline KtValue kt_string_n(const char* chars, size_t length) {
+    KtValue value;
+    value.type = KT_STRING;
+    value.as.string.chars = chars;
+    value.as.string.length = length;
+    return value;
+}
+
+static inline KtValue kt_string(const char* chars) {
+    size_t length = 0;
+    while (chars[length]) length++;
+    return kt_string_n(chars, length);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
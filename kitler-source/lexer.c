@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <assert.h>
 #include "types.h"
 // Main lexer
 
@@ -9,10 +10,15 @@
 // The lexer man, why the heck should i name it smth else soso
 // Bro, bob4, wtf you meeeaaaaannnnnnnn
 
+static void check_keywords(void);
+
 // Initialize lexer
 Lexer* lexer_init(const char* source) {
+    check_keywords();
+    
     Lexer* lexer = (Lexer*)malloc(sizeof(Lexer));
     lexer->source = source;
+    lexer->start = source;
     lexer->current = source;
     lexer->line = 1;
     lexer->column = 1;
@@ -52,6 +58,25 @@ static bool match(Lexer* lexer, char expected) {
     return true;
 }
 
+// Build a token for the slice scanned since lexer->start
+static Token make_token(Lexer* lexer, TokenType type) {
+    Token token;
+    token.type = type;
+    token.start = (int)(lexer->start - lexer->source);
+    token.length = (int)(lexer->current - lexer->start);
+    token.line = lexer->line;
+    token.column = lexer->start_column;
+    token.value.number = 0;
+    return token;
+}
+
+// Build an error token (message must be a static string)
+static Token error_token(Lexer* lexer, const char* message) {
+    Token token = make_token(lexer, TOKEN_ERROR);
+    token.value.message = message;
+    return token;
+}
+
 // Skip whitespace (except newlines)
 static void skip_whitespace(Lexer* lexer) {
     while (true) {
@@ -94,9 +119,8 @@ static bool skip_comment(Lexer* lexer) {
     return false;
 }
 
-// Parse string literal
-static Token* parse_string(Lexer* lexer) {
-    const char* start = lexer->current;
+// Parse string literal (the value is the slice between the quotes)
+static Token parse_string(Lexer* lexer) {
     advance(lexer); // Opening quote
     
     while (!is_at_end(lexer) && peek(lexer) != '"') {
@@ -108,113 +132,156 @@ static Token* parse_string(Lexer* lexer) {
     }
     
     if (is_at_end(lexer)) {
-        Token* token = create_token(TOKEN_ERROR, "Unterminated string", lexer->line, lexer->start_column);
-        return token;
+        lexer->current = lexer->start + 1; // Report just the opening quote
+        return error_token(lexer, "Unterminated string");
     }
     
-    int length = lexer->current - start - 1;
-    char* string_value = (char*)malloc(length + 1);
-    strncpy(string_value, start + 1, length);
-    string_value[length] = '\0';
-    
     advance(lexer); // Closing quote
+    return make_token(lexer, TOKEN_STRING);
+}
+
+// Exact powers of ten representable as doubles
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Value of the number just scanned, given its leading digits and decimal scale.
+// With a mantissa below 2^53 and an exact power of ten this is one correctly
+// rounded operation; longer literals go through strtod on a stack copy.
+static double decimal_value(Lexer* lexer, uint64_t mantissa, int exponent) {
+    double value = (double)mantissa;
     
-    Token* token = create_token(TOKEN_STRING, string_value, lexer->line, lexer->start_column);
-    token->value.string = string_value;
-    return token;
+    if (mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        return exponent >= 0 ? value * powers_of_ten[exponent] : value / powers_of_ten[-exponent];
+    }
+    
+    char buffer[64];
+    int length = (int)(lexer->current - lexer->start);
+    if (length < (int)sizeof(buffer)) {
+        memcpy(buffer, lexer->start, length);
+        buffer[length] = '\0';
+        return strtod(buffer, NULL);
+    }
+    
+    // Absurdly long literal: scale in steps
+    while (exponent > 22) {
+        value *= 1e22;
+        exponent -= 22;
+    }
+    while (exponent < -22) {
+        value /= 1e22;
+        exponent += 22;
+    }
+    
+    return exponent >= 0 ? value * powers_of_ten[exponent] : value / powers_of_ten[-exponent];
 }
 
-// Parse number literal
-static Token* parse_number(Lexer* lexer) {
-    const char* start = lexer->current;
+// Parse number literal in place from the source slice. Without a decimal
+// point it is an integer, unless it is too large for 64 bits.
+static Token parse_number(Lexer* lexer) {
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
     
+    // Keep the first 19 significant digits; later integer digits only scale
     while (isdigit(peek(lexer))) {
-        advance(lexer);
+        int digit = advance(lexer) - '0';
+        if (digits < 19) {
+            mantissa = mantissa * 10 + digit;
+            if (mantissa > 0) digits++;
+        } else {
+            exponent++;
+        }
+    }
+    
+    if (exponent == 0 && mantissa <= INT64_MAX &&
+        !(peek(lexer) == '.' && isdigit(peek_next(lexer)))) {
+        Token token = make_token(lexer, TOKEN_INTEGER);
+        token.value.integer = (int64_t)mantissa;
+        return token;
     }
     
     // Check for decimal point
     if (peek(lexer) == '.' && isdigit(peek_next(lexer))) {
         advance(lexer); // .
         while (isdigit(peek(lexer))) {
-            advance(lexer);
+            int digit = advance(lexer) - '0';
+            if (digits < 19) {
+                mantissa = mantissa * 10 + digit;
+                if (mantissa > 0) digits++;
+                exponent--;
+            }
         }
     }
     
-    int length = lexer->current - start;
-    char* number_str = (char*)malloc(length + 1);
-    strncpy(number_str, start, length);
-    number_str[length] = '\0';
-    
-    double value = atof(number_str);
-    
-    Token* token = create_token(TOKEN_NUMBER, number_str, lexer->line, lexer->start_column);
-    token->value.number = value;
-    
-    free(number_str);
+    Token token = make_token(lexer, TOKEN_NUMBER);
+    token.value.number = decimal_value(lexer, mantissa, exponent);
     return token;
 }
 
-// Parse identifier or keyword
-static Token* parse_identifier(Lexer* lexer) {
-    const char* start = lexer->current;
+// Perfect hash over (first char, last char, length) for the KT_KEYWORDS list
+#define KEYWORD_HASH(first, last, length) \
+    (((unsigned)(first) * 11 + (unsigned)(last) * 2 + (unsigned)(length) * 3) & 63)
+
+typedef struct {
+    const char* spelling;
+    int length;
+    TokenType type;
+} Keyword;
+
+#define KEYWORD_ENTRY(token, spelling, first, last) \
+    [KEYWORD_HASH(first, last, sizeof(spelling) - 1)] = { spelling, sizeof(spelling) - 1, token },
+
+// Built at compile time; empty buckets have length 0 and never match
+static const Keyword keyword_table[64] = {
+    KT_KEYWORDS(KEYWORD_ENTRY)
+};
+
+// Classify a scanned word with one hash probe and one compare
+static TokenType keyword_type(const char* start, int length) {
+    const Keyword* keyword = &keyword_table[
+        KEYWORD_HASH((unsigned char)start[0], (unsigned char)start[length - 1], length)];
     
+    if (keyword->length == length && memcmp(start, keyword->spelling, length) == 0) {
+        return keyword->type;
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+// The first and last characters in KT_KEYWORDS are typed by hand, and a wrong
+// one would quietly make its keyword an identifier: every spelling must lex
+// as its own token
+#define KEYWORD_CHECK(token, spelling, first, last) \
+    assert(keyword_type(spelling, sizeof(spelling) - 1) == token);
+
+static void check_keywords(void) {
+    KT_KEYWORDS(KEYWORD_CHECK)
+}
+
+// Parse identifier or keyword
+static Token parse_identifier(Lexer* lexer) {
     while (isalnum(peek(lexer)) || peek(lexer) == '_' || peek(lexer) == '.') {
         advance(lexer);
     }
     
-    int length = lexer->current - start;
-    char* identifier = (char*)malloc(length + 1);
-    strncpy(identifier, start, length);
-    identifier[length] = '\0';
-    
-    // Check for keywords
-    TokenType type = TOKEN_IDENTIFIER;
-    
-    if (strcmp(identifier, "including") == 0) type = TOKEN_INCLUDING;
-    else if (strcmp(identifier, "projectSpace") == 0) type = TOKEN_PROJECTSPACE;
-    else if (strcmp(identifier, "NewVar") == 0) type = TOKEN_NEWVAR;
-    else if (strcmp(identifier, "NewFunc") == 0) type = TOKEN_NEWFUNC;
-    else if (strcmp(identifier, "NewClass") == 0) type = TOKEN_NEWCLASS;
-    else if (strcmp(identifier, "NewEvent") == 0) type = TOKEN_NEWEVENT;
-    else if (strcmp(identifier, "NewAsync") == 0) type = TOKEN_NEWASYNC;
-    else if (strcmp(identifier, "if") == 0) type = TOKEN_IF;
-    else if (strcmp(identifier, "else") == 0) type = TOKEN_ELSE;
-    else if (strcmp(identifier, "while") == 0) type = TOKEN_WHILE;
-    else if (strcmp(identifier, "for") == 0) type = TOKEN_FOR;
-    else if (strcmp(identifier, "foreach") == 0) type = TOKEN_FOREACH;
-    else if (strcmp(identifier, "in") == 0) type = TOKEN_IN;
-    else if (strcmp(identifier, "switch") == 0) type = TOKEN_SWITCH;
-    else if (strcmp(identifier, "case") == 0) type = TOKEN_CASE;
-    else if (strcmp(identifier, "default") == 0) type = TOKEN_DEFAULT;
-    else if (strcmp(identifier, "break") == 0) type = TOKEN_BREAK;
-    else if (strcmp(identifier, "return") == 0) type = TOKEN_RETURN;
-    else if (strcmp(identifier, "run") == 0) type = TOKEN_RUN;
-    else if (strcmp(identifier, "end") == 0) type = TOKEN_END;
-    else if (strcmp(identifier, "when") == 0) type = TOKEN_WHEN;
-    else if (strcmp(identifier, "this") == 0) type = TOKEN_THIS;
-    else if (strcmp(identifier, "New") == 0) type = TOKEN_NEW;
-    else if (strcmp(identifier, "await") == 0) type = TOKEN_AWAIT;
-    else if (strcmp(identifier, "true") == 0) type = TOKEN_TRUE;
-    else if (strcmp(identifier, "false") == 0) type = TOKEN_FALSE;
-    else if (strcmp(identifier, "and") == 0) type = TOKEN_AND;
-    else if (strcmp(identifier, "or") == 0) type = TOKEN_OR;
-    
-    Token* token = create_token(type, identifier, lexer->line, lexer->start_column);
-    return token;
+    TokenType type = keyword_type(lexer->start, (int)(lexer->current - lexer->start));
+    return make_token(lexer, type);
 }
 
 // Get next token
-Token* lexer_next_token(Lexer* lexer) {
+Token lexer_next_token(Lexer* lexer) {
     // Skip whitespace and comments
     while (true) {
         skip_whitespace(lexer);
         if (!skip_comment(lexer)) break;
     }
     
+    lexer->start = lexer->current;
     lexer->start_column = lexer->column;
     
     if (is_at_end(lexer)) {
-        return create_token(TOKEN_EOF, "", lexer->line, lexer->column);
+        return make_token(lexer, TOKEN_EOF);
     }
     
     char c = peek(lexer);
@@ -222,7 +289,7 @@ Token* lexer_next_token(Lexer* lexer) {
     // Newline
     if (c == '\n') {
         advance(lexer);
-        Token* token = create_token(TOKEN_NEWLINE, "\\n", lexer->line, lexer->start_column);
+        Token token = make_token(lexer, TOKEN_NEWLINE);
         lexer->line++;
         lexer->column = 1;
         return token;
@@ -247,73 +314,71 @@ Token* lexer_next_token(Lexer* lexer) {
     advance(lexer);
     
     switch (c) {
-        case '(': return create_token(TOKEN_LPAREN, "(", lexer->line, lexer->start_column);
-        case ')': return create_token(TOKEN_RPAREN, ")", lexer->line, lexer->start_column);
-        case '[': return create_token(TOKEN_LBRACKET, "[", lexer->line, lexer->start_column);
-        case ']': return create_token(TOKEN_RBRACKET, "]", lexer->line, lexer->start_column);
-        case '{': return create_token(TOKEN_LBRACE, "{", lexer->line, lexer->start_column);
-        case '}': return create_token(TOKEN_RBRACE, "}", lexer->line, lexer->start_column);
-        case ',': return create_token(TOKEN_COMMA, ",", lexer->line, lexer->start_column);
-        case '.': return create_token(TOKEN_DOT, ".", lexer->line, lexer->start_column);
-        case ':': return create_token(TOKEN_COLON, ":", lexer->line, lexer->start_column);
-        case '#': return create_token(TOKEN_HASH, "#", lexer->line, lexer->start_column);
-        case '+': return create_token(TOKEN_PLUS, "+", lexer->line, lexer->start_column);
-        case '-': return create_token(TOKEN_MINUS, "-", lexer->line, lexer->start_column);
-        case '*': return create_token(TOKEN_STAR, "*", lexer->line, lexer->start_column);
-        case '/': return create_token(TOKEN_SLASH, "/", lexer->line, lexer->start_column);
-        case '%': return create_token(TOKEN_PERCENT, "%", lexer->line, lexer->start_column);
+        case '(': return make_token(lexer, TOKEN_LPAREN);
+        case ')': return make_token(lexer, TOKEN_RPAREN);
+        case '[': return make_token(lexer, TOKEN_LBRACKET);
+        case ']': return make_token(lexer, TOKEN_RBRACKET);
+        case '{': return make_token(lexer, TOKEN_LBRACE);
+        case '}': return make_token(lexer, TOKEN_RBRACE);
+        case ',': return make_token(lexer, TOKEN_COMMA);
+        case '.': return make_token(lexer, TOKEN_DOT);
+        case ':': return make_token(lexer, TOKEN_COLON);
+        case '#': return make_token(lexer, TOKEN_HASH);
+        case '+': return make_token(lexer, TOKEN_PLUS);
+        case '-': return make_token(lexer, TOKEN_MINUS);
+        case '*': return make_token(lexer, TOKEN_STAR);
+        case '/': return make_token(lexer, TOKEN_SLASH);
+        case '%': return make_token(lexer, TOKEN_PERCENT);
         case '=':
             if (match(lexer, '=')) {
-                return create_token(TOKEN_EQUAL, "==", lexer->line, lexer->start_column);
+                return make_token(lexer, TOKEN_EQUAL);
             }
-            return create_token(TOKEN_ASSIGN, "=", lexer->line, lexer->start_column);
+            return make_token(lexer, TOKEN_ASSIGN);
         case '!':
             if (match(lexer, '=')) {
-                return create_token(TOKEN_NOT_EQUAL, "!=", lexer->line, lexer->start_column);
+                return make_token(lexer, TOKEN_NOT_EQUAL);
             }
-            return create_token(TOKEN_NOT, "!", lexer->line, lexer->start_column);
+            return make_token(lexer, TOKEN_NOT);
         case '<':
             if (match(lexer, '=')) {
-                return create_token(TOKEN_LESS_EQUAL, "<=", lexer->line, lexer->start_column);
+                return make_token(lexer, TOKEN_LESS_EQUAL);
             }
-            return create_token(TOKEN_LESS, "<", lexer->line, lexer->start_column);
+            return make_token(lexer, TOKEN_LESS);
         case '>':
             if (match(lexer, '=')) {
-                return create_token(TOKEN_GREATER_EQUAL, ">=", lexer->line, lexer->start_column);
+                return make_token(lexer, TOKEN_GREATER_EQUAL);
             }
-            return create_token(TOKEN_GREATER, ">", lexer->line, lexer->start_column);
+            return make_token(lexer, TOKEN_GREATER);
     }
     
-    char error_msg[50];
-    sprintf(error_msg, "Unexpected character: %c", c);
-    return create_token(TOKEN_ERROR, error_msg, lexer->line, lexer->start_column);
+    return error_token(lexer, "Unexpected character");
 }
 
-// Tokenize entire source
-Token** lexer_tokenize(const char* source, int* token_count) {
+// Tokenize entire source into one contiguous array (release with free)
+Token* lexer_tokenize(const char* source, int* token_count) {
     Lexer* lexer = lexer_init(source);
     
-    int capacity = 256;
-    Token** tokens = (Token**)malloc(sizeof(Token*) * capacity);
+    // Roughly one token per 4 source bytes avoids most regrowth
+    int capacity = 256 + (int)(strlen(source) / 4);
+    Token* tokens = (Token*)malloc(sizeof(Token) * capacity);
     *token_count = 0;
     
     while (true) {
-        Token* token = lexer_next_token(lexer);
+        Token token = lexer_next_token(lexer);
         
         // Skip newlines for simplicity (can be added back for statement separation)
-        if (token->type == TOKEN_NEWLINE) {
-            free_token(token);
+        if (token.type == TOKEN_NEWLINE) {
             continue;
         }
         
         if (*token_count >= capacity) {
             capacity *= 2;
-            tokens = (Token**)realloc(tokens, sizeof(Token*) * capacity);
+            tokens = (Token*)realloc(tokens, sizeof(Token) * capacity);
         }
         
         tokens[(*token_count)++] = token;
         
-        if (token->type == TOKEN_EOF || token->type == TOKEN_ERROR) {
+        if (token.type == TOKEN_EOF || token.type == TOKEN_ERROR) {
             break;
         }
     }
@@ -6,16 +6,25 @@
 
 // External function declarations
 extern Lexer* lexer_init(const char* source);
-extern Token** lexer_tokenize(const char* source, int* token_count);
+extern Token* lexer_tokenize(const char* source, int* token_count);
 extern void lexer_free(Lexer* lexer);
 
-extern Parser* parser_init(Token** tokens, int token_count);
+extern Parser* parser_init(const char* source, Token* tokens, int token_count);
 extern ASTNode* parser_parse(Parser* parser);
 
 extern Interpreter* interpreter_init();
-extern void interpreter_run(Interpreter* interp, ASTNode* ast);
+extern bool interpreter_run(Interpreter* interp, ASTNode* ast);
+extern void interpreter_run_input(Interpreter* interp, ASTNode* ast);
+extern Obj* interpreter_compile(Interpreter* interp, ASTNode* ast);
+extern void register_builtins(Interpreter* interp);
 extern void interpreter_free(Interpreter* interp);
 
+// Execute with the AST tree walker instead of the bytecode VM (--walker)
+static bool use_tree_walker = false;
+
+// Neither read nor write the compiled .ktc cache (--no-cache)
+static bool use_cache = true;
+
 // Read file contents
 char* read_file(const char* filename) {
     FILE* file = fopen(filename, "rb");
@@ -36,23 +45,32 @@ char* read_file(const char* filename) {
     return buffer;
 }
 
-// Run KT source code
-int run_source(const char* source) {
+// Run KT source code read from path (NULL for REPL input); with a cache
+// path, the compiled script is saved there
+int run_source(const char* source, const char* path, const char* cache_path) {
     // Tokenize
     int token_count = 0;
-    Token** tokens = lexer_tokenize(source, &token_count);
+    Token* tokens = lexer_tokenize(source, &token_count);
     
     printf("=== LEXER OUTPUT ===\n");
     printf("Generated %d tokens\n\n", token_count);
     
+    // Priority includes are parsed on background threads while this file parses
+    Interpreter* interp = interpreter_init();
+    interp->use_tree_walker = use_tree_walker;
+    module_set_dir(interp, path);
+    module_preload(interp, source, tokens, token_count);
+    
     // Parse
-    Parser* parser = parser_init(tokens, token_count);
+    Parser* parser = parser_init(source, tokens, token_count);
     ASTNode* ast = parser_parse(parser);
     
     if (parser->had_error) {
         fprintf(stderr, "Parse errors occurred.\n");
+        interpreter_free(interp);
         free_ast(ast);
         free(parser);
+        free(tokens);
         return 1;
     }
     
@@ -61,23 +79,53 @@ int run_source(const char* source) {
     
     // Interpret
     printf("=== EXECUTION OUTPUT ===\n");
-    Interpreter* interp = interpreter_init();
-    interpreter_run(interp, ast);
+    
+    // A program that did not compile is neither cached nor run
+    int result = 0;
+    if (cache_path && !use_tree_walker) {
+        Obj* script = interpreter_compile(interp, ast);
+        if (script) {
+            ktc_save(interp, cache_path, script, source, strlen(source));
+            if (!vm_run(interp, script)) result = 1;
+        } else {
+            result = 1;
+        }
+    } else if (!interpreter_run(interp, ast)) {
+        result = 1;
+    }
     
     // Cleanup
     interpreter_free(interp);
     free_ast(ast);
     free(parser);
+    free(tokens);
     
-    for (int i = 0; i < token_count; i++) {
-        free_token(tokens[i]);
+    return result;
+}
+
+// Run a script from its compiled cache without lexing or parsing it; false
+// when there is no cache for this exact source and compiler. *result is the
+// exit status of the run.
+static bool run_cached(const char* cache_path, const char* source, int* result) {
+    Interpreter* interp = interpreter_init();
+    register_builtins(interp);
+    
+    Obj* script = ktc_load(interp, cache_path, source, strlen(source));
+    if (!script) {
+        interpreter_free(interp);
+        return false;
     }
-    free(tokens);
     
-    return 0;
+    printf("=== COMPILED CACHE ===\n");
+    printf("Loaded %s\n\n", cache_path);
+    
+    printf("=== EXECUTION OUTPUT ===\n");
+    *result = vm_run(interp, script) ? 0 : 1;
+    interpreter_free(interp);
+    return true;
 }
 
-// Run file
+// Run file, from its .ktc cache when that is still valid
 int run_file(const char* filename) {
     char* source = read_file(filename);
     if (!source) return 1;
@@ -85,38 +133,221 @@ int run_file(const char* filename) {
     printf("Running: %s\n", filename);
     printf("=====================================\n\n");
     
-    int result = run_source(source);
+    char* cache_path = use_cache && !use_tree_walker ? ktc_path(filename) : NULL;
+    int result = 0;
+    if (!cache_path || !run_cached(cache_path, source, &result)) {
+        result = run_source(source, filename, cache_path);
+    }
+    
+    free(cache_path);
+    free(source);
+    
+    return result;
+}
+
+// Run file's top level, then save the heap it built as a snapshot
+int create_snapshot(const char* filename, const char* snapshot_path) {
+    char* source = read_file(filename);
+    if (!source) return 1;
+    
+    int token_count = 0;
+    Token* tokens = lexer_tokenize(source, &token_count);
+    
+    Interpreter* interp = interpreter_init();
+    module_set_dir(interp, filename);
+    module_preload(interp, source, tokens, token_count);
+    
+    Parser* parser = parser_init(source, tokens, token_count);
+    ASTNode* ast = parser_parse(parser);
+    int result = 1;
+    
+    if (parser->had_error) {
+        fprintf(stderr, "Parse errors occurred.\n");
+    } else {
+        Obj* script = interpreter_compile(interp, ast);
+        
+        if (!script) {
+            fprintf(stderr, "Error: '%s' could not be compiled\n", filename);
+        } else if (!vm_run(interp, script)) {
+            fprintf(stderr, "Error: '%s' stopped before its top level finished\n", filename);
+        } else if (snapshot_save(interp, snapshot_path, script)) {
+            printf("Snapshot written to %s\n", snapshot_path);
+            result = 0;
+        } else {
+            fprintf(stderr, "Error: Could not write a snapshot of '%s'\n", filename);
+        }
+    }
+    
+    interpreter_free(interp);
+    free_ast(ast);
+    free(parser);
+    free(tokens);
     free(source);
     
     return result;
 }
 
-// REPL (Read-Eval-Print-Loop)
+// Script entry point: a function named WhenRan, or <Project>.WhenRan
+static Value find_when_ran(Interpreter* interp) {
+    Scope* globals = interp->global_scope;
+    
+    for (int i = 0; i < globals->count; i++) {
+        const char* name = globals->names[i];
+        size_t length = strlen(name);
+        bool entry = strcmp(name, "WhenRan") == 0 ||
+            (length > 8 && strcmp(name + length - 8, ".WhenRan") == 0);
+        
+        if (entry && globals->values[i].type == VALUE_FUNCTION) return globals->values[i];
+    }
+    return UNDEFINED_VAL;
+}
+
+// Restore a heap snapshot and go straight to WhenRan: nothing is lexed,
+// parsed, compiled or initialised again
+int run_snapshot(const char* snapshot_path) {
+    Interpreter* interp = interpreter_init();
+    register_builtins(interp);
+    
+    if (!snapshot_load(interp, snapshot_path)) {
+        fprintf(stderr, "Error: Could not load snapshot '%s'\n", snapshot_path);
+        interpreter_free(interp);
+        return 1;
+    }
+    
+    Value when_ran = find_when_ran(interp);
+    Value returned;
+    int result = 0;
+    
+    if (IS_UNDEFINED(when_ran)) {
+        fprintf(stderr, "Error: Snapshot '%s' has no WhenRan function\n", snapshot_path);
+        result = 1;
+    } else if (!vm_call(interp, when_ran, NULL, 0, &returned)) {
+        result = 1;
+    }
+    
+    interpreter_free(interp);
+    return result;
+}
+
+// Blocks still open at the end of REPL input: brackets, and 'run:' blocks
+// waiting for their 'end'
+static int open_blocks(const Token* tokens, int token_count) {
+    int depth = 0;
+    
+    for (int i = 0; i < token_count; i++) {
+        switch (tokens[i].type) {
+            case TOKEN_LPAREN:
+            case TOKEN_LBRACKET:
+            case TOKEN_LBRACE:
+                depth++;
+                break;
+            case TOKEN_RPAREN:
+            case TOKEN_RBRACKET:
+            case TOKEN_RBRACE:
+            case TOKEN_END:
+                depth--;
+                break;
+            case TOKEN_RUN:
+                if (i + 1 < token_count && tokens[i + 1].type == TOKEN_COLON) depth++;
+                break;
+            default:
+                break;
+        }
+    }
+    
+    return depth;
+}
+
+// REPL (Read-Eval-Print-Loop). One interpreter lives for the whole session,
+// so globals, functions, classes and included modules carry over from one
+// input to the next, and each input is only lexed, parsed and compiled on
+// its own. Input with an open block continues on the next line; an empty
+// line runs it as it is.
 void run_repl() {
     char line[1024];
+    size_t capacity = sizeof(line);
+    size_t length = 0;
+    size_t line_start = 0;
+    char* input = (char*)malloc(capacity);
+    
+    // Compiled functions and closures point into their program's AST, so
+    // every program stays alive until the session ends
+    ASTNode** programs = NULL;
+    int program_count = 0;
+    
+    Interpreter* interp = interpreter_init();
+    interp->use_tree_walker = use_tree_walker;
+    module_set_dir(interp, NULL);
+    register_builtins(interp);
     
     printf("Kitler (KT) REPL v1.0\n");
     printf("Type 'exit' to quit\n\n");
     
     while (true) {
-        printf("kt> ");
+        if (line_start == length) printf(length == 0 ? "kt> " : "... ");
         
         if (!fgets(line, sizeof(line), stdin)) {
             break;
         }
         
-        // Remove newline
-        line[strcspn(line, "\n")] = 0;
+        size_t chunk = strlen(line);
+        if (length + chunk + 1 > capacity) {
+            while (length + chunk + 1 > capacity) capacity *= 2;
+            input = (char*)realloc(input, capacity);
+        }
+        memcpy(input + length, line, chunk + 1);
+        length += chunk;
         
-        if (strcmp(line, "exit") == 0 || strcmp(line, "quit") == 0) {
-            break;
+        // The rest of a line longer than the buffer is still to come
+        if (input[length - 1] != '\n' && !feof(stdin)) continue;
+        
+        const char* current = input + line_start;
+        size_t current_length = strcspn(current, "\r\n");
+        bool blank = current_length == 0;
+        line_start = length;
+        
+        if (current == input) {
+            if ((current_length == 4 && strncmp(input, "exit", 4) == 0) ||
+                (current_length == 4 && strncmp(input, "quit", 4) == 0)) {
+                break;
+            }
+            
+            if (blank) {
+                length = line_start = 0;
+                continue;
+            }
+        }
+        
+        int token_count = 0;
+        Token* tokens = lexer_tokenize(input, &token_count);
+        
+        if (!blank && open_blocks(tokens, token_count) > 0) {
+            free(tokens);
+            continue;
         }
         
-        if (strlen(line) == 0) continue;
+        Parser* parser = parser_init(input, tokens, token_count);
+        ASTNode* ast = parser_parse(parser);
         
-        run_source(line);
-        printf("\n");
+        if (parser->had_error) {
+            free_ast(ast);
+        } else {
+            programs = (ASTNode**)realloc(programs, sizeof(ASTNode*) * (program_count + 1));
+            programs[program_count++] = ast;
+            interpreter_run_input(interp, ast);
+        }
+        
+        free(parser);
+        free(tokens);
+        length = line_start = 0;
+    }
+    
+    interpreter_free(interp);
+    for (int i = 0; i < program_count; i++) {
+        free_ast(programs[i]);
     }
+    free(programs);
+    free(input);
     
     printf("Goodbye!\n");
 }
@@ -127,6 +358,11 @@ void print_usage() {
     printf("Usage:\n");
     printf("  kt                        Start REPL\n");
     printf("  kt run --file=<file.kt>   Run a KT file\n");
+    printf("       [--walker]           Use the AST tree walker instead of the VM\n");
+    printf("       [--no-cache]         Do not read or write the compiled .ktc cache\n");
+    printf("  kt run --snapshot=<file>  Restore a heap snapshot and call WhenRan\n");
+    printf("  kt snapshot --file=<file.kt> -o <file.ktsnap>\n");
+    printf("                            Run the top level and snapshot the heap\n");
     printf("  kt --config               Configure project (interactive)\n");
     printf("  kt --config=auto          Auto-configure project\n");
     printf("  kt new <project>          Create new project\n");
@@ -207,9 +443,23 @@ int main(int argc, char** argv) {
     }
     
     if (strcmp(argv[1], "run") == 0 && argc >= 3) {
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--walker") == 0) use_tree_walker = true;
+            if (strcmp(argv[i], "--no-cache") == 0) use_cache = false;
+        }
+        
         if (strncmp(argv[2], "--file=", 7) == 0) {
             return run_file(argv[2] + 7);
         }
+        
+        if (strncmp(argv[2], "--snapshot=", 11) == 0) {
+            return run_snapshot(argv[2] + 11);
+        }
+    }
+    
+    if (strcmp(argv[1], "snapshot") == 0 && argc >= 5 &&
+        strncmp(argv[2], "--file=", 7) == 0 && strcmp(argv[3], "-o") == 0) {
+        return create_snapshot(argv[2] + 7, argv[4]);
     }
     
     if (strcmp(argv[1], "new") == 0 && argc >= 3) {
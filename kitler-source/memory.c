@@ -1,30 +1,130 @@
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
 #include "types.h"
 
-// Create token
-Token* create_token(TokenType type, const char* lexeme, int line, int column) {
-    Token* token = (Token*)malloc(sizeof(Token));
-    token->type = type;
-    token->lexeme = strdup(lexeme);
-    token->line = line;
-    token->column = column;
-    return token;
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN 8
+
+// Create an empty arena (the first block is allocated on demand)
+Arena* arena_create() {
+    Arena* arena = (Arena*)malloc(sizeof(Arena));
+    arena->blocks = NULL;
+    arena->last = NULL;
+    arena->names = NULL;
+    arena->name_count = 0;
+    arena->name_capacity = 0;
+    return arena;
+}
+
+// Bump-allocate size bytes (oversized requests get a block of their own)
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    
+    ArenaBlock* block = arena->blocks;
+    if (!block || block->used + size > block->capacity) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + capacity);
+        block->used = 0;
+        block->capacity = capacity;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    
+    void* memory = block->data + block->used;
+    block->used += size;
+    arena->last = memory;
+    return memory;
+}
+
+// Resize an arena array; extends in place when it was the last allocation
+void* arena_grow(Arena* arena, void* old, size_t old_size, size_t new_size) {
+    old_size = (old_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    new_size = (new_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    
+    ArenaBlock* block = arena->blocks;
+    if (old && old == arena->last &&
+        (char*)old + new_size <= block->data + block->capacity) {
+        block->used += new_size - old_size;
+        return old;
+    }
+    
+    void* memory = arena_alloc(arena, new_size);
+    if (old) memcpy(memory, old, old_size);
+    return memory;
+}
+
+// Copy length bytes into the arena as a C string
+char* arena_strndup(Arena* arena, const char* chars, int length) {
+    char* copy = (char*)arena_alloc(arena, length + 1);
+    memcpy(copy, chars, length);
+    copy[length] = '\0';
+    return copy;
 }
 
-// Free token
-void free_token(Token* token) {
-    if (!token) return;
-    if (token->lexeme) free(token->lexeme);
-    if (token->type == TOKEN_STRING && token->value.string) {
-        free(token->value.string);
+// FNV-1a hash of a name
+static uint32_t hash_chars(const char* chars, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)chars[i];
+        hash *= 16777619u;
     }
-    free(token);
+    return hash;
 }
 
-// Create AST node
-ASTNode* create_node(NodeType type, int line, int column) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
+// Return the arena's single copy of a name, adding it on first use
+char* arena_intern(Arena* arena, const char* chars, int length) {
+    // Keep the table at most half full
+    if (arena->name_count * 2 >= arena->name_capacity) {
+        int capacity = arena->name_capacity < 64 ? 64 : arena->name_capacity * 2;
+        char** names = (char**)calloc(capacity, sizeof(char*));
+        
+        for (int i = 0; i < arena->name_capacity; i++) {
+            char* name = arena->names[i];
+            if (!name) continue;
+            
+            uint32_t index = hash_chars(name, (int)strlen(name)) & (capacity - 1);
+            while (names[index]) index = (index + 1) & (capacity - 1);
+            names[index] = name;
+        }
+        
+        free(arena->names);
+        arena->names = names;
+        arena->name_capacity = capacity;
+    }
+    
+    uint32_t index = hash_chars(chars, length) & (arena->name_capacity - 1);
+    while (arena->names[index]) {
+        char* name = arena->names[index];
+        if (strncmp(name, chars, length) == 0 && name[length] == '\0') return name;
+        index = (index + 1) & (arena->name_capacity - 1);
+    }
+    
+    char* name = arena_strndup(arena, chars, length);
+    arena->names[index] = name;
+    arena->name_count++;
+    return name;
+}
+
+// Release every block of the arena at once
+void arena_free(Arena* arena) {
+    if (!arena) return;
+    
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    
+    free(arena->names);
+    free(arena);
+}
+
+// Create AST node in the program's arena
+ASTNode* create_node(Arena* arena, NodeType type, int line, int column) {
+    ASTNode* node = (ASTNode*)arena_alloc(arena, sizeof(ASTNode));
     node->type = type;
     node->line = line;
     node->column = column;
@@ -35,335 +135,868 @@ ASTNode* create_node(NodeType type, int line, int column) {
     return node;
 }
 
-// Free AST node recursively
-void free_ast(ASTNode* node) {
-    if (!node) return;
+// Free a parsed program: nodes, child arrays and names all live in its arena
+void free_ast(ASTNode* program) {
+    if (!program) return;
+    arena_free(program->data.block.arena);
+}
+
+// Create heap object
+Obj* create_object(ValueType type) {
+    Obj* object = (Obj*)malloc(sizeof(Obj));
+    object->type = type;
+    object->is_marked = false;
+    object->is_remembered = false;
+    object->is_permanent = false;
     
-    switch (node->type) {
-        case NODE_INCLUDING:
-            if (node->data.including.library) free(node->data.including.library);
-            break;
-            
-        case NODE_PROJECTSPACE:
-            if (node->data.projectspace.name) free(node->data.projectspace.name);
-            for (int i = 0; i < node->data.projectspace.child_count; i++) {
-                free_ast(node->data.projectspace.children[i]);
-            }
-            if (node->data.projectspace.children) free(node->data.projectspace.children);
-            break;
-            
-        case NODE_VARDECL:
-            if (node->data.var_decl.name) free(node->data.var_decl.name);
-            free_ast(node->data.var_decl.initializer);
-            break;
-            
-        case NODE_FUNCDECL:
-            if (node->data.func_decl.name) free(node->data.func_decl.name);
-            for (int i = 0; i < node->data.func_decl.param_count; i++) {
-                if (node->data.func_decl.params[i]) free(node->data.func_decl.params[i]);
-            }
-            if (node->data.func_decl.params) free(node->data.func_decl.params);
-            free_ast(node->data.func_decl.body);
-            break;
-            
-        case NODE_CLASSDECL:
-            if (node->data.class_decl.name) free(node->data.class_decl.name);
-            for (int i = 0; i < node->data.class_decl.member_count; i++) {
-                free_ast(node->data.class_decl.members[i]);
-            }
-            if (node->data.class_decl.members) free(node->data.class_decl.members);
-            break;
-            
-        case NODE_EVENTDECL:
-            if (node->data.event_decl.name) free(node->data.event_decl.name);
-            for (int i = 0; i < node->data.event_decl.param_count; i++) {
-                if (node->data.event_decl.params[i]) free(node->data.event_decl.params[i]);
-            }
-            if (node->data.event_decl.params) free(node->data.event_decl.params);
+    // Initialize all pointers to NULL
+    memset(&object->data, 0, sizeof(object->data));
+    
+    return object;
+}
+
+// Free the data a heap object owns (referenced objects are managed by GC)
+static void free_object_data(Obj* object) {
+    switch (object->type) {
+        case VALUE_STRING:
+            if (object->data.string.chars) free(object->data.string.chars);
             break;
             
-        case NODE_BLOCK:
-        case NODE_PROGRAM:
-            for (int i = 0; i < node->data.block.statement_count; i++) {
-                free_ast(node->data.block.statements[i]);
-            }
-            if (node->data.block.statements) free(node->data.block.statements);
+        case VALUE_LIST:
+            if (object->data.list.elements) free(object->data.list.elements);
             break;
             
-        case NODE_IF:
-            free_ast(node->data.if_stmt.condition);
-            free_ast(node->data.if_stmt.then_branch);
-            free_ast(node->data.if_stmt.else_branch);
+        case VALUE_MAP:
+            map_free(object);
             break;
             
-        case NODE_WHILE:
-            free_ast(node->data.while_loop.condition);
-            free_ast(node->data.while_loop.body);
+        case VALUE_ARRAY:
+            if (object->data.array.block) free(object->data.array.block);
             break;
             
-        case NODE_FOR:
-        case NODE_FOREACH:
-            if (node->data.for_loop.iterator) free(node->data.for_loop.iterator);
-            free_ast(node->data.for_loop.iterable);
-            free_ast(node->data.for_loop.body);
+        case VALUE_FUNCTION:
+            // Only a prototype owns its name; a closure borrows the prototype's
+            if (object->is_permanent && object->data.function.name) free(object->data.function.name);
+            if (object->data.function.upvalues) free(object->data.function.upvalues);
+            // Note: params and captures are managed by AST, don't free here
             break;
             
-        case NODE_SWITCH:
-            free_ast(node->data.switch_stmt.expression);
-            for (int i = 0; i < node->data.switch_stmt.case_count; i++) {
-                free_ast(node->data.switch_stmt.cases[i]);
-            }
-            if (node->data.switch_stmt.cases) free(node->data.switch_stmt.cases);
-            free_ast(node->data.switch_stmt.default_case);
+        case VALUE_CLASS:
+            // The vtable and shape belong to the interpreter
+            if (object->data.class_obj.name) free(object->data.class_obj.name);
+            if (object->data.class_obj.methods) free(object->data.class_obj.methods);
+            if (object->data.class_obj.defaults) free(object->data.class_obj.defaults);
             break;
             
-        case NODE_CASE:
-            free_ast(node->data.case_stmt.value);
-            free_ast(node->data.case_stmt.body);
+        case VALUE_INSTANCE:
+            // Shapes belong to the interpreter; only the slot array is the instance's
+            if (object->data.instance.slots) free(object->data.instance.slots);
             break;
             
-        case NODE_ASSIGN:
-            free_ast(node->data.assignment.target);
-            free_ast(node->data.assignment.value);
+        case VALUE_NATIVE_FUNCTION:
+            if (object->data.native_function.name) free(object->data.native_function.name);
             break;
             
-        case NODE_BINARY_OP:
-            free_ast(node->data.binary_op.left);
-            free_ast(node->data.binary_op.right);
+        case VALUE_SPRITE:
+            // Free sprite-specific data
+            if (object->data.sprite.sprite_data) free(object->data.sprite.sprite_data);
             break;
             
-        case NODE_UNARY_OP:
-            free_ast(node->data.unary_op.operand);
+        case VALUE_COMPONENT:
+            if (object->data.component.component_type) free(object->data.component.component_type);
+            if (object->data.component.component_data) free(object->data.component.component_data);
             break;
             
-        case NODE_CALL:
-            free_ast(node->data.call.callee);
-            for (int i = 0; i < node->data.call.arg_count; i++) {
-                free_ast(node->data.call.args[i]);
-            }
-            if (node->data.call.args) free(node->data.call.args);
+        default:
             break;
-            
-        case NODE_MEMBER_ACCESS:
-            free_ast(node->data.member_access.object);
-            if (node->data.member_access.member) free(node->data.member_access.member);
+    }
+}
+
+// Free heap object (referenced objects are managed by GC, don't free here)
+void free_object(Obj* object) {
+    if (!object) return;
+    
+    free_object_data(object);
+    free(object);
+}
+
+// Create scope
+Scope* create_scope(Scope* parent) {
+    Scope* scope = (Scope*)malloc(sizeof(Scope));
+    scope->capacity = 16;
+    scope->names = (char**)malloc(sizeof(char*) * scope->capacity);
+    scope->values = (Value*)malloc(sizeof(Value) * scope->capacity);
+    scope->count = 0;
+    scope->parent = parent;
+    return scope;
+}
+
+// Set up a call's scope inside its frame, with slot_count unnamed slots taken
+// from the locals stack (NULL when the locals stack is full)
+Scope* enter_frame_scope(Interpreter* interp, CallFrame* frame, int slot_count) {
+    if (interp->locals_top + slot_count > interp->locals + KT_STACK_MAX) return NULL;
+    
+    Scope* scope = &frame->locals;
+    scope->names = NULL;
+    scope->values = interp->locals_top;
+    scope->count = slot_count;
+    scope->capacity = slot_count;
+    scope->parent = NULL;
+    
+    for (int i = 0; i < slot_count; i++) {
+        scope->values[i] = UNDEFINED_VAL;
+    }
+    interp->locals_top += slot_count;
+    
+    frame->scope = scope;
+    return scope;
+}
+
+// Release a call's slots, first closing the upvalues that point into them:
+// each captured variable moves into its upvalue, where closures still see it
+void leave_frame_scope(Interpreter* interp, CallFrame* frame) {
+    Value* base = frame->locals.values;
+    
+    while (interp->open_upvalues && interp->open_upvalues->data.upvalue.location >= base) {
+        Obj* upvalue = interp->open_upvalues;
+        upvalue->data.upvalue.closed = *upvalue->data.upvalue.location;
+        upvalue->data.upvalue.location = &upvalue->data.upvalue.closed;
+        gc_write_barrier(interp, upvalue, upvalue->data.upvalue.closed);
+        interp->open_upvalues = upvalue->data.upvalue.next;
+    }
+    
+    interp->locals_top = base;
+}
+
+// Upvalue for a local slot of an active call, shared by every closure that
+// captures the same variable. Upvalues are allocated old: a closed one points
+// into itself, so it must never be moved by promotion.
+Obj* capture_upvalue(Interpreter* interp, Value* slot) {
+    Obj** link = &interp->open_upvalues;
+    while (*link && (*link)->data.upvalue.location > slot) {
+        link = &(*link)->data.upvalue.next;
+    }
+    if (*link && (*link)->data.upvalue.location == slot) return *link;
+    
+    Obj* upvalue = allocate_tenured(interp, VALUE_UPVALUE);
+    upvalue->data.upvalue.location = slot;
+    upvalue->data.upvalue.closed = NULL_VAL;
+    upvalue->data.upvalue.next = *link;
+    *link = upvalue;
+    return upvalue;
+}
+
+// Free scope
+void free_scope(Scope* scope) {
+    if (!scope) return;
+    
+    for (int i = 0; scope->names && i < scope->count; i++) {
+        if (scope->names[i]) free(scope->names[i]);
+        // Note: values are managed by GC, don't free here
+    }
+    
+    if (scope->names) free(scope->names);
+    if (scope->values) free(scope->values);
+    free(scope);
+}
+
+// Create bytecode chunk
+Chunk* create_chunk() {
+    Chunk* chunk = (Chunk*)malloc(sizeof(Chunk));
+    memset(chunk, 0, sizeof(Chunk));
+    return chunk;
+}
+
+// Free bytecode chunk (constants are managed by GC, don't free here)
+void free_chunk(Chunk* chunk) {
+    if (!chunk) return;
+    // Mapped code and lines belong to the interpreter's .ktc mapping
+    if (chunk->code && !chunk->mapped) free(chunk->code);
+    if (chunk->lines && !chunk->mapped) free(chunk->lines);
+    if (chunk->constants) free(chunk->constants);
+    if (chunk->caches) free(chunk->caches);
+    free(chunk);
+}
+
+// ============================================================================
+// GARBAGE COLLECTOR
+// Young objects are bump-allocated in a fixed nursery. A minor collection
+// copies the survivors into the malloc'd old generation, using gc_objects as
+// the scan queue, then resets the nursery. When the old generation has
+// doubled since the last full collection an incremental cycle starts.
+// ============================================================================
+
+static inline bool in_nursery(Interpreter* interp, Obj* object) {
+    return (uintptr_t)object - (uintptr_t)interp->nursery <
+        (uintptr_t)(sizeof(Obj) * KT_NURSERY_OBJECTS);
+}
+
+static void mark_object(Interpreter* interp, Obj* object);
+
+// Register object with the old generation
+void gc_register(Interpreter* interp, Obj* object) {
+    if (interp->gc_count >= interp->gc_capacity) {
+        interp->gc_capacity *= 2;
+        interp->gc_objects = (Obj**)realloc(
+            interp->gc_objects, sizeof(Obj*) * interp->gc_capacity);
+    }
+    interp->gc_objects[interp->gc_count++] = object;
+    
+    // Objects created during a cycle must not be freed by it
+    if (interp->gc_phase == GC_MARK) {
+        mark_object(interp, object);
+    } else if (interp->gc_phase == GC_SWEEP) {
+        object->is_marked = true;
+    }
+    
+    // Ask for a cycle, or for an unfinished one to be completed
+    int limit = interp->gc_phase == GC_IDLE ? interp->gc_next_major : interp->gc_next_major * 2;
+    if (interp->gc_count > limit) interp->gc_requested = true;
+}
+
+// Queue an old object for scanning at the next minor collection
+static void remember(Interpreter* interp, Obj* object) {
+    if (object->is_remembered) return;
+    
+    if (interp->remembered_count >= interp->remembered_capacity) {
+        interp->remembered_capacity = interp->remembered_capacity < 64 ? 64 : interp->remembered_capacity * 2;
+        interp->remembered = (Obj**)realloc(interp->remembered,
+            sizeof(Obj*) * interp->remembered_capacity);
+    }
+    
+    object->is_remembered = true;
+    interp->remembered[interp->remembered_count++] = object;
+}
+
+// Allocate an object directly in the old generation
+Obj* allocate_tenured(Interpreter* interp, ValueType type) {
+    Obj* object = create_object(type);
+    gc_register(interp, object);
+    return object;
+}
+
+// Record an object to be freed with the interpreter instead of by the GC
+static void add_permanent(Interpreter* interp, Obj* object) {
+    if (interp->permanent_count >= interp->permanent_capacity) {
+        interp->permanent_capacity = interp->permanent_capacity < 64 ? 64 : interp->permanent_capacity * 2;
+        interp->permanent = (Obj**)realloc(interp->permanent,
+            sizeof(Obj*) * interp->permanent_capacity);
+    }
+    
+    interp->permanent[interp->permanent_count++] = object;
+}
+
+// Allocate an object that lives as long as the interpreter. It is born black,
+// so marking never traces it: it may only refer to other permanent objects.
+Obj* allocate_permanent(Interpreter* interp, ValueType type) {
+    Obj* object = create_object(type);
+    object->is_marked = true;
+    object->is_permanent = true;
+    add_permanent(interp, object);
+    return object;
+}
+
+// Allocate a young object from the nursery
+Obj* allocate_object(Interpreter* interp, ValueType type) {
+    if (interp->nursery_used < KT_NURSERY_OBJECTS) {
+        Obj* object = &interp->nursery[interp->nursery_used++];
+        object->type = type;
+        object->is_marked = false;
+        object->is_remembered = false;
+        object->is_permanent = false;
+        memset(&object->data, 0, sizeof(object->data));
+        
+        if (interp->nursery_used == KT_NURSERY_OBJECTS) interp->gc_requested = true;
+        return object;
+    }
+    
+    // Nursery full before reaching a safepoint: allocate old, and remember the
+    // object since its caller is about to fill it with young references
+    Obj* object = allocate_tenured(interp, type);
+    remember(interp, object);
+    return object;
+}
+
+// ============================================================================
+// STRING INTERNING
+// Every string object is interned: there is one object per distinct content,
+// so string equality is pointer equality and each string carries its length
+// and hash. The set is weak. The sweep removes dead strings from it, and
+// deleted slots become tombstones until the next rehash. Interned strings
+// skip the nursery because the set refers to them by address.
+// ============================================================================
+
+static Obj string_tombstone;
+#define STRING_TOMBSTONE (&string_tombstone)
+
+// Rebuild the set with room for at least twice as many strings, dropping tombstones
+static void grow_strings(Interpreter* interp) {
+    int capacity = interp->string_capacity < 256 ? 256 : interp->string_capacity * 2;
+    Obj** strings = (Obj**)calloc(capacity, sizeof(Obj*));
+    int count = 0;
+    
+    for (int i = 0; i < interp->string_capacity; i++) {
+        Obj* string = interp->strings[i];
+        if (!string || string == STRING_TOMBSTONE) continue;
+        
+        uint32_t index = string->data.string.hash & (capacity - 1);
+        while (strings[index]) index = (index + 1) & (capacity - 1);
+        strings[index] = string;
+        count++;
+    }
+    
+    if (interp->strings) free(interp->strings);
+    interp->strings = strings;
+    interp->string_capacity = capacity;
+    interp->string_count = count;
+}
+
+// Find the string with this content, or return NULL with *slot set to where it belongs
+static Obj* find_string(Interpreter* interp, const char* chars, int length, uint32_t hash, uint32_t* slot) {
+    // Keep the set (tombstones included) at most half full
+    if ((interp->string_count + 1) * 2 > interp->string_capacity) grow_strings(interp);
+    
+    uint32_t mask = (uint32_t)interp->string_capacity - 1;
+    bool has_free = false;
+    
+    for (uint32_t index = hash & mask; ; index = (index + 1) & mask) {
+        Obj* string = interp->strings[index];
+        
+        if (!string) {
+            if (!has_free) *slot = index;
+            return NULL;
+        }
+        
+        if (string == STRING_TOMBSTONE) {
+            if (!has_free) *slot = index;
+            has_free = true;
+        } else if (string->data.string.hash == hash && string->data.string.length == length &&
+                   memcmp(string->data.string.chars, chars, length) == 0) {
+            return string;
+        }
+    }
+}
+
+// A string found in the set is about to gain a reference: keep the current
+// cycle from freeing it if marking has already passed it by. During the sweep
+// an unmarked string may be dead or may already be swept, so it is marked and
+// remembered, and the end of the sweep unmarks it again; otherwise one the
+// cursor had passed would start the next cycle marked.
+static Obj* revive_string(Interpreter* interp, Obj* string) {
+    if (interp->gc_phase == GC_MARK) {
+        mark_object(interp, string);
+    } else if (interp->gc_phase == GC_SWEEP && !string->is_marked) {
+        if (interp->revived_count >= interp->revived_capacity) {
+            interp->revived_capacity = interp->revived_capacity < 64 ? 64 : interp->revived_capacity * 2;
+            interp->revived = (Obj**)realloc(interp->revived,
+                sizeof(Obj*) * interp->revived_capacity);
+        }
+        string->is_marked = true;
+        interp->revived[interp->revived_count++] = string;
+    }
+    return string;
+}
+
+// Add a new string object owning chars to the set at slot
+static Obj* insert_string(Interpreter* interp, Obj* string, char* chars, int length, uint32_t hash, uint32_t slot) {
+    string->data.string.chars = chars;
+    string->data.string.length = length;
+    string->data.string.hash = hash;
+    
+    if (!interp->strings[slot]) interp->string_count++;
+    interp->strings[slot] = string;
+    return string;
+}
+
+// Return the string object for chars[0..length), copying them if it is new
+Obj* intern_string(Interpreter* interp, const char* chars, int length) {
+    uint32_t hash = hash_chars(chars, length);
+    uint32_t slot;
+    Obj* string = find_string(interp, chars, length, hash, &slot);
+    if (string) return revive_string(interp, string);
+    
+    char* copy = (char*)malloc(length + 1);
+    memcpy(copy, chars, length);
+    copy[length] = '\0';
+    return insert_string(interp, allocate_tenured(interp, VALUE_STRING), copy, length, hash, slot);
+}
+
+// Return the string object for a malloc'd buffer, taking ownership of it
+Obj* intern_owned_string(Interpreter* interp, char* chars, int length) {
+    uint32_t hash = hash_chars(chars, length);
+    uint32_t slot;
+    Obj* string = find_string(interp, chars, length, hash, &slot);
+    
+    if (string) {
+        free(chars);
+        return revive_string(interp, string);
+    }
+    return insert_string(interp, allocate_tenured(interp, VALUE_STRING), chars, length, hash, slot);
+}
+
+// Return the interned string for chars as a permanent constant. A string that
+// already exists is pinned in place, so it stays the one object for its content.
+Obj* constant_string(Interpreter* interp, const char* chars) {
+    int length = (int)strlen(chars);
+    uint32_t hash = hash_chars(chars, length);
+    uint32_t slot;
+    Obj* string = find_string(interp, chars, length, hash, &slot);
+    
+    if (!string) {
+        return insert_string(interp, allocate_permanent(interp, VALUE_STRING),
+            strdup(chars), length, hash, slot);
+    }
+    
+    if (!string->is_permanent) {
+        // The sweep drops it from gc_objects without freeing it
+        string->is_permanent = true;
+        string->is_marked = true;
+        add_permanent(interp, string);
+    }
+    return string;
+}
+
+// Remove a string the sweep is about to free from the set
+static void forget_string(Interpreter* interp, Obj* string) {
+    uint32_t mask = (uint32_t)interp->string_capacity - 1;
+    
+    for (uint32_t index = string->data.string.hash & mask; interp->strings[index]; index = (index + 1) & mask) {
+        if (interp->strings[index] == string) {
+            interp->strings[index] = STRING_TOMBSTONE;
+            return;
+        }
+    }
+}
+
+// Copy a nursery object into the old generation once, leaving a forwarding pointer
+static Obj* promote(Interpreter* interp, Obj* object) {
+    if (object->is_marked) return object->data.forwarding;
+    
+    Obj* copy = (Obj*)malloc(sizeof(Obj));
+    *copy = *object;
+    gc_register(interp, copy);
+    
+    object->is_marked = true;
+    object->data.forwarding = copy;
+    return copy;
+}
+
+static void evacuate_value(Interpreter* interp, Value* value) {
+    if (IS_OBJ(*value) && in_nursery(interp, AS_OBJ(*value))) {
+        value->data.obj = promote(interp, AS_OBJ(*value));
+    }
+}
+
+static void evacuate_values(Interpreter* interp, Value* values, int count) {
+    for (int i = 0; i < count; i++) {
+        evacuate_value(interp, &values[i]);
+    }
+}
+
+static void evacuate_scope(Interpreter* interp, Scope* scope) {
+    evacuate_values(interp, scope->values, scope->count);
+}
+
+// Evacuate the young objects an old object refers to
+static void evacuate_children(Interpreter* interp, Obj* object) {
+    switch (object->type) {
+        case VALUE_LIST:
+            evacuate_values(interp, object->data.list.elements, object->data.list.count);
             break;
             
-        case NODE_INDEX_ACCESS:
-            free_ast(node->data.index_access.object);
-            free_ast(node->data.index_access.index);
+        case VALUE_ROPE:
+            // The flattened string is interned, so it is never young
+            evacuate_value(interp, &object->data.rope.left);
+            evacuate_value(interp, &object->data.rope.right);
             break;
             
-        case NODE_LITERAL:
-            if (node->data.literal.literal_type == LITERAL_STRING && 
-                node->data.literal.literal_value.string) {
-                free(node->data.literal.literal_value.string);
+        case VALUE_MAP:
+            for (int i = 0; i < object->data.map.count; i++) {
+                MapEntry* entry = &object->data.map.entries[i];
+                if (entry->key && in_nursery(interp, entry->key)) {
+                    entry->key = promote(interp, entry->key);
+                }
+                evacuate_value(interp, &entry->value);
             }
             break;
             
-        case NODE_IDENTIFIER:
-            if (node->data.identifier.name) free(node->data.identifier.name);
-            break;
-            
-        case NODE_LIST:
-            for (int i = 0; i < node->data.list.element_count; i++) {
-                free_ast(node->data.list.elements[i]);
+        case VALUE_CLASS:
+            // Permanent prototypes have neither array
+            if (object->data.class_obj.methods) {
+                evacuate_values(interp, object->data.class_obj.methods,
+                    object->data.class_obj.vtable->count);
             }
-            if (node->data.list.elements) free(node->data.list.elements);
-            break;
-            
-        case NODE_MAP:
-            for (int i = 0; i < node->data.map.pair_count; i++) {
-                if (node->data.map.keys[i]) free(node->data.map.keys[i]);
-                free_ast(node->data.map.values[i]);
+            if (object->data.class_obj.defaults) {
+                evacuate_values(interp, object->data.class_obj.defaults,
+                    object->data.class_obj.shape->slot_count);
             }
-            if (node->data.map.keys) free(node->data.map.keys);
-            if (node->data.map.values) free(node->data.map.values);
             break;
             
-        case NODE_NEW_INSTANCE:
-            if (node->data.new_instance.class_name) free(node->data.new_instance.class_name);
-            for (int i = 0; i < node->data.new_instance.arg_count; i++) {
-                free_ast(node->data.new_instance.args[i]);
+        case VALUE_INSTANCE:
+            if (object->data.instance.class_ref && in_nursery(interp, object->data.instance.class_ref)) {
+                object->data.instance.class_ref = promote(interp, object->data.instance.class_ref);
             }
-            if (node->data.new_instance.args) free(node->data.new_instance.args);
+            evacuate_values(interp, object->data.instance.slots,
+                object->data.instance.shape->slot_count);
             break;
             
-        case NODE_RETURN:
-            free_ast(node->data.return_stmt.value);
+        case VALUE_UPVALUE:
+            // An open upvalue's slot is a root anyway; this catches closed ones
+            evacuate_value(interp, object->data.upvalue.location);
             break;
             
         default:
+            // Upvalues are never young, so function objects have nothing to move
             break;
     }
-    
-    free(node);
 }
 
-// Create value
-Value* create_value(ValueType type) {
-    Value* value = (Value*)malloc(sizeof(Value));
-    value->type = type;
-    value->is_marked = false;
+// Minor collection: promote everything reachable from the nursery's roots
+static void collect_nursery(Interpreter* interp) {
+    int scan = interp->gc_count;
     
-    // Initialize all pointers to NULL
-    memset(&value->data, 0, sizeof(value->data));
+    // Operand stack (also holds the tree walker's temporaries and call arguments)
+    evacuate_values(interp, interp->stack, (int)(interp->stack_top - interp->stack));
+    evacuate_value(interp, &interp->return_value);
+    
+    // Active calls, the walker's scope and globals
+    for (int i = 0; i < interp->frame_count; i++) {
+        CallFrame* frame = &interp->frames[i];
+        if (frame->function && in_nursery(interp, frame->function)) {
+            frame->function = promote(interp, frame->function);
+        }
+        evacuate_scope(interp, frame->scope);
+    }
+    evacuate_scope(interp, interp->current_scope);
+    evacuate_scope(interp, interp->global_scope);
+    
+    // Old objects that were given young references
+    for (int i = 0; i < interp->remembered_count; i++) {
+        interp->remembered[i]->is_remembered = false;
+        evacuate_children(interp, interp->remembered[i]);
+    }
+    interp->remembered_count = 0;
+    
+    // Scan promoted objects until no new ones appear
+    while (scan < interp->gc_count) {
+        evacuate_children(interp, interp->gc_objects[scan++]);
+    }
     
-    return value;
+    // Whatever was not promoted is garbage
+    for (int i = 0; i < interp->nursery_used; i++) {
+        if (!interp->nursery[i].is_marked) free_object_data(&interp->nursery[i]);
+    }
+    interp->nursery_used = 0;
 }
 
-// Free value recursively
-void free_value(Value* value) {
-    if (!value) return;
+// ============================================================================
+// INCREMENTAL OLD-GENERATION COLLECTION
+// Tri-color marking: white objects are unmarked, gray ones are marked and on
+// gray_stack, black ones are marked and scanned. Marking and sweeping run in
+// steps bounded by gc_step_budget_ms and gc_step_work; only the final remark
+// (a minor collection plus a rescan of the roots) is done in one go. Stores
+// into heap objects, closed upvalues included, shade the stored value while
+// marking; frame and global slots are roots and are rescanned instead.
+// ============================================================================
+
+static double now_ms() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1e6;
+}
+
+// Turn a white object gray (young objects are grayed when they are promoted)
+static void mark_object(Interpreter* interp, Obj* object) {
+    if (!object || object->is_marked || in_nursery(interp, object)) return;
     
-    switch (value->type) {
-        case VALUE_STRING:
-            if (value->data.string) free(value->data.string);
+    object->is_marked = true;
+    
+    if (interp->gray_count >= interp->gray_capacity) {
+        interp->gray_capacity = interp->gray_capacity < 256 ? 256 : interp->gray_capacity * 2;
+        interp->gray_stack = (Obj**)realloc(interp->gray_stack,
+            sizeof(Obj*) * interp->gray_capacity);
+    }
+    interp->gray_stack[interp->gray_count++] = object;
+}
+
+static void mark_value(Interpreter* interp, Value value) {
+    if (IS_OBJ(value)) mark_object(interp, AS_OBJ(value));
+}
+
+static void mark_values(Interpreter* interp, Value* values, int count) {
+    for (int i = 0; i < count; i++) {
+        mark_value(interp, values[i]);
+    }
+}
+
+static void mark_scope(Interpreter* interp, Scope* scope) {
+    mark_values(interp, scope->values, scope->count);
+}
+
+// Mark a map's keys and values (deleted entries have a NULL key and null value)
+static void mark_map(Interpreter* interp, Obj* map) {
+    for (int i = 0; i < map->data.map.count; i++) {
+        mark_object(interp, map->data.map.entries[i].key);
+        mark_value(interp, map->data.map.entries[i].value);
+    }
+}
+
+// Scan a gray object's references, turning it black
+static void blacken_object(Interpreter* interp, Obj* object) {
+    switch (object->type) {
+        case VALUE_LIST:
+            mark_values(interp, object->data.list.elements, object->data.list.count);
             break;
             
-        case VALUE_LIST:
-            for (int i = 0; i < value->data.list.count; i++) {
-                free_value(value->data.list.elements[i]);
-            }
-            if (value->data.list.elements) free(value->data.list.elements);
+        case VALUE_ROPE:
+            mark_value(interp, object->data.rope.left);
+            mark_value(interp, object->data.rope.right);
+            mark_object(interp, object->data.rope.flat);
             break;
             
         case VALUE_MAP:
-            for (int i = 0; i < value->data.map.count; i++) {
-                if (value->data.map.keys[i]) free(value->data.map.keys[i]);
-                free_value(value->data.map.values[i]);
-            }
-            if (value->data.map.keys) free(value->data.map.keys);
-            if (value->data.map.values) free(value->data.map.values);
+            mark_map(interp, object);
             break;
             
         case VALUE_FUNCTION:
-            if (value->data.function.name) free(value->data.function.name);
-            // Note: params are managed by AST, don't free here
-            break;
-            
-        case VALUE_CLASS:
-            if (value->data.class_obj.name) free(value->data.class_obj.name);
-            for (int i = 0; i < value->data.class_obj.method_count; i++) {
-                if (value->data.class_obj.method_names[i]) 
-                    free(value->data.class_obj.method_names[i]);
-                free_value(value->data.class_obj.methods[i]);
+            for (int i = 0; i < object->data.function.upvalue_count; i++) {
+                mark_object(interp, object->data.function.upvalues[i]);
             }
-            if (value->data.class_obj.methods) free(value->data.class_obj.methods);
-            if (value->data.class_obj.method_names) free(value->data.class_obj.method_names);
             break;
             
-        case VALUE_INSTANCE:
-            free_value(value->data.instance.fields);
+        case VALUE_UPVALUE:
+            mark_value(interp, *object->data.upvalue.location);
             break;
             
-        case VALUE_NATIVE_FUNCTION:
-            if (value->data.native_function.name) free(value->data.native_function.name);
-            break;
-            
-        case VALUE_SPRITE:
-            // Free sprite-specific data
-            if (value->data.sprite.sprite_data) free(value->data.sprite.sprite_data);
+        case VALUE_CLASS:
+            if (object->data.class_obj.methods) {
+                mark_values(interp, object->data.class_obj.methods,
+                    object->data.class_obj.vtable->count);
+            }
+            if (object->data.class_obj.defaults) {
+                mark_values(interp, object->data.class_obj.defaults,
+                    object->data.class_obj.shape->slot_count);
+            }
             break;
             
-        case VALUE_COMPONENT:
-            if (value->data.component.component_type) free(value->data.component.component_type);
-            if (value->data.component.component_data) free(value->data.component.component_data);
+        case VALUE_INSTANCE:
+            mark_object(interp, object->data.instance.class_ref);
+            mark_values(interp, object->data.instance.slots,
+                object->data.instance.shape->slot_count);
             break;
             
         default:
             break;
     }
-    
-    free(value);
 }
 
-// Free scope
-void free_scope(Scope* scope) {
-    if (!scope) return;
+// Gray everything directly reachable from the interpreter
+static void mark_roots(Interpreter* interp) {
+    mark_values(interp, interp->stack, (int)(interp->stack_top - interp->stack));
+    mark_value(interp, interp->return_value);
     
-    for (int i = 0; i < scope->count; i++) {
-        if (scope->names[i]) free(scope->names[i]);
-        // Note: values are managed by GC, don't free here
+    for (int i = 0; i < interp->frame_count; i++) {
+        mark_object(interp, interp->frames[i].function);
+        mark_scope(interp, interp->frames[i].scope);
     }
+    mark_scope(interp, interp->current_scope);
+    mark_scope(interp, interp->global_scope);
     
-    if (scope->names) free(scope->names);
-    if (scope->values) free(scope->values);
-    free(scope);
+    // Open upvalues are unlinked when their call returns, not when they die
+    for (Obj* upvalue = interp->open_upvalues; upvalue; upvalue = upvalue->data.upvalue.next) {
+        mark_object(interp, upvalue);
+    }
+    
+    // Chunk constants are permanent objects, so they are not roots
 }
 
-// Simple mark-and-sweep garbage collector
-void gc_mark(Value* value) {
-    if (!value || value->is_marked) return;
-    
-    value->is_marked = true;
+// Record a store of value into owner, for both the generational and incremental collectors
+void gc_write_barrier(Interpreter* interp, Obj* owner, Value value) {
+    if (!IS_OBJ(value)) return;
     
-    // Mark referenced values
-    switch (value->type) {
-        case VALUE_LIST:
-            for (int i = 0; i < value->data.list.count; i++) {
-                gc_mark(value->data.list.elements[i]);
-            }
-            break;
-            
-        case VALUE_MAP:
-            for (int i = 0; i < value->data.map.count; i++) {
-                gc_mark(value->data.map.values[i]);
-            }
-            break;
-            
-        case VALUE_INSTANCE:
-            gc_mark(value->data.instance.fields);
-            break;
-            
-        default:
-            break;
+    if (in_nursery(interp, AS_OBJ(value)) && !in_nursery(interp, owner)) {
+        remember(interp, owner);
+    }
+    if (interp->gc_phase == GC_MARK && owner->is_marked) {
+        mark_object(interp, AS_OBJ(value));
     }
 }
 
-void gc_mark_roots(Interpreter* interp) {
-    // Mark all values in scope chain
-    Scope* scope = interp->current_scope;
-    while (scope) {
-        for (int i = 0; i < scope->count; i++) {
-            gc_mark(scope->values[i]);
-        }
-        scope = scope->parent;
+// Begin a cycle by graying the roots
+static void start_cycle(Interpreter* interp) {
+    interp->gc_phase = GC_MARK;
+    interp->gray_count = 0;
+    mark_roots(interp);
+}
+
+// Trace gray objects until none are left or the budget runs out (true when done)
+static bool mark_step(Interpreter* interp, double deadline, int work) {
+    while (interp->gray_count > 0) {
+        if (work-- <= 0) return false;
+        if ((work & 63) == 0 && deadline > 0 && now_ms() >= deadline) return false;
+        
+        blacken_object(interp, interp->gray_stack[--interp->gray_count]);
     }
+    return true;
 }
 
-void gc_sweep(Interpreter* interp) {
-    int alive = 0;
+// Atomic end of marking: empty the nursery, then rescan roots the mutator
+// changed without barriers (stack, frame and global scopes)
+static void finish_marking(Interpreter* interp) {
+    collect_nursery(interp);
+    mark_roots(interp);
+    mark_step(interp, 0, INT_MAX);
     
-    for (int i = 0; i < interp->gc_count; i++) {
-        Value* value = interp->gc_objects[i];
+    interp->gc_phase = GC_SWEEP;
+    interp->sweep_cursor = 0;
+    interp->sweep_alive = 0;
+}
+
+// Free unmarked old objects until the sweep ends or the budget runs out (true when done)
+static bool sweep_step(Interpreter* interp, double deadline, int work) {
+    while (interp->sweep_cursor < interp->gc_count) {
+        if (work-- <= 0) return false;
+        if ((work & 63) == 0 && deadline > 0 && now_ms() >= deadline) return false;
+        
+        Obj* object = interp->gc_objects[interp->sweep_cursor++];
         
-        if (value->is_marked) {
-            value->is_marked = false; // Reset for next GC
-            interp->gc_objects[alive++] = value;
+        if (object->is_permanent) {
+            // Pinned as a constant since it was registered: no longer the GC's
+            continue;
+        } else if (object->is_marked) {
+            object->is_marked = false; // Reset for next GC
+            interp->gc_objects[interp->sweep_alive++] = object;
         } else {
-            free_value(value);
+            if (object->type == VALUE_STRING) forget_string(interp, object);
+            free_object(object);
         }
     }
     
-    interp->gc_count = alive;
+    // Strings pinned as constants since they were revived stay black
+    for (int i = 0; i < interp->revived_count; i++) {
+        if (!interp->revived[i]->is_permanent) interp->revived[i]->is_marked = false;
+    }
+    interp->revived_count = 0;
+    
+    interp->gc_count = interp->sweep_alive;
+    interp->gc_phase = GC_IDLE;
+    interp->gc_next_major = interp->gc_count * 2 > KT_GC_MIN_MAJOR
+        ? interp->gc_count * 2 : KT_GC_MIN_MAJOR;
+    return true;
+}
+
+// Advance the current cycle by at most budget_ms and gc_step_work objects.
+// Call only at a safepoint or from the host between runs.
+void gc_step(Interpreter* interp, double budget_ms) {
+    double deadline = now_ms() + budget_ms;
+    
+    if (interp->gc_phase == GC_MARK) {
+        if (!mark_step(interp, deadline, interp->gc_step_work)) return;
+        finish_marking(interp);
+    }
+    
+    if (interp->gc_phase == GC_SWEEP) {
+        sweep_step(interp, deadline, interp->gc_step_work);
+    }
+}
+
+// Let the GC use idle_ms of host idle time (e.g. what is left of a frame)
+void gc_idle(Interpreter* interp, double idle_ms) {
+    double deadline = now_ms() + idle_ms;
+    
+    if (interp->gc_requested) gc_collect(interp);
+    
+    // Get ahead of the allocation trigger when there is time to spare
+    if (interp->gc_phase == GC_IDLE && interp->gc_count > interp->gc_next_major / 2) {
+        start_cycle(interp);
+    }
+    
+    while (interp->gc_phase != GC_IDLE) {
+        double remaining = deadline - now_ms();
+        if (remaining <= 0) break;
+        gc_step(interp, remaining);
+    }
 }
 
+// Minor collection, then a slice of old-generation work when a cycle is due or running
 void gc_collect(Interpreter* interp) {
-    gc_mark_roots(interp);
-    gc_sweep(interp);
+    interp->gc_requested = false;
+    collect_nursery(interp);
+    
+    if (interp->gc_phase == GC_IDLE && interp->gc_count > interp->gc_next_major) {
+        start_cycle(interp);
+    }
+    
+    if (interp->gc_phase != GC_IDLE) {
+        // Allocation is outrunning the steps: finish the cycle now
+        if (interp->gc_count > interp->gc_next_major * 2) {
+            gc_collect_full(interp);
+            return;
+        }
+        gc_step(interp, interp->gc_step_budget_ms);
+    }
+}
+
+// Collect both generations now, finishing any cycle in progress
+void gc_collect_full(Interpreter* interp) {
+    interp->gc_requested = false;
+    
+    if (interp->gc_phase == GC_IDLE) start_cycle(interp);
+    if (interp->gc_phase == GC_MARK) finish_marking(interp);
+    sweep_step(interp, 0, INT_MAX);
+    
+    // Objects promoted during the sweep are only collected by the next cycle
+    collect_nursery(interp);
 }
 
 // Free interpreter
 void interpreter_free(Interpreter* interp) {
     if (!interp) return;
     
-    // Free all GC objects
+    // Free all GC objects: the old generation, then live nursery entries.
+    // Mid-sweep, the slots between the survivors and the cursor are stale.
     for (int i = 0; i < interp->gc_count; i++) {
-        free_value(interp->gc_objects[i]);
+        if (interp->gc_phase == GC_SWEEP && i >= interp->sweep_alive && i < interp->sweep_cursor) {
+            continue;
+        }
+        // Strings pinned as constants since the last sweep are freed below
+        if (!interp->gc_objects[i]->is_permanent) free_object(interp->gc_objects[i]);
+    }
+    for (int i = 0; i < interp->nursery_used; i++) {
+        if (!interp->nursery[i].is_marked) free_object_data(&interp->nursery[i]);
+    }
+    
+    for (int i = 0; i < interp->permanent_count; i++) {
+        free_object(interp->permanent[i]);
     }
     
     if (interp->gc_objects) free(interp->gc_objects);
+    if (interp->permanent) free(interp->permanent);
+    if (interp->strings) free(interp->strings);
+    if (interp->global_index) free_object(interp->global_index);
+    shape_free(interp->root_shape);
+    
+    while (interp->vtables) {
+        VTable* next = interp->vtables->next;
+        free(interp->vtables->names);
+        free(interp->vtables);
+        interp->vtables = next;
+    }
+    if (interp->gray_stack) free(interp->gray_stack);
+    if (interp->revived) free(interp->revived);
+    if (interp->nursery) free(interp->nursery);
+    if (interp->remembered) free(interp->remembered);
+    
+    for (int i = 0; i < interp->chunk_count; i++) {
+        free_chunk(interp->chunks[i]);
+    }
+    if (interp->chunks) free(interp->chunks);
+    ktc_release(interp);
+    module_free_all(interp);
+    if (interp->stack) free(interp->stack);
+    if (interp->locals) free(interp->locals);
+    if (interp->frames) free(interp->frames);
+    
     free_scope(interp->global_scope);
     free(interp);
 }
\ No newline at end of file
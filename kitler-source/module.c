@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "types.h"
+// Module loader for Kitler 'including' directives
+// 'including System.IO' names either a native module built into the
+// interpreter or a script module, System/IO.kt next to the main script. The
+// resolver includes a module when it reaches the directive: a native module
+// reserves the globals it exports, and a script module is parsed, resolved
+// and compiled once per interpreter, which reserves the globals its top
+// level declares. Nothing runs yet. The first read of one of those globals
+// (an undefined global slot, so the fast path pays nothing) initialises the
+// module: the native init function defines its natives, or the script's top
+// level runs. Priority includes ('including X#') are parsed on a background
+// thread while the main file is still being parsed. Compiled script modules
+// are also saved in the including program's .ktc cache (see cache.c).
+
+// External function declarations
+extern Token* lexer_tokenize(const char* source, int* token_count);
+extern Parser* parser_init(const char* source, Token* tokens, int token_count);
+extern ASTNode* parser_parse(Parser* parser);
+
+// ============================================================================
+// FILES
+// ============================================================================
+
+// Copy of the first length characters of chars
+static char* copy_chars(const char* chars, size_t length) {
+    char* copy = (char*)malloc(length + 1);
+    memcpy(copy, chars, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Whole file as a NUL-terminated string, or NULL if it cannot be read
+static char* read_source(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    char* source = (char*)malloc(size > 0 ? size + 1 : 1);
+    *length = size > 0 ? fread(source, 1, size, file) : 0;
+    source[*length] = '\0';
+    fclose(file);
+    return source;
+}
+
+// ============================================================================
+// NATIVE MODULES
+// ============================================================================
+
+// Text of a string or rope argument, or NULL for anything else
+static const char* text_arg(Interpreter* interp, Value value) {
+    if (value.type == VALUE_STRING) return AS_STRING(value);
+    if (value.type == VALUE_ROPE) return string_flatten(interp, AS_OBJ(value))->data.string.chars;
+    return NULL;
+}
+
+// File.Read(path): the whole file as a string, or null
+static Value file_read(Interpreter* interp, Value* args, int arg_count) {
+    const char* path = arg_count >= 1 ? text_arg(interp, args[0]) : NULL;
+    size_t length = 0;
+    char* chars = path ? read_source(path, &length) : NULL;
+    return chars ? new_string(interp, chars) : NULL_VAL;
+}
+
+// Write or append text to a file; true on success
+static Value file_output(Interpreter* interp, Value* args, int arg_count, const char* mode) {
+    const char* path = arg_count >= 1 ? text_arg(interp, args[0]) : NULL;
+    const char* text = arg_count >= 2 ? text_arg(interp, args[1]) : NULL;
+    if (!path || !text) return BOOL_VAL(false);
+    
+    FILE* file = fopen(path, mode);
+    if (!file) return BOOL_VAL(false);
+    
+    size_t length = strlen(text);
+    bool ok = fwrite(text, 1, length, file) == length;
+    if (fclose(file) != 0) ok = false;
+    return BOOL_VAL(ok);
+}
+
+static Value file_write(Interpreter* interp, Value* args, int arg_count) {
+    return file_output(interp, args, arg_count, "wb");
+}
+
+static Value file_append(Interpreter* interp, Value* args, int arg_count) {
+    return file_output(interp, args, arg_count, "ab");
+}
+
+static Value file_exists(Interpreter* interp, Value* args, int arg_count) {
+    const char* path = arg_count >= 1 ? text_arg(interp, args[0]) : NULL;
+    FILE* file = path ? fopen(path, "rb") : NULL;
+    if (file) fclose(file);
+    return BOOL_VAL(file != NULL);
+}
+
+static void init_io(Interpreter* interp) {
+    define_native(interp, "File.Read", file_read);
+    define_native(interp, "File.Write", file_write);
+    define_native(interp, "File.Append", file_append);
+    define_native(interp, "File.Exists", file_exists);
+}
+
+// First argument as a double (0 when missing or not a number)
+static double number_arg(Value* args, int arg_count, int index) {
+    if (index >= arg_count || !IS_NUMBER(args[index])) return 0;
+    return AS_NUMBER(args[index]);
+}
+
+// A whole result as an integer when it fits, else a double
+static Value whole_number(double value) {
+    if (value >= -9.2e18 && value <= 9.2e18) return INT_VAL((int64_t)value);
+    return NUMBER_VAL(value);
+}
+
+static Value math_sqrt(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    return NUMBER_VAL(sqrt(number_arg(args, arg_count, 0)));
+}
+
+static Value math_abs(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    if (arg_count >= 1 && IS_INT(args[0]) && AS_INT(args[0]) != INT64_MIN) {
+        return INT_VAL(AS_INT(args[0]) < 0 ? -AS_INT(args[0]) : AS_INT(args[0]));
+    }
+    return NUMBER_VAL(fabs(number_arg(args, arg_count, 0)));
+}
+
+static Value math_floor(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    if (arg_count >= 1 && IS_INT(args[0])) return args[0];
+    return whole_number(floor(number_arg(args, arg_count, 0)));
+}
+
+static Value math_ceil(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    if (arg_count >= 1 && IS_INT(args[0])) return args[0];
+    return whole_number(ceil(number_arg(args, arg_count, 0)));
+}
+
+static Value math_sin(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    return NUMBER_VAL(sin(number_arg(args, arg_count, 0)));
+}
+
+static Value math_cos(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    return NUMBER_VAL(cos(number_arg(args, arg_count, 0)));
+}
+
+static Value math_pow(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    return NUMBER_VAL(pow(number_arg(args, arg_count, 0), number_arg(args, arg_count, 1)));
+}
+
+static void init_math(Interpreter* interp) {
+    define_native(interp, "Math.Sqrt", math_sqrt);
+    define_native(interp, "Math.Abs", math_abs);
+    define_native(interp, "Math.Floor", math_floor);
+    define_native(interp, "Math.Ceil", math_ceil);
+    define_native(interp, "Math.Sin", math_sin);
+    define_native(interp, "Math.Cos", math_cos);
+    define_native(interp, "Math.Pow", math_pow);
+    interp->global_scope->values[global_slot(interp, "Math.PI")] = NUMBER_VAL(3.14159265358979323846);
+}
+
+// A library built into the interpreter: the globals it defines, and the
+// function that defines them on first use
+struct NativeModule {
+    const char* name;
+    const char* exports[12];    // NULL-terminated
+    void (*init)(Interpreter* interp);
+};
+
+// The .NET bridge libraries have nothing to load in the interpreter itself;
+// including them is accepted so that bridge projects run unchanged
+static const NativeModule native_modules[] = {
+    { "System.IO", { "File.Read", "File.Write", "File.Append", "File.Exists", NULL }, init_io },
+    { "System.Math", { "Math.Sqrt", "Math.Abs", "Math.Floor", "Math.Ceil", "Math.Sin",
+                       "Math.Cos", "Math.Pow", "Math.PI", NULL }, init_math },
+    { "System.Interface", { NULL }, NULL },
+    { "System.Audio", { NULL }, NULL },
+    { "System.Physics", { NULL }, NULL },
+    { "Windows.NET6", { NULL }, NULL },
+    { "Windows.NET7", { NULL }, NULL },
+    { "Windows.NET8", { NULL }, NULL },
+    { "Windows.NET9", { NULL }, NULL },
+};
+
+static const NativeModule* find_native(const char* name) {
+    for (size_t i = 0; i < sizeof(native_modules) / sizeof(native_modules[0]); i++) {
+        if (strcmp(native_modules[i].name, name) == 0) return &native_modules[i];
+    }
+    return NULL;
+}
+
+// ============================================================================
+// SCRIPT MODULES
+// ============================================================================
+
+// Directory that script modules are looked up in: the main script's own
+void module_set_dir(Interpreter* interp, const char* script_path) {
+    free(interp->module_dir);
+    interp->module_dir = NULL;
+    if (!script_path) return;
+    
+    const char* slash = strrchr(script_path, '/');
+    const char* backslash = strrchr(script_path, '\\');
+    if (backslash > slash) slash = backslash;
+    if (slash) interp->module_dir = copy_chars(script_path, slash - script_path);
+}
+
+// Source file of a script module: System.IO is <module_dir>/System/IO.kt.
+// NULL if there is no memory for it.
+static char* module_path(Interpreter* interp, const char* name) {
+    const char* dir = interp->module_dir ? interp->module_dir : ".";
+    int length = snprintf(NULL, 0, "%s/%s.kt", dir, name);
+    char* path = length < 0 ? NULL : (char*)malloc((size_t)length + 1);
+    if (!path) return NULL;
+    snprintf(path, (size_t)length + 1, "%s/%s.kt", dir, name);
+    
+    for (char* c = path + strlen(dir) + 1; *c && strcmp(c, ".kt") != 0; c++) {
+        if (*c == '.') *c = '/';
+    }
+    return path;
+}
+
+// Read, tokenize and parse a script module. Touches nothing but the module,
+// so it runs on a preload thread as well.
+static void parse_module(Module* module) {
+    module->source = read_source(module->path, &module->source_length);
+    if (!module->source) return;
+    
+    module->tokens = lexer_tokenize(module->source, &module->token_count);
+    Parser* parser = parser_init(module->source, module->tokens, module->token_count);
+    module->ast = parser_parse(parser);
+    module->parse_failed = parser->had_error;
+    free(parser);
+}
+
+static void* preload_thread(void* argument) {
+    parse_module((Module*)argument);
+    return NULL;
+}
+
+// Wait for a background parse of module to finish
+static void join_preload(Module* module) {
+    if (!module->thread) return;
+    pthread_join(*(pthread_t*)module->thread, NULL);
+    free(module->thread);
+    module->thread = NULL;
+}
+
+// ============================================================================
+// MODULE TABLE
+// ============================================================================
+
+static Module* find_module(Interpreter* interp, const char* name) {
+    for (Module* module = interp->modules; module; module = module->next) {
+        if (strcmp(module->name, name) == 0) return module;
+    }
+    return NULL;
+}
+
+// Add a module entry, native if the interpreter has one by that name
+static Module* new_module(Interpreter* interp, const char* name) {
+    Module* module = (Module*)calloc(1, sizeof(Module));
+    module->name = strdup(name);
+    module->native = find_native(name);
+    if (!module->native) module->path = module_path(interp, name);
+    module->state = MODULE_LOADING;
+    
+    // Kept in include order, which is also the order the cache stores them in
+    Module** tail = &interp->modules;
+    while (*tail) tail = &(*tail)->next;
+    *tail = module;
+    return module;
+}
+
+static void add_slot(Module* module, int slot) {
+    module->slots = (int*)realloc(module->slots, sizeof(int) * (module->slot_count + 1));
+    module->slots[module->slot_count++] = slot;
+}
+
+// Start parsing the script modules of priority includes on background threads,
+// so they are ready by the time the resolver reaches their directives
+void module_preload(Interpreter* interp, const char* source, Token* tokens, int token_count) {
+    for (int i = 0; i + 2 < token_count; i++) {
+        if (tokens[i].type != TOKEN_INCLUDING || tokens[i + 1].type != TOKEN_IDENTIFIER ||
+            tokens[i + 2].type != TOKEN_HASH) {
+            continue;
+        }
+        
+        char* name = copy_chars(source + tokens[i + 1].start, tokens[i + 1].length);
+        if (!find_module(interp, name)) {
+            Module* module = new_module(interp, name);
+            
+            if (module->path) {
+                module->thread = malloc(sizeof(pthread_t));
+                if (pthread_create((pthread_t*)module->thread, NULL, preload_thread, module) != 0) {
+                    // No thread: the module is parsed when it is included
+                    free(module->thread);
+                    module->thread = NULL;
+                }
+            }
+        }
+        free(name);
+    }
+}
+
+// Include a module for a directive being resolved. Its globals get their
+// slots now, but it is only initialised when one of them is first read.
+void module_include(Interpreter* interp, const char* name, int line) {
+    Module* module = find_module(interp, name);
+    if (!module) module = new_module(interp, name);
+    if (module->state != MODULE_LOADING) return;
+    
+    if (module->native) {
+        for (int i = 0; module->native->exports[i]; i++) {
+            add_slot(module, global_slot(interp, module->native->exports[i]));
+        }
+        module->state = MODULE_PENDING;
+        return;
+    }
+    
+    if (!module->path) {
+        fprintf(stderr, "Error at line %d: out of memory including module %s\n", line, name);
+        module->state = MODULE_FAILED;
+        return;
+    }
+    
+    if (module->thread) {
+        join_preload(module);
+    } else {
+        parse_module(module);
+    }
+    
+    if (!module->source || module->parse_failed) {
+        fprintf(stderr, "Error at line %d: %s module %s (%s)\n", line,
+            module->source ? "could not parse" : "no such", name, module->path);
+        module->state = MODULE_FAILED;
+        return;
+    }
+    
+    // Resolving may include further modules; a cycle stops here
+    module->state = MODULE_RESOLVING;
+    module->source_hash = ktc_hash(module->source, module->source_length);
+    resolve_program(interp, module->ast);
+    
+    ASTNode* program = module->ast;
+    for (int i = 0; i < program->data.block.statement_count; i++) {
+        ASTNode* statement = program->data.block.statements[i];
+        if (statement->type == NODE_VARDECL) add_slot(module, statement->data.var_decl.slot);
+        if (statement->type == NODE_FUNCDECL) add_slot(module, statement->data.func_decl.slot);
+        if (statement->type == NODE_CLASSDECL) add_slot(module, statement->data.class_decl.slot);
+    }
+    
+    // A module that does not compile fails like one that does not parse
+    if (!interp->use_tree_walker) {
+        module->script = compile_program(interp, module->ast);
+        if (!module->script) {
+            fprintf(stderr, "Error at line %d: could not compile module %s (%s)\n", line,
+                name, module->path);
+            module->state = MODULE_FAILED;
+            return;
+        }
+    }
+    module->state = MODULE_PENDING;
+}
+
+// Initialise the module that defines global slot, if one is still waiting.
+// Returns true when a module ran, after which the slot should be read again.
+bool module_touch(Interpreter* interp, int slot) {
+    for (Module* module = interp->modules; module; module = module->next) {
+        if (module->state != MODULE_PENDING) continue;
+        
+        for (int i = 0; i < module->slot_count; i++) {
+            if (module->slots[i] != slot) continue;
+            
+            // Ready before it runs, so its own top level does not start it again
+            module->state = MODULE_READY;
+            if (module->native) {
+                if (module->native->init) module->native->init(interp);
+            } else if (module->script) {
+                vm_run_nested(interp, module->script);
+            } else {
+                interpreter_eval_module(interp, module->ast);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Recreate a module from a .ktc cache or a heap snapshot. It must still
+// exist and, when check_source is set, a script module must still have the
+// source the cache was compiled from. A module restored ready has already
+// run; only a native one runs its init again, to recreate its natives.
+bool module_restore(Interpreter* interp, const char* name, const char* path,
+                    uint64_t source_hash, size_t source_length, Obj* script,
+                    const int* slots, int slot_count, ModuleState state, bool check_source) {
+    if (find_module(interp, name)) return false;
+    if (state != MODULE_PENDING && state != MODULE_READY) return false;
+    
+    Module* module = new_module(interp, name);
+    if ((path != NULL) == (module->native != NULL)) return false;
+    
+    if (path) {
+        if (!script) return false;
+        if (check_source) {
+            size_t length = 0;
+            char* source = read_source(path, &length);
+            bool same = source && length == source_length && ktc_hash(source, length) == source_hash;
+            free(source);
+            if (!same) return false;
+        }
+        
+        free(module->path);
+        module->path = strdup(path);
+        module->source_hash = source_hash;
+        module->source_length = source_length;
+        module->script = script;
+    }
+    
+    for (int i = 0; i < slot_count; i++) add_slot(module, slots[i]);
+    module->state = state;
+    if (state == MODULE_READY && module->native && module->native->init) {
+        module->native->init(interp);
+    }
+    return true;
+}
+
+// Free every module, waiting for preload threads that are still parsing
+void module_free_all(Interpreter* interp) {
+    while (interp->modules) {
+        Module* module = interp->modules;
+        interp->modules = module->next;
+        
+        join_preload(module);
+        if (module->ast) free_ast(module->ast);
+        free(module->tokens);
+        free(module->source);
+        free(module->slots);
+        free(module->path);
+        free(module->name);
+        free(module);
+    }
+    free(interp->module_dir);
+    interp->module_dir = NULL;
+}
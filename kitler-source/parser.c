@@ -8,11 +8,14 @@
 static ASTNode* parse_statement(Parser* parser);
 static ASTNode* parse_expression(Parser* parser);
 static ASTNode* parse_primary(Parser* parser);
+static ASTNode* parse_postfix(Parser* parser);
 
-// Initialize parser
-Parser* parser_init(Token** tokens, int token_count) {
+// Initialize parser over the token array produced from source
+Parser* parser_init(const char* source, Token* tokens, int token_count) {
     Parser* parser = (Parser*)malloc(sizeof(Parser));
-    parser->tokens = *tokens;
+    parser->source = source;
+    parser->arena = NULL;
+    parser->tokens = tokens;
     parser->token_count = token_count;
     parser->current = 0;
     parser->had_error = false;
@@ -39,6 +42,26 @@ static Token* advance(Parser* parser) {
     return &parser->tokens[parser->current - 1];
 }
 
+// Intern a token's source slice in the program arena
+static char* copy_lexeme(Parser* parser, Token* token) {
+    return arena_intern(parser->arena, parser->source + token->start, token->length);
+}
+
+// Create a node in the program arena
+static ASTNode* new_node(Parser* parser, NodeType type, int line, int column) {
+    return create_node(parser->arena, type, line, column);
+}
+
+// Append a node to an arena-backed child array, doubling it when full
+static void append_node(Parser* parser, ASTNode*** items, int* count, int* capacity, ASTNode* node) {
+    if (*count >= *capacity) {
+        *items = (ASTNode**)arena_grow(parser->arena, *items,
+            sizeof(ASTNode*) * *capacity, sizeof(ASTNode*) * *capacity * 2);
+        *capacity *= 2;
+    }
+    (*items)[(*count)++] = node;
+}
+
 // Match token type and advance
 static bool match(Parser* parser, TokenType type) {
     if (check(parser, type)) {
@@ -73,8 +96,8 @@ static ASTNode* parse_including(Parser* parser) {
         is_priority = true;
     }
     
-    ASTNode* node = create_node(NODE_INCLUDING, including_token->line, including_token->column);
-    node->data.including.library = strdup(lib_name->lexeme);
+    ASTNode* node = new_node(parser, NODE_INCLUDING, including_token->line, including_token->column);
+    node->data.including.library = copy_lexeme(parser, lib_name);
     node->data.including.is_priority = is_priority;
     
     return node;
@@ -82,22 +105,22 @@ static ASTNode* parse_including(Parser* parser) {
 
 // Parse block of statements
 static ASTNode* parse_block(Parser* parser) {
-    ASTNode* block = create_node(NODE_BLOCK, peek(parser)->line, peek(parser)->column);
+    ASTNode* block = new_node(parser, NODE_BLOCK, peek(parser)->line, peek(parser)->column);
     
-    int capacity = 16;
-    block->data.block.statements = (ASTNode**)malloc(sizeof(ASTNode*) * capacity);
+    int capacity = 8;
+    block->data.block.statements = (ASTNode**)arena_alloc(parser->arena, sizeof(ASTNode*) * capacity);
     block->data.block.statement_count = 0;
     
-    while (!check(parser, TOKEN_END) && !check(parser, TOKEN_EOF)) {
+    // Blocks close with 'end', 'else:' or the ')' of a function body
+    while (!check(parser, TOKEN_END) && !check(parser, TOKEN_ELSE) &&
+           !check(parser, TOKEN_RPAREN) && !check(parser, TOKEN_EOF)) {
         ASTNode* stmt = parse_statement(parser);
         if (stmt) {
-            if (block->data.block.statement_count >= capacity) {
-                capacity *= 2;
-                block->data.block.statements = (ASTNode**)realloc(
-                    block->data.block.statements, sizeof(ASTNode*) * capacity);
-            }
-            block->data.block.statements[block->data.block.statement_count++] = stmt;
+            append_node(parser, &block->data.block.statements,
+                &block->data.block.statement_count, &capacity, stmt);
         }
+        
+        if (parser->had_error) break;
     }
     
     return block;
@@ -110,8 +133,8 @@ static ASTNode* parse_var_decl(Parser* parser) {
     
     if (!name) return NULL;
     
-    ASTNode* node = create_node(NODE_VARDECL, newvar_token->line, newvar_token->column);
-    node->data.var_decl.name = strdup(name->lexeme);
+    ASTNode* node = new_node(parser, NODE_VARDECL, newvar_token->line, newvar_token->column);
+    node->data.var_decl.name = copy_lexeme(parser, name);
     node->data.var_decl.initializer = NULL;
     
     if (match(parser, TOKEN_ASSIGN)) {
@@ -126,7 +149,7 @@ static void parse_params(Parser* parser, char*** params, int* param_count) {
     expect(parser, TOKEN_LPAREN, "Expected '(' after function name");
     
     int capacity = 8;
-    *params = (char**)malloc(sizeof(char*) * capacity);
+    *params = (char**)arena_alloc(parser->arena, sizeof(char*) * capacity);
     *param_count = 0;
     
     if (!check(parser, TOKEN_RPAREN)) {
@@ -134,10 +157,11 @@ static void parse_params(Parser* parser, char*** params, int* param_count) {
             Token* param = expect(parser, TOKEN_IDENTIFIER, "Expected parameter name");
             if (param) {
                 if (*param_count >= capacity) {
+                    *params = (char**)arena_grow(parser->arena, *params,
+                        sizeof(char*) * capacity, sizeof(char*) * capacity * 2);
                     capacity *= 2;
-                    *params = (char**)realloc(*params, sizeof(char*) * capacity);
                 }
-                (*params)[(*param_count)++] = strdup(param->lexeme);
+                (*params)[(*param_count)++] = copy_lexeme(parser, param);
             }
         } while (match(parser, TOKEN_COMMA));
     }
@@ -153,8 +177,8 @@ static ASTNode* parse_func_decl(Parser* parser) {
     Token* name = expect(parser, TOKEN_IDENTIFIER, "Expected function name");
     if (!name) return NULL;
     
-    ASTNode* node = create_node(NODE_FUNCDECL, func_token->line, func_token->column);
-    node->data.func_decl.name = strdup(name->lexeme);
+    ASTNode* node = new_node(parser, NODE_FUNCDECL, func_token->line, func_token->column);
+    node->data.func_decl.name = copy_lexeme(parser, name);
     node->data.func_decl.is_async = is_async;
     
     parse_params(parser, &node->data.func_decl.params, &node->data.func_decl.param_count);
@@ -166,11 +190,68 @@ static ASTNode* parse_func_decl(Parser* parser) {
     return node;
 }
 
+// Parse a method: a function whose hidden first parameter is 'this'
+static ASTNode* parse_method(Parser* parser) {
+    ASTNode* method = parse_func_decl(parser);
+    if (!method) return NULL;
+    
+    int count = method->data.func_decl.param_count;
+    char** params = (char**)arena_alloc(parser->arena, sizeof(char*) * (count + 1));
+    params[0] = arena_intern(parser->arena, "this", 4);
+    for (int i = 0; i < count; i++) {
+        params[i + 1] = method->data.func_decl.params[i];
+    }
+    
+    method->data.func_decl.params = params;
+    method->data.func_decl.param_count = count + 1;
+    return method;
+}
+
+// Parse class declaration: NewClass Name [ NewVar field = value ... NewFunc method() (...) ]
+static ASTNode* parse_class_decl(Parser* parser) {
+    Token* class_token = advance(parser); // NewClass
+    
+    Token* name = expect(parser, TOKEN_IDENTIFIER, "Expected class name");
+    if (!name) return NULL;
+    
+    ASTNode* node = new_node(parser, NODE_CLASSDECL, class_token->line, class_token->column);
+    node->data.class_decl.name = copy_lexeme(parser, name);
+    
+    int capacity = 8;
+    node->data.class_decl.members = (ASTNode**)arena_alloc(parser->arena, sizeof(ASTNode*) * capacity);
+    node->data.class_decl.member_count = 0;
+    
+    expect(parser, TOKEN_LBRACKET, "Expected '[' after class name");
+    
+    while (!check(parser, TOKEN_RBRACKET) && !check(parser, TOKEN_EOF)) {
+        ASTNode* member = NULL;
+        
+        if (check(parser, TOKEN_NEWVAR)) {
+            member = parse_var_decl(parser);
+        } else if (check(parser, TOKEN_NEWFUNC)) {
+            member = parse_method(parser);
+        } else {
+            expect(parser, TOKEN_NEWVAR, "Expected field or method declaration in class body");
+            break;
+        }
+        
+        if (member) {
+            append_node(parser, &node->data.class_decl.members,
+                &node->data.class_decl.member_count, &capacity, member);
+        }
+        
+        if (parser->had_error) break;
+    }
+    
+    expect(parser, TOKEN_RBRACKET, "Expected ']' after class body");
+    return node;
+}
+
 // Parse if statement
 static ASTNode* parse_if(Parser* parser) {
     Token* if_token = advance(parser); // if
     
-    ASTNode* node = create_node(NODE_IF, if_token->line, if_token->column);
+    ASTNode* node = new_node(parser, NODE_IF, if_token->line, if_token->column);
     node->data.if_stmt.condition = parse_expression(parser);
     
     expect(parser, TOKEN_RUN, "Expected 'run:' after if condition");
@@ -193,7 +274,7 @@ static ASTNode* parse_if(Parser* parser) {
 static ASTNode* parse_while(Parser* parser) {
     Token* while_token = advance(parser); // while
     
-    ASTNode* node = create_node(NODE_WHILE, while_token->line, while_token->column);
+    ASTNode* node = new_node(parser, NODE_WHILE, while_token->line, while_token->column);
     node->data.while_loop.condition = parse_expression(parser);
     
     expect(parser, TOKEN_RUN, "Expected 'run:' after while condition");
@@ -214,8 +295,8 @@ static ASTNode* parse_for(Parser* parser) {
     
     expect(parser, TOKEN_IN, "Expected 'in' after iterator");
     
-    ASTNode* node = create_node(NODE_FOR, for_token->line, for_token->column);
-    node->data.for_loop.iterator = strdup(iterator->lexeme);
+    ASTNode* node = new_node(parser, NODE_FOR, for_token->line, for_token->column);
+    node->data.for_loop.iterator = copy_lexeme(parser, iterator);
     node->data.for_loop.iterable = parse_expression(parser);
     
     expect(parser, TOKEN_RUN, "Expected 'run:' after for condition");
@@ -231,9 +312,10 @@ static ASTNode* parse_for(Parser* parser) {
 static ASTNode* parse_return(Parser* parser) {
     Token* return_token = advance(parser); // return
     
-    ASTNode* node = create_node(NODE_RETURN, return_token->line, return_token->column);
+    ASTNode* node = new_node(parser, NODE_RETURN, return_token->line, return_token->column);
     
-    if (!check(parser, TOKEN_END) && !check(parser, TOKEN_EOF)) {
+    if (!check(parser, TOKEN_END) && !check(parser, TOKEN_ELSE) &&
+        !check(parser, TOKEN_RPAREN) && !check(parser, TOKEN_EOF)) {
         node->data.return_stmt.value = parse_expression(parser);
     } else {
         node->data.return_stmt.value = NULL;
@@ -247,7 +329,7 @@ static ASTNode* parse_assignment_or_expr(Parser* parser) {
     ASTNode* expr = parse_expression(parser);
     
     if (match(parser, TOKEN_ASSIGN)) {
-        ASTNode* node = create_node(NODE_ASSIGN, peek(parser)->line, peek(parser)->column);
+        ASTNode* node = new_node(parser, NODE_ASSIGN, peek(parser)->line, peek(parser)->column);
         node->data.assignment.target = expr;
         node->data.assignment.value = parse_expression(parser);
         return node;
@@ -268,6 +350,11 @@ static ASTNode* parse_statement(Parser* parser) {
         return parse_func_decl(parser);
     }
     
+    if (match(parser, TOKEN_NEWCLASS)) {
+        parser->current--;
+        return parse_class_decl(parser);
+    }
+    
     if (match(parser, TOKEN_IF)) {
         parser->current--;
         return parse_if(parser);
@@ -288,16 +375,35 @@ static ASTNode* parse_statement(Parser* parser) {
         return parse_return(parser);
     }
     
+    if (check(parser, TOKEN_INCLUDING)) {
+        return parse_including(parser);
+    }
+    
     if (match(parser, TOKEN_BREAK)) {
-        return create_node(NODE_BREAK, peek(parser)->line, peek(parser)->column);
+        return new_node(parser, NODE_BREAK, peek(parser)->line, peek(parser)->column);
     }
     
     return parse_assignment_or_expr(parser);
 }
 
+// Parse call arguments up to and including the closing ')'
+static void parse_args(Parser* parser, ASTNode*** args, int* arg_count) {
+    int capacity = 4;
+    *args = (ASTNode**)arena_alloc(parser->arena, sizeof(ASTNode*) * capacity);
+    *arg_count = 0;
+    
+    if (!check(parser, TOKEN_RPAREN)) {
+        do {
+            append_node(parser, args, arg_count, &capacity, parse_expression(parser));
+        } while (match(parser, TOKEN_COMMA));
+    }
+    
+    expect(parser, TOKEN_RPAREN, "Expected ')' after arguments");
+}
+
 // Parse binary expression (with operator precedence)
 static ASTNode* parse_binary(Parser* parser, int min_precedence) {
-    ASTNode* left = parse_primary(parser);
+    ASTNode* left = parse_postfix(parser);
     
     while (true) {
         Token* op_token = peek(parser);
@@ -325,7 +431,7 @@ static ASTNode* parse_binary(Parser* parser, int min_precedence) {
         advance(parser);
         ASTNode* right = parse_binary(parser, precedence + 1);
         
-        ASTNode* binary = create_node(NODE_BINARY_OP, op_token->line, op_token->column);
+        ASTNode* binary = new_node(parser, NODE_BINARY_OP, op_token->line, op_token->column);
         binary->data.binary_op.operator = op_token->type;
         binary->data.binary_op.left = left;
         binary->data.binary_op.right = right;
@@ -347,30 +453,39 @@ static ASTNode* parse_primary(Parser* parser) {
     
     // Number literal
     if (match(parser, TOKEN_NUMBER)) {
-        ASTNode* node = create_node(NODE_LITERAL, token->line, token->column);
+        ASTNode* node = new_node(parser, NODE_LITERAL, token->line, token->column);
         node->data.literal.literal_type = LITERAL_NUMBER;
         node->data.literal.literal_value.number = token->value.number;
         return node;
     }
     
+    if (match(parser, TOKEN_INTEGER)) {
+        ASTNode* node = new_node(parser, NODE_LITERAL, token->line, token->column);
+        node->data.literal.literal_type = LITERAL_INT;
+        node->data.literal.literal_value.integer = token->value.integer;
+        return node;
+    }
+    
     // String literal
     if (match(parser, TOKEN_STRING)) {
-        ASTNode* node = create_node(NODE_LITERAL, token->line, token->column);
+        ASTNode* node = new_node(parser, NODE_LITERAL, token->line, token->column);
         node->data.literal.literal_type = LITERAL_STRING;
-        node->data.literal.literal_value.string = strdup(token->value.string);
+        // Strip the quotes from the slice
+        node->data.literal.literal_value.string = arena_strndup(parser->arena,
+            parser->source + token->start + 1, token->length - 2);
         return node;
     }
     
     // Boolean literals
     if (match(parser, TOKEN_TRUE)) {
-        ASTNode* node = create_node(NODE_LITERAL, token->line, token->column);
+        ASTNode* node = new_node(parser, NODE_LITERAL, token->line, token->column);
         node->data.literal.literal_type = LITERAL_BOOL;
         node->data.literal.literal_value.boolean = true;
         return node;
     }
     
     if (match(parser, TOKEN_FALSE)) {
-        ASTNode* node = create_node(NODE_LITERAL, token->line, token->column);
+        ASTNode* node = new_node(parser, NODE_LITERAL, token->line, token->column);
         node->data.literal.literal_type = LITERAL_BOOL;
         node->data.literal.literal_value.boolean = false;
         return node;
@@ -378,42 +493,40 @@ static ASTNode* parse_primary(Parser* parser) {
     
     // Identifier or function call
     if (match(parser, TOKEN_IDENTIFIER)) {
-        ASTNode* node = create_node(NODE_IDENTIFIER, token->line, token->column);
-        node->data.identifier.name = strdup(token->lexeme);
+        ASTNode* node = new_node(parser, NODE_IDENTIFIER, token->line, token->column);
+        node->data.identifier.name = copy_lexeme(parser, token);
         
         // Check for function call
         if (match(parser, TOKEN_LPAREN)) {
-            ASTNode* call = create_node(NODE_CALL, token->line, token->column);
+            ASTNode* call = new_node(parser, NODE_CALL, token->line, token->column);
             call->data.call.callee = node;
-            
-            int capacity = 8;
-            call->data.call.args = (ASTNode**)malloc(sizeof(ASTNode*) * capacity);
-            call->data.call.arg_count = 0;
-            
-            if (!check(parser, TOKEN_RPAREN)) {
-                do {
-                    if (call->data.call.arg_count >= capacity) {
-                        capacity *= 2;
-                        call->data.call.args = (ASTNode**)realloc(
-                            call->data.call.args, sizeof(ASTNode*) * capacity);
-                    }
-                    call->data.call.args[call->data.call.arg_count++] = parse_expression(parser);
-                } while (match(parser, TOKEN_COMMA));
-            }
-            
-            expect(parser, TOKEN_RPAREN, "Expected ')' after arguments");
+            parse_args(parser, &call->data.call.args, &call->data.call.arg_count);
             return call;
         }
         
-        // Check for member access
-        if (match(parser, TOKEN_DOT)) {
-            Token* member = expect(parser, TOKEN_IDENTIFIER, "Expected member name");
-            ASTNode* access = create_node(NODE_MEMBER_ACCESS, token->line, token->column);
-            access->data.member_access.object = node;
-            access->data.member_access.member = strdup(member->lexeme);
-            return access;
-        }
+        return node;
+    }
+    
+    // The receiver of the method being run (a hidden parameter)
+    if (match(parser, TOKEN_THIS)) {
+        ASTNode* node = new_node(parser, NODE_IDENTIFIER, token->line, token->column);
+        node->data.identifier.name = copy_lexeme(parser, token);
+        return node;
+    }
+    
+    // Instantiation: New ClassName(args)
+    if (match(parser, TOKEN_NEW)) {
+        Token* name = expect(parser, TOKEN_IDENTIFIER, "Expected class name after 'New'");
+        if (!name) return NULL;
+        
+        ASTNode* class_ref = new_node(parser, NODE_IDENTIFIER, name->line, name->column);
+        class_ref->data.identifier.name = copy_lexeme(parser, name);
+        
+        ASTNode* node = new_node(parser, NODE_NEW_INSTANCE, token->line, token->column);
+        node->data.new_instance.class_ref = class_ref;
         
+        expect(parser, TOKEN_LPAREN, "Expected '(' after class name");
+        parse_args(parser, &node->data.new_instance.args, &node->data.new_instance.arg_count);
         return node;
     }
     
@@ -424,29 +537,67 @@ static ASTNode* parse_primary(Parser* parser) {
         return expr;
     }
     
-    fprintf(stderr, "Unexpected token at line %d: %s\n", token->line, token->lexeme);
+    if (token->type == TOKEN_ERROR) {
+        fprintf(stderr, "Unexpected token at line %d: %s: %.*s\n", token->line,
+            token->value.message, token->length, parser->source + token->start);
+    } else {
+        fprintf(stderr, "Unexpected token at line %d: %.*s\n", token->line,
+            token->length, parser->source + token->start);
+    }
     parser->had_error = true;
     return NULL;
 }
 
-// Parse program
+// Parse member accesses chained onto a primary: f().a, (x).b, a.Get().c.
+// The lexer keeps 'b.c' in '.b.c' together, so each segment gets its own
+// access. A '(' right after a member makes it a method call.
+static ASTNode* parse_postfix(Parser* parser) {
+    ASTNode* expr = parse_primary(parser);
+    
+    while (expr && check(parser, TOKEN_DOT)) {
+        Token* dot = advance(parser);
+        Token* member = expect(parser, TOKEN_IDENTIFIER, "Expected member name after '.'");
+        if (!member) return expr;
+        
+        const char* chars = parser->source + member->start;
+        int start = 0;
+        for (int i = 0; i <= member->length; i++) {
+            if (i < member->length && chars[i] != '.') continue;
+            
+            ASTNode* access = new_node(parser, NODE_MEMBER_ACCESS, dot->line, dot->column);
+            access->data.member_access.object = expr;
+            access->data.member_access.member = arena_intern(parser->arena, chars + start, i - start);
+            expr = access;
+            start = i + 1;
+        }
+        
+        if (match(parser, TOKEN_LPAREN)) {
+            ASTNode* call = new_node(parser, NODE_CALL, dot->line, dot->column);
+            call->data.call.callee = expr;
+            parse_args(parser, &call->data.call.args, &call->data.call.arg_count);
+            expr = call;
+        }
+    }
+    
+    return expr;
+}
+
+// Parse program (the returned tree owns a fresh arena; release it with free_ast)
 ASTNode* parser_parse(Parser* parser) {
-    ASTNode* program = create_node(NODE_PROGRAM, 1, 1);
+    parser->arena = arena_create();
+    ASTNode* program = new_node(parser, NODE_PROGRAM, 1, 1);
+    program->data.block.arena = parser->arena;
     
     int capacity = 32;
-    program->data.block.statements = (ASTNode**)malloc(sizeof(ASTNode*) * capacity);
+    program->data.block.statements = (ASTNode**)arena_alloc(parser->arena, sizeof(ASTNode*) * capacity);
     program->data.block.statement_count = 0;
     
     while (!check(parser, TOKEN_EOF)) {
         ASTNode* stmt = parse_statement(parser);
         
         if (stmt) {
-            if (program->data.block.statement_count >= capacity) {
-                capacity *= 2;
-                program->data.block.statements = (ASTNode**)realloc(
-                    program->data.block.statements, sizeof(ASTNode*) * capacity);
-            }
-            program->data.block.statements[program->data.block.statement_count++] = stmt;
+            append_node(parser, &program->data.block.statements,
+                &program->data.block.statement_count, &capacity, stmt);
         }
         
         if (parser->had_error) break;
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+// Resolver pass for Kitler
+// Gives every local a (depth, slot) pair and every global a fixed index into
+// the global table, so neither the tree walker nor the VM looks names up at
+// runtime. Locals are visible from their declaration onwards in source order.
+// String literals are turned into permanent constants here as well, dotted
+// names that are not globals become member accesses, and class fields and
+// methods get their slots in the class shape and vtable. Accesses through
+// 'this' start with those slots already in their inline caches.
+// This is also where closures are converted: a function that uses a local of
+// an enclosing function gets an upvalue for it, and the reference becomes an
+// index into the function's upvalues instead of a walk up a scope chain.
+// 'including' directives include their modules here, so that a module's
+// globals have slots before the code after the directive uses them.
+
+// Locals of one function being resolved, in slot order, and the variables it
+// captures from enclosing functions
+typedef struct FunctionScope {
+    struct FunctionScope* enclosing;
+    const char** names;
+    int count;
+    int capacity;
+    UpvalueRef* upvalues;
+    int upvalue_count;
+    int upvalue_capacity;
+} FunctionScope;
+
+typedef struct {
+    Interpreter* interp;
+    Arena* arena;           // Program arena, for nodes created while resolving
+    FunctionScope* current; // NULL at top level
+    ASTNode* current_class; // Class whose method bodies are being resolved
+} Resolver;
+
+static void resolve_node(Resolver* resolver, ASTNode* node);
+
+// ============================================================================
+// SLOT ALLOCATION
+// ============================================================================
+
+// Find a local slot in one function, or -1
+static int find_local(FunctionScope* function, const char* name) {
+    for (int i = function->count - 1; i >= 0; i--) {
+        if (strcmp(function->names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// Declare a local in the current function (redeclaring reuses the slot)
+static int declare_local(FunctionScope* function, const char* name) {
+    int slot = find_local(function, name);
+    if (slot >= 0) return slot;
+    
+    if (function->count >= function->capacity) {
+        function->capacity = function->capacity < 8 ? 8 : function->capacity * 2;
+        function->names = (const char**)realloc(function->names,
+            sizeof(char*) * function->capacity);
+    }
+    
+    function->names[function->count] = name;
+    return function->count++;
+}
+
+// Declare a name in the current scope, writing the binding to depth/slot
+static void declare(Resolver* resolver, const char* name, int* depth, int* slot) {
+    if (!resolver->current) {
+        *depth = -1;
+        *slot = global_slot(resolver->interp, name);
+        return;
+    }
+    
+    *depth = 0;
+    *slot = declare_local(resolver->current, name);
+}
+
+// Upvalue index of a captured variable in function, added if it is new
+static int add_upvalue(FunctionScope* function, bool is_local, int index) {
+    for (int i = 0; i < function->upvalue_count; i++) {
+        UpvalueRef* upvalue = &function->upvalues[i];
+        if (upvalue->is_local == is_local && upvalue->index == index) return i;
+    }
+    
+    if (function->upvalue_count >= function->upvalue_capacity) {
+        function->upvalue_capacity = function->upvalue_capacity < 8 ? 8 : function->upvalue_capacity * 2;
+        function->upvalues = (UpvalueRef*)realloc(function->upvalues,
+            sizeof(UpvalueRef) * function->upvalue_capacity);
+    }
+    
+    function->upvalues[function->upvalue_count].is_local = is_local;
+    function->upvalues[function->upvalue_count].index = index;
+    return function->upvalue_count++;
+}
+
+// Upvalue index of name in function if it is a local of an enclosing function,
+// or -1. Every function in between captures it too, so that a closure only
+// ever copies upvalues from the function that creates it.
+static int resolve_upvalue(FunctionScope* function, const char* name) {
+    if (!function->enclosing) return -1;
+    
+    int local = find_local(function->enclosing, name);
+    if (local >= 0) return add_upvalue(function, true, local);
+    
+    int upvalue = resolve_upvalue(function->enclosing, name);
+    if (upvalue >= 0) return add_upvalue(function, false, upvalue);
+    
+    return -1;
+}
+
+// Resolve a use of a name to the innermost declaration visible so far
+static void resolve_name(Resolver* resolver, const char* name, int* depth, int* slot) {
+    if (resolver->current) {
+        int local = find_local(resolver->current, name);
+        if (local >= 0) {
+            *depth = 0;
+            *slot = local;
+            return;
+        }
+        
+        int upvalue = resolve_upvalue(resolver->current, name);
+        if (upvalue >= 0) {
+            *depth = 1;
+            *slot = upvalue;
+            return;
+        }
+    }
+    
+    // Not a local anywhere: global (undeclared globals get a slot that stays NULL)
+    *depth = -1;
+    *slot = global_slot(resolver->interp, name);
+}
+
+// ============================================================================
+// AST WALK
+// ============================================================================
+
+// Resolve a function body in a fresh function scope
+static void resolve_function(Resolver* resolver, ASTNode* node) {
+    FunctionScope function;
+    function.enclosing = resolver->current;
+    function.names = NULL;
+    function.count = 0;
+    function.capacity = 0;
+    function.upvalues = NULL;
+    function.upvalue_count = 0;
+    function.upvalue_capacity = 0;
+    
+    // Parameters occupy the first slots
+    for (int i = 0; i < node->data.func_decl.param_count; i++) {
+        declare_local(&function, node->data.func_decl.params[i]);
+    }
+    
+    resolver->current = &function;
+    resolve_node(resolver, node->data.func_decl.body);
+    resolver->current = function.enclosing;
+    
+    node->data.func_decl.local_count = function.count;
+    node->data.func_decl.upvalue_count = function.upvalue_count;
+    node->data.func_decl.upvalues = NULL;
+    
+    if (function.upvalue_count > 0) {
+        size_t size = sizeof(UpvalueRef) * function.upvalue_count;
+        node->data.func_decl.upvalues = (UpvalueRef*)arena_alloc(resolver->arena, size);
+        memcpy(node->data.func_decl.upvalues, function.upvalues, size);
+    }
+    
+    if (function.names) free(function.names);
+    if (function.upvalues) free(function.upvalues);
+}
+
+// Give each field of a class its slot in the class shape and each method its
+// slot in the class vtable, then resolve the method bodies against that layout.
+// Field defaults are evaluated where the class is declared, so they resolve in
+// the enclosing scope.
+static void resolve_class(Resolver* resolver, ASTNode* node) {
+    Shape* shape = resolver->interp->root_shape;
+    VTable* vtable = vtable_create(resolver->interp);
+    
+    for (int i = 0; i < node->data.class_decl.member_count; i++) {
+        ASTNode* member = node->data.class_decl.members[i];
+        
+        if (member->type == NODE_FUNCDECL) {
+            Obj* key = constant_string(resolver->interp, member->data.func_decl.name);
+            member->data.func_decl.depth = 0;
+            member->data.func_decl.slot = vtable_add(vtable, key);
+            continue;
+        }
+        
+        resolve_node(resolver, member->data.var_decl.initializer);
+        
+        Obj* key = constant_string(resolver->interp, member->data.var_decl.name);
+        shape = shape_add(shape, key);
+        member->data.var_decl.depth = 0;
+        member->data.var_decl.slot = shape_find(shape, key);
+    }
+    
+    node->data.class_decl.shape = shape;
+    node->data.class_decl.vtable = vtable;
+    
+    ASTNode* enclosing = resolver->current_class;
+    resolver->current_class = node;
+    
+    for (int i = 0; i < node->data.class_decl.member_count; i++) {
+        ASTNode* member = node->data.class_decl.members[i];
+        if (member->type == NODE_FUNCDECL) resolve_function(resolver, member);
+    }
+    
+    resolver->current_class = enclosing;
+}
+
+// True for 'this' inside a method, whose class the resolver knows
+static bool is_this(Resolver* resolver, ASTNode* node) {
+    return resolver->current_class && node->type == NODE_IDENTIFIER &&
+        strcmp(node->data.identifier.name, "this") == 0;
+}
+
+// Prepare a member access: intern its name and give it a field cache, which
+// already holds the field's slot for 'this.field' on a declared field
+static void resolve_member(Resolver* resolver, ASTNode* node) {
+    resolve_node(resolver, node->data.member_access.object);
+    
+    Obj* key = constant_string(resolver->interp, node->data.member_access.member);
+    InlineCache* cache = (InlineCache*)arena_alloc(resolver->arena, sizeof(InlineCache));
+    memset(cache, 0, sizeof(InlineCache));
+    node->data.member_access.key = key;
+    node->data.member_access.cache = cache;
+    
+    if (is_this(resolver, node->data.member_access.object)) {
+        Shape* shape = resolver->current_class->data.class_decl.shape;
+        int slot = shape_find(shape, key);
+        if (slot >= 0) cache_update(cache, shape, slot);
+    }
+}
+
+// A member access being called is a method call: its cache maps vtables to
+// method slots, and 'this.method()' has its slot resolved here
+static void resolve_method_call(Resolver* resolver, ASTNode* callee) {
+    InlineCache* cache = callee->data.member_access.cache;
+    memset(cache, 0, sizeof(InlineCache));
+    
+    if (is_this(resolver, callee->data.member_access.object)) {
+        VTable* vtable = resolver->current_class->data.class_decl.vtable;
+        int slot = vtable_find(vtable, callee->data.member_access.key);
+        if (slot >= 0) cache_update(cache, vtable, slot);
+    }
+}
+
+// True for a call of the global Range with 1 to 3 arguments. A for loop over
+// one is compiled as a counted loop: the builtin's rules, without the object.
+static bool is_range_call(ASTNode* node) {
+    if (node->type != NODE_CALL || node->data.call.arg_count < 1 || node->data.call.arg_count > 3) {
+        return false;
+    }
+    
+    ASTNode* callee = node->data.call.callee;
+    return callee->type == NODE_IDENTIFIER && callee->data.identifier.depth < 0 &&
+        strcmp(callee->data.identifier.name, "Range") == 0;
+}
+
+// The lexer reads 'goblin.health' as one identifier. Unless the whole name is
+// a global (like the builtin Console.Write), rewrite the node in place into a
+// member access on everything before the last dot.
+static bool split_dotted_name(Resolver* resolver, ASTNode* node) {
+    const char* name = node->data.identifier.name;
+    const char* dot = strrchr(name, '.');
+    if (!dot || dot == name || dot[1] == '\0') return false;
+    
+    Value slot;
+    if (map_get(resolver->interp->global_index, constant_string(resolver->interp, name), &slot)) {
+        return false;
+    }
+    
+    ASTNode* object = create_node(resolver->arena, NODE_IDENTIFIER, node->line, node->column);
+    object->data.identifier.name = arena_intern(resolver->arena, name, (int)(dot - name));
+    
+    node->type = NODE_MEMBER_ACCESS;
+    node->data.member_access.object = object;
+    node->data.member_access.member = arena_intern(resolver->arena, dot + 1, (int)strlen(dot + 1));
+    resolve_member(resolver, node);
+    return true;
+}
+
+static void resolve_node(Resolver* resolver, ASTNode* node) {
+    if (!node) return;
+    
+    switch (node->type) {
+        case NODE_PROGRAM:
+        case NODE_BLOCK:
+            for (int i = 0; i < node->data.block.statement_count; i++) {
+                resolve_node(resolver, node->data.block.statements[i]);
+            }
+            break;
+            
+        case NODE_VARDECL:
+            // Initializer first: 'NewVar x = x + 1' reads the outer x
+            resolve_node(resolver, node->data.var_decl.initializer);
+            declare(resolver, node->data.var_decl.name,
+                &node->data.var_decl.depth, &node->data.var_decl.slot);
+            break;
+            
+        case NODE_FUNCDECL:
+            declare(resolver, node->data.func_decl.name,
+                &node->data.func_decl.depth, &node->data.func_decl.slot);
+            resolve_function(resolver, node);
+            break;
+            
+        case NODE_CLASSDECL:
+            declare(resolver, node->data.class_decl.name,
+                &node->data.class_decl.depth, &node->data.class_decl.slot);
+            resolve_class(resolver, node);
+            break;
+            
+        case NODE_IDENTIFIER:
+            if (split_dotted_name(resolver, node)) break;
+            resolve_name(resolver, node->data.identifier.name,
+                &node->data.identifier.depth, &node->data.identifier.slot);
+            break;
+            
+        case NODE_LITERAL:
+            // String literals become shared constants for both back ends
+            if (node->data.literal.literal_type == LITERAL_STRING) {
+                node->data.literal.constant = constant_string(resolver->interp,
+                    node->data.literal.literal_value.string);
+            }
+            break;
+            
+        case NODE_IF:
+            resolve_node(resolver, node->data.if_stmt.condition);
+            resolve_node(resolver, node->data.if_stmt.then_branch);
+            resolve_node(resolver, node->data.if_stmt.else_branch);
+            break;
+            
+        case NODE_WHILE:
+            resolve_node(resolver, node->data.while_loop.condition);
+            resolve_node(resolver, node->data.while_loop.body);
+            break;
+            
+        case NODE_FOR:
+            // Iterable first, like an initializer: it cannot see the loop variable
+            resolve_node(resolver, node->data.for_loop.iterable);
+            node->data.for_loop.counted = is_range_call(node->data.for_loop.iterable);
+            declare(resolver, node->data.for_loop.iterator,
+                &node->data.for_loop.depth, &node->data.for_loop.slot);
+            resolve_node(resolver, node->data.for_loop.body);
+            break;
+            
+        case NODE_RETURN:
+            resolve_node(resolver, node->data.return_stmt.value);
+            break;
+            
+        case NODE_INCLUDING:
+            module_include(resolver->interp, node->data.including.library, node->line);
+            break;
+            
+        case NODE_ASSIGN:
+            resolve_node(resolver, node->data.assignment.value);
+            resolve_node(resolver, node->data.assignment.target);
+            break;
+            
+        case NODE_BINARY_OP:
+            resolve_node(resolver, node->data.binary_op.left);
+            resolve_node(resolver, node->data.binary_op.right);
+            break;
+            
+        case NODE_UNARY_OP:
+            resolve_node(resolver, node->data.unary_op.operand);
+            break;
+            
+        case NODE_CALL:
+            resolve_node(resolver, node->data.call.callee);
+            if (node->data.call.callee->type == NODE_MEMBER_ACCESS) {
+                resolve_method_call(resolver, node->data.call.callee);
+            }
+            for (int i = 0; i < node->data.call.arg_count; i++) {
+                resolve_node(resolver, node->data.call.args[i]);
+            }
+            break;
+            
+        case NODE_MEMBER_ACCESS:
+            resolve_member(resolver, node);
+            break;
+            
+        case NODE_NEW_INSTANCE:
+            resolve_node(resolver, node->data.new_instance.class_ref);
+            for (int i = 0; i < node->data.new_instance.arg_count; i++) {
+                resolve_node(resolver, node->data.new_instance.args[i]);
+            }
+            break;
+            
+        case NODE_INDEX_ACCESS:
+            resolve_node(resolver, node->data.index_access.object);
+            resolve_node(resolver, node->data.index_access.index);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+// Resolve every variable reference in a program against the interpreter's globals
+void resolve_program(Interpreter* interp, ASTNode* program) {
+    Resolver resolver;
+    resolver.interp = interp;
+    resolver.arena = program->data.block.arena;
+    resolver.current = NULL;
+    resolver.current_class = NULL;
+    
+    resolve_node(&resolver, program);
+}
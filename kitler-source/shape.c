@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+// Hidden classes, method tables and inline caches for Kitler instances
+// An instance is a shape pointer plus a contiguous slot array. The shape
+// records which field name lives in which slot, and adding a field moves the
+// instance along a transition to the next shape, so instances built the same
+// way share shapes. Every field access site keeps an inline cache of the
+// shapes it has seen and their slots; a hit is one compare and one load.
+// Methods live in a per-class array indexed by vtable slot, and method call
+// sites cache the slot per vtable in the same way.
+
+// ============================================================================
+// SHAPES
+// ============================================================================
+
+// Create the empty shape every instance starts from
+Shape* shape_create_root() {
+    Shape* shape = (Shape*)malloc(sizeof(Shape));
+    memset(shape, 0, sizeof(Shape));
+    return shape;
+}
+
+// Free a shape and every shape reached from it by transitions
+void shape_free(Shape* shape) {
+    if (!shape) return;
+    
+    for (int i = 0; i < shape->transition_count; i++) {
+        shape_free(shape->transitions[i]);
+    }
+    
+    if (shape->transitions) free(shape->transitions);
+    if (shape->keys) free(shape->keys);
+    free(shape);
+}
+
+// Slot of field key in shape, or -1
+int shape_find(Shape* shape, Obj* key) {
+    for (int i = shape->slot_count - 1; i >= 0; i--) {
+        if (shape->keys[i] == key) return i;
+    }
+    return -1;
+}
+
+// Shape after adding field key (shape itself if it already has the field)
+Shape* shape_add(Shape* shape, Obj* key) {
+    if (shape_find(shape, key) >= 0) return shape;
+    
+    // Follow an existing transition, so equal field orders share one shape
+    for (int i = 0; i < shape->transition_count; i++) {
+        Shape* next = shape->transitions[i];
+        if (next->keys[shape->slot_count] == key) return next;
+    }
+    
+    Shape* next = shape_create_root();
+    next->parent = shape;
+    next->slot_count = shape->slot_count + 1;
+    next->keys = (Obj**)malloc(sizeof(Obj*) * next->slot_count);
+    if (shape->slot_count > 0) {
+        memcpy(next->keys, shape->keys, sizeof(Obj*) * shape->slot_count);
+    }
+    next->keys[shape->slot_count] = key;
+    
+    if (shape->transition_count >= shape->transition_capacity) {
+        shape->transition_capacity = shape->transition_capacity < 4 ? 4 : shape->transition_capacity * 2;
+        shape->transitions = (Shape**)realloc(shape->transitions,
+            sizeof(Shape*) * shape->transition_capacity);
+    }
+    shape->transitions[shape->transition_count++] = next;
+    
+    return next;
+}
+
+// ============================================================================
+// METHOD TABLES
+// ============================================================================
+
+// Create an empty method table owned by the interpreter
+VTable* vtable_create(Interpreter* interp) {
+    VTable* vtable = (VTable*)malloc(sizeof(VTable));
+    vtable->names = NULL;
+    vtable->count = 0;
+    vtable->next = interp->vtables;
+    interp->vtables = vtable;
+    return vtable;
+}
+
+// Slot of method key in vtable, or -1
+int vtable_find(VTable* vtable, Obj* key) {
+    for (int i = 0; i < vtable->count; i++) {
+        if (vtable->names[i] == key) return i;
+    }
+    return -1;
+}
+
+// Slot for method key, appending it if the table does not have it yet
+int vtable_add(VTable* vtable, Obj* key) {
+    int slot = vtable_find(vtable, key);
+    if (slot >= 0) return slot;
+    
+    vtable->names = (Obj**)realloc(vtable->names, sizeof(Obj*) * (vtable->count + 1));
+    vtable->names[vtable->count] = key;
+    return vtable->count++;
+}
+
+// ============================================================================
+// INLINE CACHES
+// ============================================================================
+
+// Cached slot for key (a shape or vtable), or -1 on a miss
+static inline int cache_lookup(InlineCache* cache, const void* key) {
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->keys[i] == key) return cache->slots[i];
+    }
+    return -1;
+}
+
+// Remember the slot for key; a full cache stays as it is
+void cache_update(InlineCache* cache, const void* key, int slot) {
+    if (cache->count >= KT_IC_WAYS) return;
+    
+    cache->keys[cache->count] = key;
+    cache->slots[cache->count] = slot;
+    cache->count++;
+}
+
+// Slot of field key in instance, consulting and training the cache (if any); -1 if absent
+static int field_slot(Obj* instance, Obj* key, InlineCache* cache) {
+    Shape* shape = instance->data.instance.shape;
+    int slot = cache ? cache_lookup(cache, shape) : -1;
+    if (slot >= 0) return slot;
+    
+    slot = shape_find(shape, key);
+    if (slot >= 0 && cache) cache_update(cache, shape, slot);
+    return slot;
+}
+
+// ============================================================================
+// CLASSES AND INSTANCES
+// ============================================================================
+
+// Allocate a class whose instances start with shape's fields, all null, and
+// whose methods are all null until the declaration fills them in
+Obj* new_class(Interpreter* interp, const char* name, Shape* shape, VTable* vtable) {
+    Obj* klass = allocate_object(interp, VALUE_CLASS);
+    klass->data.class_obj.name = strdup(name);
+    klass->data.class_obj.shape = shape;
+    klass->data.class_obj.vtable = vtable;
+    
+    int count = shape->slot_count;
+    klass->data.class_obj.defaults = (Value*)malloc(sizeof(Value) * (count > 0 ? count : 1));
+    for (int i = 0; i < count; i++) {
+        klass->data.class_obj.defaults[i] = NULL_VAL;
+    }
+    
+    count = vtable->count;
+    klass->data.class_obj.methods = (Value*)malloc(sizeof(Value) * (count > 0 ? count : 1));
+    for (int i = 0; i < count; i++) {
+        klass->data.class_obj.methods[i] = NULL_VAL;
+    }
+    
+    return klass;
+}
+
+// Instantiate a class: the instance takes the class shape and field defaults
+Value new_instance(Interpreter* interp, Value klass) {
+    if (klass.type != VALUE_CLASS) {
+        fprintf(stderr, "Can only instantiate classes with New\n");
+        return NULL_VAL;
+    }
+    
+    Shape* shape = AS_OBJ(klass)->data.class_obj.shape;
+    int capacity = shape->slot_count > 0 ? shape->slot_count : 1;
+    
+    Obj* instance = allocate_object(interp, VALUE_INSTANCE);
+    instance->data.instance.class_ref = AS_OBJ(klass);
+    instance->data.instance.shape = shape;
+    instance->data.instance.slots = (Value*)malloc(sizeof(Value) * capacity);
+    instance->data.instance.slot_capacity = capacity;
+    memcpy(instance->data.instance.slots, AS_OBJ(klass)->data.class_obj.defaults,
+        sizeof(Value) * shape->slot_count);
+    
+    return OBJ_VAL(instance);
+}
+
+// Read a field (the slow path behind the back ends' monomorphic check)
+Value get_field(Interpreter* interp, Value receiver, Obj* key, InlineCache* cache) {
+    (void)interp;
+    
+    if (IS_VECTOR(receiver) || IS_COLOR(receiver)) return vector_field(receiver, key);
+    
+    if (receiver.type != VALUE_INSTANCE) {
+        fprintf(stderr, "Only instances have fields: %s\n", key->data.string.chars);
+        return NULL_VAL;
+    }
+    
+    Obj* instance = AS_OBJ(receiver);
+    int slot = field_slot(instance, key, cache);
+    
+    if (slot < 0) {
+        fprintf(stderr, "Undefined field: %s\n", key->data.string.chars);
+        return NULL_VAL;
+    }
+    
+    return instance->data.instance.slots[slot];
+}
+
+// Write a field, adding it (and moving to the next shape) if it is new
+Value set_field(Interpreter* interp, Value receiver, Obj* key, Value value, InlineCache* cache) {
+    if (IS_VECTOR(receiver) || IS_COLOR(receiver)) {
+        // Immediates are copied, so there is no shared vector to update
+        fprintf(stderr, "Cannot set %s of a vector or color; build a new one instead\n",
+            key->data.string.chars);
+        return value;
+    }
+    
+    if (receiver.type != VALUE_INSTANCE) {
+        fprintf(stderr, "Only instances have fields: %s\n", key->data.string.chars);
+        return value;
+    }
+    
+    Obj* instance = AS_OBJ(receiver);
+    int slot = field_slot(instance, key, cache);
+    
+    if (slot < 0) {
+        // Transitions are not cached: adding fields is rare next to storing them
+        Shape* shape = shape_add(instance->data.instance.shape, key);
+        slot = shape->slot_count - 1;
+        
+        if (slot >= instance->data.instance.slot_capacity) {
+            int capacity = instance->data.instance.slot_capacity * 2;
+            instance->data.instance.slots = (Value*)realloc(instance->data.instance.slots,
+                sizeof(Value) * capacity);
+            instance->data.instance.slot_capacity = capacity;
+        }
+        instance->data.instance.shape = shape;
+    }
+    
+    gc_write_barrier(interp, instance, value);
+    instance->data.instance.slots[slot] = value;
+    return value;
+}
+
+// Method of the receiver's class named key, or UNDEFINED_VAL if the receiver
+// has no class or its class has no such method. Vectors and colors use the
+// built-in interp->vector_class. The call site's cache maps vtables to slots,
+// so a hit skips the name search.
+Value find_method(Interpreter* interp, Value receiver, Obj* key, InlineCache* cache) {
+    Obj* klass;
+    if (receiver.type == VALUE_INSTANCE) {
+        klass = AS_OBJ(receiver)->data.instance.class_ref;
+    } else if ((IS_VECTOR(receiver) || IS_COLOR(receiver)) && interp->vector_class) {
+        klass = interp->vector_class;
+    } else {
+        return UNDEFINED_VAL;
+    }
+    
+    VTable* vtable = klass->data.class_obj.vtable;
+    int slot = cache_lookup(cache, vtable);
+    
+    if (slot < 0) {
+        slot = vtable_find(vtable, key);
+        if (slot < 0) return UNDEFINED_VAL;
+        cache_update(cache, vtable, slot);
+    }
+    
+    return klass->data.class_obj.methods[slot];
+}
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+// Hash map for Kitler maps
+// Entries live in a dense array in insertion order, so iteration follows the
+// order keys were added. A separate open-addressing index of entry positions
+// is probed Robin Hood style: an insert takes the slot of any entry that is
+// closer to its home slot, which keeps every probe sequence short. Keys are
+// interned strings, so they use their cached hash and compare by pointer.
+
+#define MAP_MIN_ENTRIES 8
+#define MAP_EMPTY (-1)
+
+// ============================================================================
+// HASHING
+// ============================================================================
+
+// Keys are interned strings, which carry their hash
+static inline uint32_t hash_key(Obj* key) {
+    return key->data.string.hash;
+}
+
+// Distance of an index slot from the home slot of the entry stored in it
+static inline int probe_distance(Obj* map, int slot) {
+    uint32_t mask = (uint32_t)map->data.map.index_capacity - 1;
+    uint32_t home = map->data.map.entries[map->data.map.index[slot]].hash & mask;
+    return (int)(((uint32_t)slot - home) & mask);
+}
+
+// ============================================================================
+// INDEX
+// ============================================================================
+
+// Place entry position into the index, displacing entries nearer their home
+static void index_insert(Obj* map, int position) {
+    int32_t* index = map->data.map.index;
+    uint32_t mask = (uint32_t)map->data.map.index_capacity - 1;
+    int slot = (int)(map->data.map.entries[position].hash & mask);
+    int distance = 0;
+    
+    while (index[slot] != MAP_EMPTY) {
+        int existing = probe_distance(map, slot);
+        
+        // Robin Hood: the entry that has travelled further keeps the slot
+        if (existing < distance) {
+            int32_t displaced = index[slot];
+            index[slot] = position;
+            position = displaced;
+            distance = existing;
+        }
+        
+        slot = (int)((slot + 1) & mask);
+        distance++;
+    }
+    
+    index[slot] = position;
+}
+
+// Index slot holding key, or -1
+static int index_find(Obj* map, Obj* key, uint32_t hash) {
+    if (map->data.map.index_capacity == 0) return -1;
+    
+    int32_t* index = map->data.map.index;
+    MapEntry* entries = map->data.map.entries;
+    uint32_t mask = (uint32_t)map->data.map.index_capacity - 1;
+    int slot = (int)(hash & mask);
+    
+    for (int distance = 0; index[slot] != MAP_EMPTY; distance++) {
+        // Every entry further along is closer to home than key would be
+        if (probe_distance(map, slot) < distance) return -1;
+        if (entries[index[slot]].key == key) return slot;
+        slot = (int)((slot + 1) & mask);
+    }
+    
+    return -1;
+}
+
+// Compact deleted entries away and rebuild the index for entry_capacity entries
+static void map_rebuild(Obj* map, int entry_capacity) {
+    MapEntry* entries = map->data.map.entries;
+    int live = 0;
+    
+    for (int i = 0; i < map->data.map.count; i++) {
+        if (entries[i].key) entries[live++] = entries[i];
+    }
+    
+    map->data.map.entries = (MapEntry*)realloc(entries, sizeof(MapEntry) * entry_capacity);
+    map->data.map.capacity = entry_capacity;
+    map->data.map.count = live;
+    map->data.map.live = live;
+    
+    // The index stays at most half full
+    int index_capacity = entry_capacity * 2;
+    free(map->data.map.index);
+    map->data.map.index = (int32_t*)malloc(sizeof(int32_t) * index_capacity);
+    map->data.map.index_capacity = index_capacity;
+    
+    for (int i = 0; i < index_capacity; i++) {
+        map->data.map.index[i] = MAP_EMPTY;
+    }
+    for (int i = 0; i < live; i++) {
+        index_insert(map, i);
+    }
+}
+
+// ============================================================================
+// MAP OPERATIONS
+// ============================================================================
+
+// Look up key (an interned string); false if it is not present
+bool map_get(Obj* map, Obj* key, Value* value) {
+    int slot = index_find(map, key, hash_key(key));
+    if (slot < 0) return false;
+    
+    *value = map->data.map.entries[map->data.map.index[slot]].value;
+    return true;
+}
+
+// Insert or update key. Returns true for a new key. Callers that store into an
+// existing object run gc_write_barrier on it.
+bool map_set(Obj* map, Obj* key, Value value) {
+    uint32_t hash = hash_key(key);
+    int slot = index_find(map, key, hash);
+    
+    if (slot >= 0) {
+        map->data.map.entries[map->data.map.index[slot]].value = value;
+        return false;
+    }
+    
+    if (map->data.map.count >= map->data.map.capacity) {
+        // Grow only when deleted entries cannot make the room
+        int capacity = map->data.map.capacity;
+        if (map->data.map.live >= capacity / 2) {
+            capacity = capacity < MAP_MIN_ENTRIES ? MAP_MIN_ENTRIES : capacity * 2;
+        }
+        map_rebuild(map, capacity);
+    }
+    
+    int position = map->data.map.count++;
+    map->data.map.entries[position].key = key;
+    map->data.map.entries[position].hash = hash;
+    map->data.map.entries[position].value = value;
+    map->data.map.live++;
+    
+    index_insert(map, position);
+    return true;
+}
+
+// Remove key; false if it was not present
+bool map_delete(Obj* map, Obj* key) {
+    int slot = index_find(map, key, hash_key(key));
+    if (slot < 0) return false;
+    
+    // The entry stays behind as a hole in insertion order until the next rebuild
+    MapEntry* entry = &map->data.map.entries[map->data.map.index[slot]];
+    entry->key = NULL;
+    entry->value = NULL_VAL;
+    map->data.map.live--;
+    
+    // Backward-shift the rest of the cluster so no tombstones enter the index
+    int32_t* index = map->data.map.index;
+    uint32_t mask = (uint32_t)map->data.map.index_capacity - 1;
+    int next = (int)((slot + 1) & mask);
+    
+    while (index[next] != MAP_EMPTY && probe_distance(map, next) > 0) {
+        index[slot] = index[next];
+        slot = next;
+        next = (int)((next + 1) & mask);
+    }
+    index[slot] = MAP_EMPTY;
+    
+    return true;
+}
+
+// Release a map's storage (keys and values belong to the GC)
+void map_free(Obj* map) {
+    if (map->data.map.entries) free(map->data.map.entries);
+    if (map->data.map.index) free(map->data.map.index);
+}
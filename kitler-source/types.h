@@ -3,42 +3,57 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
 // types.h for the Kitler programming language
 
+// Reserved words as X(token, spelling, first char, last char). The keyword
+// members of TokenType, the lexer's perfect hash and the IDE highlighter are
+// all generated from this one list. The two characters feed KEYWORD_HASH in
+// lexer.c; a collision there is reported by -Woverride-init, and lexer_init
+// asserts that they match each spelling.
+#define KT_KEYWORDS(X) \
+    X(TOKEN_TRUE, "true", 't', 'e') \
+    X(TOKEN_FALSE, "false", 'f', 'e') \
+    X(TOKEN_INCLUDING, "including", 'i', 'g') \
+    X(TOKEN_PROJECTSPACE, "projectSpace", 'p', 'e') \
+    X(TOKEN_NEWVAR, "NewVar", 'N', 'r') \
+    X(TOKEN_NEWFUNC, "NewFunc", 'N', 'c') \
+    X(TOKEN_NEWCLASS, "NewClass", 'N', 's') \
+    X(TOKEN_NEWEVENT, "NewEvent", 'N', 't') \
+    X(TOKEN_NEWASYNC, "NewAsync", 'N', 'c') \
+    X(TOKEN_IF, "if", 'i', 'f') \
+    X(TOKEN_ELSE, "else", 'e', 'e') \
+    X(TOKEN_WHILE, "while", 'w', 'e') \
+    X(TOKEN_FOR, "for", 'f', 'r') \
+    X(TOKEN_FOREACH, "foreach", 'f', 'h') \
+    X(TOKEN_IN, "in", 'i', 'n') \
+    X(TOKEN_SWITCH, "switch", 's', 'h') \
+    X(TOKEN_CASE, "case", 'c', 'e') \
+    X(TOKEN_DEFAULT, "default", 'd', 't') \
+    X(TOKEN_BREAK, "break", 'b', 'k') \
+    X(TOKEN_RETURN, "return", 'r', 'n') \
+    X(TOKEN_RUN, "run", 'r', 'n') \
+    X(TOKEN_END, "end", 'e', 'd') \
+    X(TOKEN_WHEN, "when", 'w', 'n') \
+    X(TOKEN_THIS, "this", 't', 's') \
+    X(TOKEN_NEW, "New", 'N', 'w') \
+    X(TOKEN_AWAIT, "await", 'a', 't') \
+    X(TOKEN_AND, "and", 'a', 'd') \
+    X(TOKEN_OR, "or", 'o', 'r')
+
+#define KT_KEYWORD_ENUM(token, spelling, first, last) token,
+
 // Token types for the lexer
 typedef enum {
     // Literals
     TOKEN_NUMBER,
+    TOKEN_INTEGER,
     TOKEN_STRING,
     TOKEN_IDENTIFIER,
-    TOKEN_TRUE,
-    TOKEN_FALSE,
     
-    // Keywords
-    TOKEN_INCLUDING,
-    TOKEN_PROJECTSPACE,
-    TOKEN_NEWVAR,
-    TOKEN_NEWFUNC,
-    TOKEN_NEWCLASS,
-    TOKEN_NEWEVENT,
-    TOKEN_NEWASYNC,
-    TOKEN_IF,
-    TOKEN_ELSE,
-    TOKEN_WHILE,
-    TOKEN_FOR,
-    TOKEN_FOREACH,
-    TOKEN_IN,
-    TOKEN_SWITCH,
-    TOKEN_CASE,
-    TOKEN_DEFAULT,
-    TOKEN_BREAK,
-    TOKEN_RETURN,
-    TOKEN_RUN,
-    TOKEN_END,
-    TOKEN_WHEN,
-    TOKEN_THIS,
-    TOKEN_NEW,
-    TOKEN_AWAIT,
+    // Keywords (including true/false and the and/or operators)
+    KT_KEYWORDS(KT_KEYWORD_ENUM)
     
     // Operators
     TOKEN_PLUS,
@@ -53,8 +68,6 @@ typedef enum {
     TOKEN_LESS_EQUAL,
     TOKEN_GREATER,
     TOKEN_GREATER_EQUAL,
-    TOKEN_AND,
-    TOKEN_OR,
     TOKEN_NOT,
     
     // Delimiters
@@ -75,15 +88,17 @@ typedef enum {
     TOKEN_ERROR
 } TokenType;
 
-// Token structure
+// Token structure (the lexeme is a slice of the source buffer, never copied)
 typedef struct {
     TokenType type;
-    char* lexeme;
+    int start;              // Byte offset of the lexeme in the source
+    int length;             // Lexeme length in bytes (strings include their quotes)
     int line;
     int column;
     union {
-        double number;
-        char* string;
+        double number;          // TOKEN_NUMBER
+        int64_t integer;        // TOKEN_INTEGER
+        const char* message;    // TOKEN_ERROR (static string)
     } value;
 } Token;
 
@@ -126,6 +141,34 @@ typedef enum {
 typedef struct ASTNode ASTNode;
 typedef struct Scope Scope;
 typedef struct Value Value;
+typedef struct Obj Obj;
+typedef struct Chunk Chunk;
+typedef struct Interpreter Interpreter;
+typedef struct Shape Shape;
+typedef struct VTable VTable;
+typedef struct InlineCache InlineCache;
+
+// Where a closure finds one captured variable when it is created (resolver output)
+typedef struct {
+    bool is_local;      // A local slot of the creating function, else one of its upvalues
+    int index;
+} UpvalueRef;
+
+// Bump allocator that owns one parsed program: nodes, child arrays and names
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;     // Newest first; allocations bump the head block
+    void* last;             // Most recent allocation (arena_grow extends it in place)
+    char** names;           // Interned identifiers (open addressing, power of two)
+    int name_count;
+    int name_capacity;
+} Arena;
 
 // AST Node structure
 struct ASTNode {
@@ -151,6 +194,8 @@ struct ASTNode {
         struct {
             char* name;
             ASTNode* initializer;
+            int depth;          // Set by resolver: 0 = local, -1 = global
+            int slot;           // Local slot or global table index
         } var_decl;
         
         // Function declaration
@@ -160,13 +205,23 @@ struct ASTNode {
             int param_count;
             ASTNode* body;
             bool is_async;
+            int depth;          // Set by resolver: binding of the function name
+            int slot;
+            int local_count;    // Parameters + locals declared in the body
+            UpvalueRef* upvalues; // Set by resolver: variables captured from enclosing functions
+            int upvalue_count;
         } func_decl;
         
         // Class declaration
         struct {
             char* name;
-            ASTNode** members;
+            ASTNode** members;  // NODE_VARDECL fields and NODE_FUNCDECL methods; the
+                                // resolver sets each slot in shape or vtable
             int member_count;
+            int depth;          // Set by resolver: binding of the class name
+            int slot;
+            Shape* shape;       // Set by resolver: shape of a new instance
+            VTable* vtable;     // Set by resolver: method slots
         } class_decl;
         
         // Event declaration
@@ -180,6 +235,7 @@ struct ASTNode {
         struct {
             ASTNode** statements;
             int statement_count;
+            Arena* arena;       // NODE_PROGRAM only: owns the whole tree
         } block;
         
         // If statement
@@ -200,6 +256,10 @@ struct ASTNode {
             char* iterator;
             ASTNode* iterable;
             ASTNode* body;
+            int depth;          // Set by resolver: binding of the loop variable
+            int slot;
+            bool counted;       // Set by resolver: iterable is a Range(...) call, run
+                                // as a counted loop without a range object
         } for_loop;
         
         // Switch statement
@@ -246,6 +306,9 @@ struct ASTNode {
         struct {
             ASTNode* object;
             char* member;
+            Obj* key;           // Set by resolver: interned member name
+            InlineCache* cache; // Set by resolver: tree walker's field cache (method
+                                // cache when this is the callee of a call)
         } member_access;
         
         // Index access (arr[index])
@@ -258,20 +321,25 @@ struct ASTNode {
         struct {
             enum {
                 LITERAL_NUMBER,
+                LITERAL_INT,
                 LITERAL_STRING,
                 LITERAL_BOOL,
                 LITERAL_NULL
             } literal_type;
             union {
                 double number;
+                int64_t integer;
                 char* string;
                 bool boolean;
             } literal_value;
+            Obj* constant;  // Shared permanent string, set by the resolver
         } literal;
         
         // Identifier
         struct {
             char* name;
+            int depth;          // Set by resolver: 0 = local, 1 = upvalue, -1 = global
+            int slot;           // Local slot, upvalue index or global table index
         } identifier;
         
         // List literal
@@ -289,7 +357,7 @@ struct ASTNode {
         
         // New instance
         struct {
-            char* class_name;
+            ASTNode* class_ref;
             ASTNode** args;
             int arg_count;
         } new_instance;
@@ -303,13 +371,25 @@ struct ASTNode {
 
 // Value types for runtime
 typedef enum {
-    VALUE_NUMBER,
-    VALUE_STRING,
+    // Immediates (stored inline in Value)
+    VALUE_UNDEFINED,    // Empty variable slot (zeroed memory), never visible to scripts
+    VALUE_NUMBER,       // double
+    VALUE_INT,          // int64_t
     VALUE_BOOL,
     VALUE_NULL,
+    VALUE_VEC2,         // Two float lanes
+    VALUE_VEC3,         // Three float lanes (z in the padding lane)
+    VALUE_COLOR,        // RGBA, 8 bits per channel
+    
+    // Heap objects (Value points to an Obj)
+    VALUE_STRING,
+    VALUE_ROPE,         // Unflattened string concatenation
     VALUE_LIST,
     VALUE_MAP,
+    VALUE_RANGE,        // Lazy counter from the Range builtin
+    VALUE_ARRAY,        // Typed numeric array (FloatArray, DoubleArray, IntArray)
     VALUE_FUNCTION,
+    VALUE_UPVALUE,      // Captured variable cell of closures, never visible to scripts
     VALUE_CLASS,
     VALUE_INSTANCE,
     VALUE_NATIVE_FUNCTION,
@@ -317,52 +397,196 @@ typedef enum {
     VALUE_COMPONENT
 } ValueType;
 
-// Runtime value structure
+// Runtime value: a 16-byte tagged immediate passed by value.
+// Numbers (doubles and 64-bit integers), booleans, null, vectors and colors
+// live inline; everything else points to an Obj.
 struct Value {
     ValueType type;
-    bool is_marked; // For garbage collection
-    
+    float z;            // Third lane of a Vec3 (padding for every other type)
     union {
         double number;
-        char* string;
+        int64_t integer;
         bool boolean;
+        Obj* obj;
+        float vec[2];   // x and y of a Vec2 or Vec3
+        uint8_t rgba[4];
+    } data;
+};
+
+_Static_assert(sizeof(Value) == 16, "Value must stay two words");
+
+#define IS_UNDEFINED(v)   ((v).type == VALUE_UNDEFINED)
+#define IS_INT(v)         ((v).type == VALUE_INT)
+#define IS_NUMBER(v)      ((v).type == VALUE_NUMBER || IS_INT(v))
+#define IS_BOOL(v)        ((v).type == VALUE_BOOL)
+#define IS_NULL(v)        ((v).type == VALUE_NULL)
+#define IS_STRING(v)      ((v).type == VALUE_STRING)
+#define IS_ROPE(v)        ((v).type == VALUE_ROPE)
+#define IS_TEXT(v)        (IS_STRING(v) || IS_ROPE(v))
+#define IS_VECTOR(v)      ((v).type == VALUE_VEC2 || (v).type == VALUE_VEC3)
+#define IS_COLOR(v)       ((v).type == VALUE_COLOR)
+#define IS_OBJ(v)         ((v).type >= VALUE_STRING)
+
+#define AS_INT(v)         ((v).data.integer)
+#define AS_NUMBER(v)      (IS_INT(v) ? (double)(v).data.integer : (v).data.number)
+#define AS_BOOL(v)        ((v).data.boolean)
+#define AS_OBJ(v)         ((v).data.obj)
+#define AS_STRING(v)      ((v).data.obj->data.string.chars)
+
+#define UNDEFINED_VAL     ((Value){ .type = VALUE_UNDEFINED, .data = { .number = 0 } })
+#define NULL_VAL          ((Value){ .type = VALUE_NULL, .data = { .number = 0 } })
+#define NUMBER_VAL(n)     ((Value){ .type = VALUE_NUMBER, .data = { .number = (n) } })
+#define INT_VAL(i)        ((Value){ .type = VALUE_INT, .data = { .integer = (i) } })
+#define BOOL_VAL(b)       ((Value){ .type = VALUE_BOOL, .data = { .boolean = (b) } })
+#define OBJ_VAL(o)        ((Value){ .type = (o)->type, .data = { .obj = (o) } })
+#define VEC2_VAL(x, y)    ((Value){ .type = VALUE_VEC2, .z = 0, .data = { .vec = { (x), (y) } } })
+#define VEC3_VAL(x, y, z_) ((Value){ .type = VALUE_VEC3, .z = (z_), .data = { .vec = { (x), (y) } } })
+
+// Integer arithmetic for both back ends. A result that does not fit in 64
+// bits is computed as a double instead, and so is a quotient that is not
+// whole: 7 / 2 is 3.5, as it was before integers existed.
+static inline Value int_add(int64_t a, int64_t b) {
+    int64_t result;
+    if (__builtin_add_overflow(a, b, &result)) return NUMBER_VAL((double)a + (double)b);
+    return INT_VAL(result);
+}
+
+static inline Value int_subtract(int64_t a, int64_t b) {
+    int64_t result;
+    if (__builtin_sub_overflow(a, b, &result)) return NUMBER_VAL((double)a - (double)b);
+    return INT_VAL(result);
+}
+
+static inline Value int_multiply(int64_t a, int64_t b) {
+    int64_t result;
+    if (__builtin_mul_overflow(a, b, &result)) return NUMBER_VAL((double)a * (double)b);
+    return INT_VAL(result);
+}
+
+static inline Value int_divide(int64_t a, int64_t b) {
+    if (b == 0 || (b == -1 && a == INT64_MIN) || a % b != 0) {
+        return NUMBER_VAL((double)a / (double)b);
+    }
+    return INT_VAL(a / b);
+}
+
+// Remainder with the sign of a, as fmod gives for doubles
+static inline Value int_modulo(int64_t a, int64_t b) {
+    if (b == 0) return NUMBER_VAL(fmod((double)a, 0.0));
+    if (b == -1) return INT_VAL(0);     // INT64_MIN % -1 would trap
+    return INT_VAL(a % b);
+}
+
+// a op b for a numeric comparison: exact for two integers, else as doubles
+#define NUMBER_COMPARE(a, op, b) \
+    (IS_INT(a) && IS_INT(b) ? AS_INT(a) op AS_INT(b) : AS_NUMBER(a) op AS_NUMBER(b))
+
+// Native function called from scripts; args are rooted on the stack during the call
+typedef Value (*NativeFn)(Interpreter* interp, Value* args, int arg_count);
+
+// Element type of a typed array
+typedef enum {
+    ARRAY_FLOAT,        // float
+    ARRAY_DOUBLE,       // double
+    ARRAY_INT           // int32_t
+} ArrayKind;
+
+// One key/value pair of a map, kept in insertion order (see table.c)
+typedef struct {
+    Obj* key;           // Interned string; NULL once the entry is deleted
+    uint32_t hash;      // Cached hash of key
+    Value value;
+} MapEntry;
+
+// Heap object: strings, lists, maps, functions, classes and instances
+struct Obj {
+    ValueType type;
+    bool is_marked;     // Old generation: reached by the current mark phase
+                        // Nursery: already promoted (see forwarding)
+    bool is_remembered; // Old object queued for the next minor collection
+    bool is_permanent;  // Compile-time constant, never traced or freed by the GC
+    
+    union {
+        struct {
+            char* chars;
+            int length;
+            uint32_t hash;
+        } string;       // Interned: one object per distinct content
+        
+        struct {
+            Value left;
+            Value right;    // Either side may be a string, rope, number, bool or null
+            int length_hint; // Buffer size estimate for flattening
+            Obj* flat;      // Interned result once flattened (left and right are then dropped)
+        } rope;
+        
+        Obj* forwarding; // Old-generation copy of a promoted nursery object
         
         struct {
-            Value** elements;
+            Value* elements;
             int count;
             int capacity;
         } list;
         
         struct {
-            char** keys;
-            Value** values;
-            int count;
+            MapEntry* entries;  // Insertion order, including deleted entries
+            int count;          // Entries used, deleted ones included
+            int live;           // Entries not deleted
             int capacity;
+            int32_t* index;     // Robin Hood table of entry positions (-1 empty)
+            int index_capacity;
         } map;
         
         struct {
-            char* name;
+            Value start;        // All three integers, or all three doubles
+            Value end;          // Exclusive
+            Value step;         // Never 0
+        } range;
+        
+        struct {
+            void* data;         // count elements of kind, 32-byte aligned
+            void* block;        // Allocation holding data
+            int count;
+            ArrayKind kind;
+        } array;
+        
+        struct {
+            char* name;         // Owned by the prototype (permanent); closures share it
             char** params;
             int param_count;
+            int local_count;
             ASTNode* body;
-            Scope* closure;
+            UpvalueRef* captures; // How to fill upvalues (owned by the AST)
+            Obj** upvalues;     // Captured variable cells, shared with other closures
+            int upvalue_count;
+            Chunk* chunk; // Compiled body (NULL for tree-walker functions)
         } function;
         
+        struct {
+            Value* location;    // Frame slot while the variable's call runs, then &closed
+            Value closed;
+            Obj* next;          // Next open upvalue, lower on the locals stack
+        } upvalue;
+        
         struct {
             char* name;
-            struct Value** methods;
-            char** method_names;
-            int method_count;
+            VTable* vtable;     // Method names by slot, shared with the declaration
+            Value* methods;     // Method functions, one per slot of vtable
+            Shape* shape;       // Shape of a new instance: the declared fields
+            Value* defaults;    // Initial field values, one per slot of shape
         } class_obj;
         
         struct {
-            struct Value* class_ref;
-            struct Value* fields; // Map of field values
+            Obj* class_ref;
+            Shape* shape;       // Hidden class: which field lives in which slot
+            Value* slots;       // Field values, shape->slot_count of them
+            int slot_capacity;
         } instance;
         
         struct {
             char* name;
-            Value* (*native_fn)(Value** args, int arg_count);
+            NativeFn native_fn;
+            void* data;         // Embedder's native behind native_fn (see kitler.c)
         } native_function;
         
         struct {
@@ -379,18 +603,157 @@ struct Value {
     } data;
 };
 
+// Hidden class of an instance (see shape.c). Instances that gained the same
+// fields in the same order share a shape, so a field's slot can be cached
+// per shape. Shapes form a tree from interp->root_shape and are never freed
+// before the interpreter.
+struct Shape {
+    Shape* parent;          // Shape before the last field was added (NULL for the root)
+    Obj** keys;             // Field names in slot order (permanent interned strings)
+    int slot_count;
+    Shape** transitions;    // Shapes reached by adding one more field
+    int transition_count;
+    int transition_capacity;
+};
+
+// Method table of a class declaration, built once by the resolver. Every
+// class object created from the declaration shares it, which makes it a
+// stable key for call-site caches even when class objects move or die.
+struct VTable {
+    Obj** names;            // Method names in slot order (permanent interned strings)
+    int count;
+    VTable* next;           // Interpreter's list of every table
+};
+
+#define KT_IC_WAYS 4        // Entries an inline cache holds before it stops learning
+
+// Slot cache of one access site, keyed on shapes at field accesses and on
+// vtables at method calls: monomorphic while it holds one key, polymorphic up
+// to KT_IC_WAYS, and megamorphic (full, slow path) after that
+struct InlineCache {
+    const void* keys[KT_IC_WAYS];
+    int slots[KT_IC_WAYS];
+    int count;
+};
+
 // Scope structure for variable resolution
+// The global scope is a name -> index table; function scopes are plain slot
+// arrays (names == NULL) indexed by the slots the resolver assigned. Function
+// scopes die with their call: closures keep upvalues, not scopes.
 struct Scope {
     char** names;
-    Value** values;
+    Value* values;
     int count;
     int capacity;
     Scope* parent;
 };
 
+// Bytecode instructions for the VM
+typedef enum {
+    OP_CONSTANT,        // [u16 index]       push constants[index]
+    OP_NULL,
+    OP_TRUE,
+    OP_FALSE,
+    OP_POP,
+    OP_GET_GLOBAL,      // [u16 index]       push global table entry
+    OP_SET_GLOBAL,      // [u16 index]       assign global, leaves value on stack
+    OP_DEFINE_GLOBAL,   // [u16 index]       define global, pops value
+    OP_GET_LOCAL,       // [u8 slot]         push frame slot
+    OP_SET_LOCAL,       // [u8 slot]         assign frame slot, leaves value on stack
+    OP_GET_UPVALUE,     // [u8 index]        push captured variable
+    OP_SET_UPVALUE,     // [u8 index]        assign captured variable, leaves value on stack
+    OP_GET_LOCAL_LONG,  // [u16 slot]        the same four for slots and indices above 255
+    OP_SET_LOCAL_LONG,  // [u16 slot]
+    OP_GET_UPVALUE_LONG, // [u16 index]
+    OP_SET_UPVALUE_LONG, // [u16 index]
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_MODULO,
+    OP_EQUAL,
+    OP_NOT_EQUAL,
+    OP_LESS,
+    OP_LESS_EQUAL,
+    OP_GREATER,
+    OP_GREATER_EQUAL,
+    OP_AND,
+    OP_OR,
+    OP_JUMP,            // [u16 offset]      forward jump
+    OP_JUMP_IF_FALSE,   // [u16 offset]      pops condition
+    OP_LOOP,            // [u16 offset]      backward jump
+    OP_FUNCTION,        // [u16 index]       instantiate function prototype, capturing its upvalues
+    OP_CALL,            // [u8 arg_count]
+    OP_RETURN,
+    OP_CLASS,           // [u16 index]       instantiate class prototype
+    OP_CLASS_FIELD,     // [u8 slot]         pop a field default into the class below it
+    OP_METHOD,          // [u8 slot]         pop a method function into the class below it
+    OP_INVOKE,          // [u16 name][u16 cache][u8 arg_count] call a method on the receiver
+    OP_NEW,             // [u8 arg_count]    replace class and arguments with an instance
+    OP_GET_FIELD,       // [u16 name][u16 cache] replace instance with a field
+    OP_SET_FIELD,       // [u16 name][u16 cache] store into instance, leaves value on stack
+    OP_ITER_INIT,       // push a cursor for the iterable below it
+    OP_ITER_NEXT,       // [u16 offset]      push the next item, or pop nothing and jump at the end
+    OP_RANGE_INIT,      // [u8 arg_count]    turn Range arguments into counter, end, step
+    OP_RANGE_NEXT       // [u16 offset]      push the counter and step it, or jump at the end
+} OpCode;
+
+#define KT_OPCODE_COUNT (OP_RANGE_NEXT + 1)
+// Bump when an instruction's operands or meaning change, so that .ktc caches
+// written by an older compiler are rebuilt instead of run
+#define KT_BYTECODE_VERSION 2
+
+// Compiled bytecode for one function body
+struct Chunk {
+    uint8_t* code;
+    int* lines;
+    int count;
+    int capacity;
+    bool mapped;            // code and lines point into a mapped .ktc file
+    
+    Value* constants;
+    int constant_count;
+    int constant_capacity;
+    
+    InlineCache* caches;    // One per field access site
+    int cache_count;
+    int cache_capacity;
+};
+
+// Activation record for a function call (bytecode or tree walker)
+typedef struct {
+    Obj* function;
+    uint8_t* ip;
+    Value* slots;      // First stack slot owned by this call (the callee)
+    Scope* scope;      // Variable scope for this call
+    Scope locals;      // Call's own scope, with values on interp->locals
+} CallFrame;
+
+// Call depth limits. The stacks are allocated once at their full size, and
+// only the part a script reaches is ever touched. The tree walker also
+// recurses on the C stack, which an 8 MB thread stack runs out of at about
+// 16K script calls, so it stops sooner.
+#define KT_FRAMES_MAX 65536
+#define KT_WALKER_FRAMES_MAX 8192
+#define KT_STACK_MAX (KT_FRAMES_MAX * 64)
+
+// Garbage collector tuning
+#define KT_NURSERY_OBJECTS 4096     // Young objects per minor collection
+#define KT_GC_MIN_MAJOR 4096        // Old-generation size before the first full collection
+#define KT_GC_STEP_BUDGET_MS 0.5    // Default time limit of one incremental step
+#define KT_GC_STEP_WORK 4096        // Default object limit of one incremental step
+
+// Phase of the incremental old-generation collector
+typedef enum {
+    GC_IDLE,
+    GC_MARK,
+    GC_SWEEP
+} GcPhase;
+
 // Lexer structure
 typedef struct {
     const char* source;
+    const char* start;      // First character of the token being scanned
     const char* current;
     int line;
     int column;
@@ -399,6 +762,8 @@ typedef struct {
 
 // Parser structure
 typedef struct {
+    const char* source;     // Buffer the token slices point into
+    Arena* arena;           // Receives every node of the program being parsed
     Token* tokens;
     int token_count;
     int current;
@@ -406,26 +771,257 @@ typedef struct {
     bool panic_mode;
 } Parser;
 
+// Life of a module named by an 'including' directive (see module.c)
+typedef enum {
+    MODULE_LOADING,     // Known, perhaps parsing on a preload thread; not included yet
+    MODULE_RESOLVING,   // Being resolved and compiled (an include cycle stops here)
+    MODULE_PENDING,     // Included: its globals have slots, but it has not run
+    MODULE_READY,       // Initialised by the first read of one of its globals
+    MODULE_FAILED       // Not found, or did not parse
+} ModuleState;
+
+typedef struct NativeModule NativeModule;
+
+// A native or script module, included at most once per interpreter
+typedef struct Module {
+    char* name;                 // Dotted name, e.g. System.IO
+    const NativeModule* native; // Built-in library, or NULL for a script module
+    char* path;                 // Script module source file
+    char* source;
+    size_t source_length;
+    uint64_t source_hash;       // Checked against the file when loaded from a .ktc
+    Token* tokens;
+    int token_count;
+    ASTNode* ast;               // Script module program (owns its arena)
+    bool parse_failed;
+    void* thread;               // Preload thread still parsing it, until joined
+    Obj* script;                // Compiled top level (NULL under the tree walker)
+    int* slots;                 // Global slots the module defines
+    int slot_count;
+    ModuleState state;
+    struct Module* next;        // Next module, in include order
+} Module;
+
 // Interpreter structure
-typedef struct {
+struct Interpreter {
     ASTNode* ast;
     Scope* global_scope;
     Scope* current_scope;
-    Value** gc_objects;
+    Obj** gc_objects;       // Old generation (malloc'd, mark-and-sweep)
     int gc_count;
     int gc_capacity;
     bool should_exit;
-    Value* return_value;
-} Interpreter;
+    
+    // Generational GC: new objects are bump-allocated in the nursery and
+    // copied into the old generation when they survive a minor collection.
+    // Collections only run at safepoints, where every live value is a root.
+    Obj* nursery;
+    int nursery_used;
+    Obj** remembered;       // Old objects that may point into the nursery
+    int remembered_count;
+    int remembered_capacity;
+    Obj* open_upvalues;     // Upvalues still pointing into interp->locals, highest first
+    int gc_next_major;      // Old-generation size that triggers a full collection
+    bool gc_requested;      // Set by the allocator, served at the next safepoint
+    
+    // Incremental old-generation cycle, advanced a budgeted step at a time
+    GcPhase gc_phase;
+    Obj** gray_stack;       // Marked objects whose references are not scanned yet
+    int gray_count;
+    int gray_capacity;
+    Obj** revived;          // Strings marked during the sweep, unmarked when it ends
+    int revived_count;
+    int revived_capacity;
+    int sweep_cursor;
+    int sweep_alive;
+    double gc_step_budget_ms; // Time limit of one step (e.g. per frame)
+    int gc_step_work;       // Object limit of one step
+    
+    // Compile-time constants: allocated black and outside gc_objects, so the
+    // GC never traces or frees them. They are released with the interpreter.
+    Obj** permanent;
+    int permanent_count;
+    int permanent_capacity;
+    
+    // Weak intern set of every string object, by content (see memory.c)
+    Obj** strings;
+    int string_count;       // Slots in use, tombstones included
+    int string_capacity;
+    Obj* global_index;      // Map from interned global name to its slot in global_scope
+    Shape* root_shape;      // Shape of an instance with no fields
+    VTable* vtables;        // Method tables of every class declaration
+    Obj* vector_class;      // Built-in methods of vectors and colors (permanent)
+    bool returning;         // Tree walker is unwinding a 'return'
+    bool failed;            // ...or a runtime error, which also sets returning
+    Value return_value;
+    
+    // Bytecode VM state
+    bool use_tree_walker;   // Execute with eval_node instead of the VM
+    Value* stack;
+    Value* stack_top;
+    Value* locals;          // Local variable slots of active calls, one region per frame
+    Value* locals_top;
+    CallFrame* frames;      // KT_FRAMES_MAX of them
+    int frame_count;
+    Chunk** chunks;         // Every chunk compiled for this interpreter
+    int chunk_count;
+    int chunk_capacity;
+    void* cache_map;        // Loaded .ktc file that mapped chunks point into
+    size_t cache_map_size;
+    
+    Module* modules;        // Included (or preloading) modules, in include order
+    char* module_dir;       // Where script modules are looked up (NULL: current directory)
+    
+    // Embedding (see kitler.c)
+    Obj* native_callee;     // Native function being called, so one NativeFn can serve many
+    void* embedder;         // Isolate that owns this interpreter, if any
+};
 
 // Function prototypes for memory management
-Token* create_token(TokenType type, const char* lexeme, int line, int column);
-void free_token(Token* token);
-ASTNode* create_node(NodeType type, int line, int column);
-void free_ast(ASTNode* node);
-Value* create_value(ValueType type);
-void free_value(Value* value);
+Arena* arena_create();
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_grow(Arena* arena, void* old, size_t old_size, size_t new_size);
+char* arena_strndup(Arena* arena, const char* chars, int length);
+char* arena_intern(Arena* arena, const char* chars, int length);
+void arena_free(Arena* arena);
+ASTNode* create_node(Arena* arena, NodeType type, int line, int column);
+void free_ast(ASTNode* program);
+Obj* create_object(ValueType type);
+void free_object(Obj* object);
 Scope* create_scope(Scope* parent);
+Scope* enter_frame_scope(Interpreter* interp, CallFrame* frame, int slot_count);
+void leave_frame_scope(Interpreter* interp, CallFrame* frame);
+Obj* capture_upvalue(Interpreter* interp, Value* slot);
 void free_scope(Scope* scope);
+Chunk* create_chunk();
+void free_chunk(Chunk* chunk);
+
+// Garbage collector (memory.c)
+Obj* allocate_object(Interpreter* interp, ValueType type);
+Obj* allocate_tenured(Interpreter* interp, ValueType type);
+Obj* allocate_permanent(Interpreter* interp, ValueType type);
+Obj* intern_string(Interpreter* interp, const char* chars, int length);
+Obj* intern_owned_string(Interpreter* interp, char* chars, int length);
+Obj* constant_string(Interpreter* interp, const char* chars);
+void gc_register(Interpreter* interp, Obj* object);
+void gc_write_barrier(Interpreter* interp, Obj* owner, Value value);
+void gc_collect(Interpreter* interp);
+void gc_collect_full(Interpreter* interp);
+void gc_step(Interpreter* interp, double budget_ms);
+void gc_idle(Interpreter* interp, double idle_ms);
+
+// Collect if the allocator asked for it; only call where every live value is rooted
+static inline void gc_safepoint(Interpreter* interp) {
+    if (interp->gc_requested) gc_collect(interp);
+}
+
+// Hash map for maps (table.c)
+bool map_get(Obj* map, Obj* key, Value* value);
+bool map_set(Obj* map, Obj* key, Value value);
+bool map_delete(Obj* map, Obj* key);
+void map_free(Obj* map);
+
+// Shapes, method tables, classes and instance fields (shape.c)
+Shape* shape_create_root();
+void shape_free(Shape* shape);
+int shape_find(Shape* shape, Obj* key);
+Shape* shape_add(Shape* shape, Obj* key);
+VTable* vtable_create(Interpreter* interp);
+int vtable_find(VTable* vtable, Obj* key);
+int vtable_add(VTable* vtable, Obj* key);
+void cache_update(InlineCache* cache, const void* key, int slot);
+Obj* new_class(Interpreter* interp, const char* name, Shape* shape, VTable* vtable);
+Value new_instance(Interpreter* interp, Value klass);
+Value get_field(Interpreter* interp, Value receiver, Obj* key, InlineCache* cache);
+Value set_field(Interpreter* interp, Value receiver, Obj* key, Value value, InlineCache* cache);
+Value find_method(Interpreter* interp, Value receiver, Obj* key, InlineCache* cache);
+
+// Ranges and the for/foreach iteration protocol (iterator.c)
+bool range_args(Value* args, int arg_count, Value* start, Value* end, Value* step);
+Value new_range(Interpreter* interp, Value start, Value end, Value step);
+Value iterator_start(Interpreter* interp, Value iterable);
+bool iterator_next(Interpreter* interp, Value iterable, Value* cursor, Value* item);
+
+// Yield a range loop's counter in *item and advance it by step, or return
+// false once it has reached end. An integer counter stays an integer; one
+// whose next step would overflow ends the loop.
+static inline bool range_next(Value* counter, Value end, Value step, Value* item) {
+    if (IS_INT(*counter)) {
+        int64_t current = AS_INT(*counter);
+        if (AS_INT(step) > 0 ? current >= AS_INT(end) : current <= AS_INT(end)) return false;
+        
+        *item = *counter;
+        if (__builtin_add_overflow(current, AS_INT(step), &counter->data.integer)) *counter = end;
+        return true;
+    }
+    
+    double current = counter->data.number;
+    if (step.data.number > 0 ? current >= end.data.number : current <= end.data.number) return false;
+    
+    *item = *counter;
+    counter->data.number = current + step.data.number;
+    return true;
+}
+
+// Typed numeric arrays and their bulk kernels (array.c)
+size_t array_element_size(ArrayKind kind);
+void array_init(Obj* array, ArrayKind kind, int count);
+Value new_array(Interpreter* interp, ArrayKind kind, int count);
+Value array_get(Obj* array, int index);
+void register_array_builtins(Interpreter* interp);
+
+// Vec2, Vec3 and Color immediates (vec.c)
+#define KT_VECTOR_TEXT_MAX 96   // Longest format_vector output
+Value vector_add(Value a, Value b);
+Value vector_subtract(Value a, Value b);
+Value vector_multiply(Value a, Value b);
+Value vector_divide(Value a, Value b);
+Value vector_field(Value value, Obj* key);
+bool vectors_equal(Value a, Value b);
+int format_vector(Value value, char* buffer, int size);
+void register_vector_builtins(Interpreter* interp);
+
+// Shared runtime helpers (interpreter.c)
+Value new_string(Interpreter* interp, char* owned_chars);
+void define_native(Interpreter* interp, const char* name, NativeFn function);
+void scope_define(Scope* scope, const char* name, Value value);
+Value scope_get(Scope* scope, const char* name);
+void scope_set(Scope* scope, const char* name, Value value);
+int global_slot(Interpreter* interp, const char* name);
+bool value_is_truthy(Value value);
+bool values_equal(Interpreter* interp, Value a, Value b);
+Value value_concat(Interpreter* interp, Value left, Value right);
+Obj* string_flatten(Interpreter* interp, Obj* rope);
+void interpreter_eval_module(Interpreter* interp, ASTNode* program);
+
+// Resolver pass (resolver.c), bytecode compiler (compiler.c) and VM (vm.c)
+void resolve_program(Interpreter* interp, ASTNode* program);
+Obj* compile_program(Interpreter* interp, ASTNode* program);
+Chunk* new_chunk(Interpreter* interp);
+bool vm_run(Interpreter* interp, Obj* script);
+void vm_run_nested(Interpreter* interp, Obj* script);
+bool vm_call(Interpreter* interp, Value callee, Value* args, int arg_count, Value* result);
+
+// Compiled script cache, heap snapshots and program images (cache.c)
+uint64_t ktc_hash(const void* data, size_t length);
+char* ktc_path(const char* source_path);
+Obj* ktc_load(Interpreter* interp, const char* path, const char* source, size_t source_length);
+void ktc_save(Interpreter* interp, const char* path, Obj* script,
+              const char* source, size_t source_length);
+void ktc_release(Interpreter* interp);
+bool snapshot_save(Interpreter* interp, const char* path, Obj* script);
+Obj* snapshot_load(Interpreter* interp, const char* path);
+bool program_image(Interpreter* interp, Obj* script, uint8_t** bytes, size_t* size);
+Obj* program_load(Interpreter* interp, const uint8_t* bytes, size_t size);
+
+// Module loader for 'including' directives (module.c)
+void module_set_dir(Interpreter* interp, const char* script_path);
+void module_preload(Interpreter* interp, const char* source, Token* tokens, int token_count);
+void module_include(Interpreter* interp, const char* name, int line);
+bool module_touch(Interpreter* interp, int slot);
+bool module_restore(Interpreter* interp, const char* name, const char* path,
+                    uint64_t source_hash, size_t source_length, Obj* script,
+                    const int* slots, int slot_count, ModuleState state, bool check_source);
+void module_free_all(Interpreter* interp);
 
 #endif // KT_TYPES_H
\ No newline at end of file
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "types.h"
+// Vec2, Vec3 and Color values for Kitler
+// Vectors and colors are immediates: their lanes live inside the 16-byte
+// Value (a Vec3 keeps z in what is padding for other types), so Vec2(x, y),
+// arithmetic and field reads never allocate. Vector math runs on one SSE
+// register holding x, y, z and a zero lane; other CPUs use the same code
+// on a plain four-float struct.
+
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define KT_VEC_SSE 1
+#else
+#define KT_VEC_SSE 0
+#endif
+
+// ============================================================================
+// LANES
+// ============================================================================
+
+#if KT_VEC_SSE
+
+typedef __m128 Lanes;
+
+static inline Lanes lanes_load(Value value) {
+    return _mm_setr_ps(value.data.vec[0], value.data.vec[1], value.z, 0.0f);
+}
+
+static inline Lanes lanes_set1(float s) { return _mm_set1_ps(s); }
+static inline Lanes lanes_add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes lanes_sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes lanes_mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes lanes_div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+
+// Sum of the four lanes
+static inline float lanes_sum(Lanes a) {
+    Lanes swapped = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+    Lanes pairs = _mm_add_ps(a, swapped);
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_movehl_ps(swapped, pairs)));
+}
+
+static inline void lanes_store(float* out, Lanes a) { _mm_storeu_ps(out, a); }
+
+#else
+
+typedef struct {
+    float lane[4];
+} Lanes;
+
+static inline Lanes lanes_load(Value value) {
+    return (Lanes){ { value.data.vec[0], value.data.vec[1], value.z, 0.0f } };
+}
+
+static inline Lanes lanes_set1(float s) { return (Lanes){ { s, s, s, s } }; }
+
+#define LANES_OP(name, op) \
+    static inline Lanes name(Lanes a, Lanes b) { \
+        for (int i = 0; i < 4; i++) a.lane[i] = a.lane[i] op b.lane[i]; \
+        return a; \
+    }
+LANES_OP(lanes_add, +)
+LANES_OP(lanes_sub, -)
+LANES_OP(lanes_mul, *)
+LANES_OP(lanes_div, /)
+#undef LANES_OP
+
+static inline float lanes_sum(Lanes a) {
+    return (a.lane[0] + a.lane[1]) + (a.lane[2] + a.lane[3]);
+}
+
+static inline void lanes_store(float* out, Lanes a) { memcpy(out, a.lane, sizeof(a.lane)); }
+
+#endif
+
+// Vector of type from lanes (a Vec2 drops whatever ended up in z)
+static inline Value vector_from_lanes(ValueType type, Lanes lanes) {
+    float out[4];
+    lanes_store(out, lanes);
+    return type == VALUE_VEC3 ? VEC3_VAL(out[0], out[1], out[2]) : VEC2_VAL(out[0], out[1]);
+}
+
+// The four channels of a color as lanes, 0 to 255
+static inline Lanes color_lanes(Value color) {
+    float channels[4];
+    for (int i = 0; i < 4; i++) channels[i] = color.data.rgba[i];
+
+#if KT_VEC_SSE
+    return _mm_loadu_ps(channels);
+#else
+    Lanes lanes;
+    memcpy(lanes.lane, channels, sizeof(channels));
+    return lanes;
+#endif
+}
+
+// One color channel from a number: rounded and kept within 0 to 255
+static uint8_t to_channel(double value) {
+    if (!(value > 0)) return 0;
+    if (value >= 255) return 255;
+    return (uint8_t)(value + 0.5);
+}
+
+static Value color_value(double r, double g, double b, double a) {
+    Value color = { .type = VALUE_COLOR, .z = 0, .data = { .number = 0 } };
+    color.data.rgba[0] = to_channel(r);
+    color.data.rgba[1] = to_channel(g);
+    color.data.rgba[2] = to_channel(b);
+    color.data.rgba[3] = to_channel(a);
+    return color;
+}
+
+static Value color_from_lanes(Lanes lanes) {
+    float out[4];
+    lanes_store(out, lanes);
+    return color_value(out[0], out[1], out[2], out[3]);
+}
+
+// ============================================================================
+// OPERATORS
+// The back ends call these when either operand of +, -, * or / is a vector.
+// Operands that do not fit are reported and give null.
+// ============================================================================
+
+static const char* type_name(Value value) {
+    switch (value.type) {
+        case VALUE_VEC2: return "Vec2";
+        case VALUE_VEC3: return "Vec3";
+        case VALUE_COLOR: return "Color";
+        case VALUE_NUMBER:
+        case VALUE_INT: return "number";
+        default: return "value";
+    }
+}
+
+static Value operand_error(char op, Value a, Value b) {
+    fprintf(stderr, "Cannot apply '%c' to %s and %s\n", op, type_name(a), type_name(b));
+    return NULL_VAL;
+}
+
+// Vec + Vec of the same size
+Value vector_add(Value a, Value b) {
+    if (!IS_VECTOR(a) || a.type != b.type) return operand_error('+', a, b);
+    return vector_from_lanes(a.type, lanes_add(lanes_load(a), lanes_load(b)));
+}
+
+// Vec - Vec of the same size
+Value vector_subtract(Value a, Value b) {
+    if (!IS_VECTOR(a) || a.type != b.type) return operand_error('-', a, b);
+    return vector_from_lanes(a.type, lanes_sub(lanes_load(a), lanes_load(b)));
+}
+
+// Vec * number or number * Vec
+Value vector_multiply(Value a, Value b) {
+    if (IS_NUMBER(a)) {
+        Value swap = a;
+        a = b;
+        b = swap;
+    }
+    if (!IS_VECTOR(a) || !IS_NUMBER(b)) return operand_error('*', a, b);
+    
+    return vector_from_lanes(a.type, lanes_mul(lanes_load(a), lanes_set1((float)AS_NUMBER(b))));
+}
+
+// Vec / number
+Value vector_divide(Value a, Value b) {
+    if (!IS_VECTOR(a) || !IS_NUMBER(b)) return operand_error('/', a, b);
+    return vector_from_lanes(a.type, lanes_div(lanes_load(a), lanes_set1((float)AS_NUMBER(b))));
+}
+
+// Equality for == and != (lane by lane, so NaN lanes are never equal)
+bool vectors_equal(Value a, Value b) {
+    if (IS_COLOR(a)) return memcmp(a.data.rgba, b.data.rgba, sizeof(a.data.rgba)) == 0;
+    
+    return a.data.vec[0] == b.data.vec[0] && a.data.vec[1] == b.data.vec[1] &&
+        (a.type == VALUE_VEC2 || a.z == b.z);
+}
+
+// ============================================================================
+// FIELDS AND TEXT
+// ============================================================================
+
+// Read .x, .y or .z of a vector, or .r, .g, .b or .a of a color
+Value vector_field(Value value, Obj* key) {
+    const char* name = key->data.string.chars;
+    
+    if (key->data.string.length == 1) {
+        if (IS_VECTOR(value)) {
+            switch (name[0]) {
+                case 'x': return NUMBER_VAL(value.data.vec[0]);
+                case 'y': return NUMBER_VAL(value.data.vec[1]);
+                case 'z': if (value.type == VALUE_VEC3) return NUMBER_VAL(value.z); break;
+            }
+        } else {
+            const char* channels = "rgba";
+            const char* channel = strchr(channels, name[0]);
+            if (channel) return INT_VAL(value.data.rgba[channel - channels]);
+        }
+    }
+    
+    fprintf(stderr, "%s has no field %s\n", type_name(value), name);
+    return NULL_VAL;
+}
+
+// Write value as Console.Write prints it; returns the length, as snprintf
+int format_vector(Value value, char* buffer, int size) {
+    switch (value.type) {
+        case VALUE_VEC2:
+            return snprintf(buffer, size, "Vec2(%g, %g)", value.data.vec[0], value.data.vec[1]);
+        case VALUE_VEC3:
+            return snprintf(buffer, size, "Vec3(%g, %g, %g)",
+                value.data.vec[0], value.data.vec[1], value.z);
+        default:
+            return snprintf(buffer, size, "RGBA(%d, %d, %d, %d)", value.data.rgba[0],
+                value.data.rgba[1], value.data.rgba[2], value.data.rgba[3]);
+    }
+}
+
+// ============================================================================
+// BUILTINS
+// ============================================================================
+
+// Read exactly count number arguments, or report the error and return false
+static bool number_args(const char* builtin, Value* args, int arg_count, int count, double* out) {
+    bool valid = arg_count == count;
+    for (int i = 0; valid && i < count; i++) {
+        valid = IS_NUMBER(args[i]);
+        out[i] = AS_NUMBER(args[i]);
+    }
+    
+    if (!valid) fprintf(stderr, "%s expects %d numbers\n", builtin, count);
+    return valid;
+}
+
+// Vec2(x, y)
+static Value builtin_vec2(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double lanes[2];
+    if (!number_args("Vec2", args, arg_count, 2, lanes)) return NULL_VAL;
+    
+    return VEC2_VAL((float)lanes[0], (float)lanes[1]);
+}
+
+// Vec3(x, y, z)
+static Value builtin_vec3(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double lanes[3];
+    if (!number_args("Vec3", args, arg_count, 3, lanes)) return NULL_VAL;
+    
+    return VEC3_VAL((float)lanes[0], (float)lanes[1], (float)lanes[2]);
+}
+
+// RGB(r, g, b) with channels from 0 to 255, opaque
+static Value builtin_rgb(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double channels[3];
+    if (!number_args("RGB", args, arg_count, 3, channels)) return NULL_VAL;
+    
+    return color_value(channels[0], channels[1], channels[2], 255);
+}
+
+// RGBA(r, g, b, a) with channels from 0 to 255
+static Value builtin_rgba(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    double channels[4];
+    if (!number_args("RGBA", args, arg_count, 4, channels)) return NULL_VAL;
+    
+    return color_value(channels[0], channels[1], channels[2], channels[3]);
+}
+
+// Methods: args[0] is the receiver, which find_method only resolves them for
+
+// v.Dot(w)
+static Value method_dot(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    if (!IS_VECTOR(args[0]) || arg_count != 2 || args[1].type != args[0].type) {
+        fprintf(stderr, "Dot expects a vector of the same size\n");
+        return NULL_VAL;
+    }
+    
+    return NUMBER_VAL(lanes_sum(lanes_mul(lanes_load(args[0]), lanes_load(args[1]))));
+}
+
+// v.Length()
+static Value method_length(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    (void)arg_count;
+    if (!IS_VECTOR(args[0])) {
+        fprintf(stderr, "Length is only defined for vectors\n");
+        return NULL_VAL;
+    }
+    
+    Lanes v = lanes_load(args[0]);
+    return NUMBER_VAL(sqrtf(lanes_sum(lanes_mul(v, v))));
+}
+
+// v.Normalize(): the unit vector in v's direction (a zero vector stays zero)
+static Value method_normalize(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    (void)arg_count;
+    if (!IS_VECTOR(args[0])) {
+        fprintf(stderr, "Normalize is only defined for vectors\n");
+        return NULL_VAL;
+    }
+    
+    Lanes v = lanes_load(args[0]);
+    float length = sqrtf(lanes_sum(lanes_mul(v, v)));
+    if (length == 0) return args[0];
+    
+    return vector_from_lanes(args[0].type, lanes_div(v, lanes_set1(length)));
+}
+
+// a.Lerp(b, t): a + (b - a) * t, for two vectors or two colors
+static Value method_lerp(Interpreter* interp, Value* args, int arg_count) {
+    (void)interp;
+    if (arg_count != 3 || args[1].type != args[0].type || !IS_NUMBER(args[2])) {
+        fprintf(stderr, "Lerp expects a %s and a number\n", type_name(args[0]));
+        return NULL_VAL;
+    }
+    
+    Lanes t = lanes_set1((float)AS_NUMBER(args[2]));
+    if (IS_COLOR(args[0])) {
+        Lanes a = color_lanes(args[0]);
+        return color_from_lanes(lanes_add(a, lanes_mul(lanes_sub(color_lanes(args[1]), a), t)));
+    }
+    
+    Lanes a = lanes_load(args[0]);
+    return vector_from_lanes(args[0].type, lanes_add(a, lanes_mul(lanes_sub(lanes_load(args[1]), a), t)));
+}
+
+static const struct {
+    const char* name;
+    NativeFn function;
+} vector_methods[] = {
+    { "Dot", method_dot },
+    { "Length", method_length },
+    { "Normalize", method_normalize },
+    { "Lerp", method_lerp }
+};
+
+static const struct {
+    const char* name;
+    uint8_t r, g, b;
+} named_colors[] = {
+    { "Color.Black", 0, 0, 0 },
+    { "Color.White", 255, 255, 255 },
+    { "Color.Red", 255, 0, 0 },
+    { "Color.Green", 0, 255, 0 },
+    { "Color.Blue", 0, 0, 255 },
+    { "Color.Yellow", 255, 255, 0 },
+    { "Color.Orange", 255, 165, 0 },
+    { "Color.Purple", 128, 0, 128 },
+    { "Color.Gray", 128, 128, 128 },
+    { "Color.LightGray", 211, 211, 211 },
+    { "Color.DarkGray", 64, 64, 64 },
+    { "Color.SkyBlue", 135, 206, 235 }
+};
+
+// The built-in class behind vector and color method calls. Like a compiled
+// class prototype it is permanent, so it needs no rooting, and method calls
+// on vectors use the same vtable-keyed caches as instances.
+static Obj* create_vector_class(Interpreter* interp) {
+    int count = (int)(sizeof(vector_methods) / sizeof(vector_methods[0]));
+    VTable* vtable = vtable_create(interp);
+    
+    Obj* klass = allocate_permanent(interp, VALUE_CLASS);
+    klass->data.class_obj.name = strdup("Vector");
+    klass->data.class_obj.shape = interp->root_shape;
+    klass->data.class_obj.vtable = vtable;
+    klass->data.class_obj.defaults = (Value*)malloc(sizeof(Value));
+    klass->data.class_obj.methods = (Value*)malloc(sizeof(Value) * count);
+    
+    for (int i = 0; i < count; i++) {
+        Obj* method = allocate_permanent(interp, VALUE_NATIVE_FUNCTION);
+        method->data.native_function.name = strdup(vector_methods[i].name);
+        method->data.native_function.native_fn = vector_methods[i].function;
+        
+        int slot = vtable_add(vtable, constant_string(interp, vector_methods[i].name));
+        klass->data.class_obj.methods[slot] = OBJ_VAL(method);
+    }
+    
+    return klass;
+}
+
+// Register the constructors, the Color.* constants and the vector methods
+void register_vector_builtins(Interpreter* interp) {
+    define_native(interp, "Vec2", builtin_vec2);
+    define_native(interp, "Vec3", builtin_vec3);
+    define_native(interp, "RGB", builtin_rgb);
+    define_native(interp, "RGBA", builtin_rgba);
+    
+    for (size_t i = 0; i < sizeof(named_colors) / sizeof(named_colors[0]); i++) {
+        int slot = global_slot(interp, named_colors[i].name);
+        interp->global_scope->values[slot] = color_value(named_colors[i].r,
+            named_colors[i].g, named_colors[i].b, 255);
+    }
+    
+    if (!interp->vector_class) interp->vector_class = create_vector_class(interp);
+}
@@ -0,0 +1,714 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "types.h"
+// Stack-based bytecode VM for Kitler
+
+// GCC and Clang support computed goto ("labels as values") for threaded dispatch
+#if defined(__GNUC__) && !defined(KT_NO_COMPUTED_GOTO)
+#define KT_COMPUTED_GOTO 1
+#else
+#define KT_COMPUTED_GOTO 0
+#endif
+
+// ============================================================================
+// STACK HELPERS
+// ============================================================================
+
+static inline void push(Interpreter* interp, Value value) {
+    *interp->stack_top++ = value;
+}
+
+static inline Value pop(Interpreter* interp) {
+    return *--interp->stack_top;
+}
+
+static inline Value peek(Interpreter* interp, int distance) {
+    return interp->stack_top[-1 - distance];
+}
+
+// ============================================================================
+// CALLS
+// ============================================================================
+
+// Push a call frame for a bytecode function whose arguments are on the stack.
+// slots is the stack slot the result replaces: the callee, or for a method
+// call the receiver, which is then also the first argument ('this').
+static bool call_function(Interpreter* interp, Obj* function, Value* slots, int arg_count) {
+    CallFrame* frame = &interp->frames[interp->frame_count];
+    Scope* scope = interp->frame_count < KT_FRAMES_MAX
+        ? enter_frame_scope(interp, frame, function->data.function.local_count)
+        : NULL;
+    
+    if (!scope) {
+        fprintf(stderr, "Stack overflow in %s\n", function->data.function.name);
+        return false;
+    }
+    
+    Value* args = interp->stack_top - arg_count;
+    
+    // Bind parameters to the first slots
+    for (int i = 0; i < function->data.function.param_count && i < arg_count; i++) {
+        scope->values[i] = args[i];
+    }
+    
+    frame->function = function;
+    frame->ip = function->data.function.chunk->code;
+    frame->slots = slots;
+    interp->frame_count++;
+    return true;
+}
+
+// Call a value with the arg_count arguments on top of the stack, just above
+// the callee's own slot. Natives finish here; bytecode functions push a frame.
+// Returns false on stack overflow.
+static bool call_value(Interpreter* interp, Value callee, int arg_count) {
+    Value* slots = interp->stack_top - arg_count - 1;
+    
+    if (callee.type == VALUE_NATIVE_FUNCTION) {
+        interp->native_callee = AS_OBJ(callee);
+        Value result = AS_OBJ(callee)->data.native_function.native_fn(
+            interp, interp->stack_top - arg_count, arg_count);
+        interp->stack_top = slots;
+        push(interp, result);
+        return true;
+    }
+    
+    if (callee.type == VALUE_FUNCTION && AS_OBJ(callee)->data.function.chunk) {
+        return call_function(interp, AS_OBJ(callee), slots, arg_count);
+    }
+    
+    // Calling a non-function evaluates to null, as in eval_call
+    interp->stack_top = slots;
+    push(interp, NULL_VAL);
+    return true;
+}
+
+// ============================================================================
+// DISPATCH LOOP
+// ============================================================================
+
+// Execute until the call at depth base_frame returns
+static void run(Interpreter* interp, int base_frame) {
+    CallFrame* frame = &interp->frames[interp->frame_count - 1];
+    register uint8_t* ip = frame->ip;
+    Value* constants = frame->function->data.function.chunk->constants;
+    InlineCache* caches = frame->function->data.function.chunk->caches;
+
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define READ_CONSTANT() (constants[READ_SHORT()])
+#define SYNC_FRAME() (frame->ip = ip)
+#define LOAD_FRAME() \
+    do { \
+        frame = &interp->frames[interp->frame_count - 1]; \
+        ip = frame->ip; \
+        constants = frame->function->data.function.chunk->constants; \
+        caches = frame->function->data.function.chunk->caches; \
+    } while (0)
+#define NUMBER_OP(op, int_op, vector_op) \
+    do { \
+        Value b = pop(interp); \
+        Value a = interp->stack_top[-1]; \
+        if (IS_INT(a) && IS_INT(b)) { \
+            interp->stack_top[-1] = int_op(AS_INT(a), AS_INT(b)); \
+        } else if (IS_VECTOR(a) || IS_VECTOR(b)) { \
+            interp->stack_top[-1] = vector_op(a, b); \
+        } else { \
+            interp->stack_top[-1] = NUMBER_VAL(AS_NUMBER(a) op AS_NUMBER(b)); \
+        } \
+    } while (0)
+#define COMPARE_OP(op) \
+    do { \
+        Value b = pop(interp); \
+        Value a = interp->stack_top[-1]; \
+        interp->stack_top[-1] = BOOL_VAL(NUMBER_COMPARE(a, op, b)); \
+    } while (0)
+// An undefined global may belong to an included module that has not run yet:
+// initialise it and carry on in this frame, or stop if its top level failed
+#define TOUCH_MODULE(index) \
+    do { \
+        SYNC_FRAME(); \
+        if (module_touch(interp, index)) { \
+            if (&interp->frames[interp->frame_count - 1] != frame) return; \
+            LOAD_FRAME(); \
+        } \
+    } while (0)
+
+#if KT_COMPUTED_GOTO
+    static void* dispatch_table[] = {
+        [OP_CONSTANT] = &&do_OP_CONSTANT,
+        [OP_NULL] = &&do_OP_NULL,
+        [OP_TRUE] = &&do_OP_TRUE,
+        [OP_FALSE] = &&do_OP_FALSE,
+        [OP_POP] = &&do_OP_POP,
+        [OP_GET_GLOBAL] = &&do_OP_GET_GLOBAL,
+        [OP_SET_GLOBAL] = &&do_OP_SET_GLOBAL,
+        [OP_DEFINE_GLOBAL] = &&do_OP_DEFINE_GLOBAL,
+        [OP_GET_LOCAL] = &&do_OP_GET_LOCAL,
+        [OP_SET_LOCAL] = &&do_OP_SET_LOCAL,
+        [OP_GET_UPVALUE] = &&do_OP_GET_UPVALUE,
+        [OP_SET_UPVALUE] = &&do_OP_SET_UPVALUE,
+        [OP_GET_LOCAL_LONG] = &&do_OP_GET_LOCAL_LONG,
+        [OP_SET_LOCAL_LONG] = &&do_OP_SET_LOCAL_LONG,
+        [OP_GET_UPVALUE_LONG] = &&do_OP_GET_UPVALUE_LONG,
+        [OP_SET_UPVALUE_LONG] = &&do_OP_SET_UPVALUE_LONG,
+        [OP_ADD] = &&do_OP_ADD,
+        [OP_SUBTRACT] = &&do_OP_SUBTRACT,
+        [OP_MULTIPLY] = &&do_OP_MULTIPLY,
+        [OP_DIVIDE] = &&do_OP_DIVIDE,
+        [OP_MODULO] = &&do_OP_MODULO,
+        [OP_EQUAL] = &&do_OP_EQUAL,
+        [OP_NOT_EQUAL] = &&do_OP_NOT_EQUAL,
+        [OP_LESS] = &&do_OP_LESS,
+        [OP_LESS_EQUAL] = &&do_OP_LESS_EQUAL,
+        [OP_GREATER] = &&do_OP_GREATER,
+        [OP_GREATER_EQUAL] = &&do_OP_GREATER_EQUAL,
+        [OP_AND] = &&do_OP_AND,
+        [OP_OR] = &&do_OP_OR,
+        [OP_JUMP] = &&do_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&do_OP_JUMP_IF_FALSE,
+        [OP_LOOP] = &&do_OP_LOOP,
+        [OP_FUNCTION] = &&do_OP_FUNCTION,
+        [OP_CALL] = &&do_OP_CALL,
+        [OP_RETURN] = &&do_OP_RETURN,
+        [OP_CLASS] = &&do_OP_CLASS,
+        [OP_CLASS_FIELD] = &&do_OP_CLASS_FIELD,
+        [OP_METHOD] = &&do_OP_METHOD,
+        [OP_INVOKE] = &&do_OP_INVOKE,
+        [OP_NEW] = &&do_OP_NEW,
+        [OP_GET_FIELD] = &&do_OP_GET_FIELD,
+        [OP_SET_FIELD] = &&do_OP_SET_FIELD,
+        [OP_ITER_INIT] = &&do_OP_ITER_INIT,
+        [OP_ITER_NEXT] = &&do_OP_ITER_NEXT,
+        [OP_RANGE_INIT] = &&do_OP_RANGE_INIT,
+        [OP_RANGE_NEXT] = &&do_OP_RANGE_NEXT
+    };
+#define DISPATCH() goto *dispatch_table[READ_BYTE()]
+#define CASE(op) do_##op
+    DISPATCH();
+#else
+#define DISPATCH() continue
+#define CASE(op) case op
+    for (;;) {
+    switch (READ_BYTE()) {
+#endif
+    
+    CASE(OP_CONSTANT): {
+        push(interp, READ_CONSTANT());
+        DISPATCH();
+    }
+    
+    CASE(OP_NULL): {
+        push(interp, NULL_VAL);
+        DISPATCH();
+    }
+    
+    CASE(OP_TRUE): {
+        push(interp, BOOL_VAL(true));
+        DISPATCH();
+    }
+    
+    CASE(OP_FALSE): {
+        push(interp, BOOL_VAL(false));
+        DISPATCH();
+    }
+    
+    CASE(OP_POP): {
+        pop(interp);
+        DISPATCH();
+    }
+    
+    CASE(OP_GET_GLOBAL): {
+        int index = READ_SHORT();
+        Value value = interp->global_scope->values[index];
+        
+        if (IS_UNDEFINED(value)) {
+            TOUCH_MODULE(index);
+            value = interp->global_scope->values[index];
+        }
+        if (IS_UNDEFINED(value)) {
+            fprintf(stderr, "Undefined variable: %s\n", interp->global_scope->names[index]);
+            value = NULL_VAL;
+        }
+        
+        push(interp, value);
+        DISPATCH();
+    }
+    
+    CASE(OP_SET_GLOBAL): {
+        int index = READ_SHORT();
+        if (IS_UNDEFINED(interp->global_scope->values[index])) TOUCH_MODULE(index);
+        Value* slot = &interp->global_scope->values[index];
+        
+        // Assigning an undeclared global is a no-op, as with scope_set
+        if (!IS_UNDEFINED(*slot)) *slot = peek(interp, 0);
+        DISPATCH();
+    }
+    
+    CASE(OP_DEFINE_GLOBAL): {
+        interp->global_scope->values[READ_SHORT()] = pop(interp);
+        DISPATCH();
+    }
+    
+    CASE(OP_GET_LOCAL): {
+        Value value = frame->scope->values[READ_BYTE()];
+        push(interp, IS_UNDEFINED(value) ? NULL_VAL : value);
+        DISPATCH();
+    }
+    
+    CASE(OP_SET_LOCAL): {
+        frame->scope->values[READ_BYTE()] = peek(interp, 0);
+        DISPATCH();
+    }
+    
+    CASE(OP_GET_UPVALUE): {
+        Obj* upvalue = frame->function->data.function.upvalues[READ_BYTE()];
+        Value value = *upvalue->data.upvalue.location;
+        push(interp, IS_UNDEFINED(value) ? NULL_VAL : value);
+        DISPATCH();
+    }
+    
+    CASE(OP_SET_UPVALUE): {
+        Obj* upvalue = frame->function->data.function.upvalues[READ_BYTE()];
+        gc_write_barrier(interp, upvalue, peek(interp, 0));
+        *upvalue->data.upvalue.location = peek(interp, 0);
+        DISPATCH();
+    }
+    
+    CASE(OP_GET_LOCAL_LONG): {
+        Value value = frame->scope->values[READ_SHORT()];
+        push(interp, IS_UNDEFINED(value) ? NULL_VAL : value);
+        DISPATCH();
+    }
+    
+    CASE(OP_SET_LOCAL_LONG): {
+        frame->scope->values[READ_SHORT()] = peek(interp, 0);
+        DISPATCH();
+    }
+    
+    CASE(OP_GET_UPVALUE_LONG): {
+        Obj* upvalue = frame->function->data.function.upvalues[READ_SHORT()];
+        Value value = *upvalue->data.upvalue.location;
+        push(interp, IS_UNDEFINED(value) ? NULL_VAL : value);
+        DISPATCH();
+    }
+    
+    CASE(OP_SET_UPVALUE_LONG): {
+        Obj* upvalue = frame->function->data.function.upvalues[READ_SHORT()];
+        gc_write_barrier(interp, upvalue, peek(interp, 0));
+        *upvalue->data.upvalue.location = peek(interp, 0);
+        DISPATCH();
+    }
+    
+    CASE(OP_ADD): {
+        Value b = peek(interp, 0);
+        Value a = peek(interp, 1);
+        
+        if (IS_TEXT(a) || IS_TEXT(b)) {
+            Value result = value_concat(interp, a, b);
+            interp->stack_top -= 2;
+            push(interp, result);
+        } else {
+            NUMBER_OP(+, int_add, vector_add);
+        }
+        DISPATCH();
+    }
+    
+    CASE(OP_SUBTRACT): {
+        NUMBER_OP(-, int_subtract, vector_subtract);
+        DISPATCH();
+    }
+    
+    CASE(OP_MULTIPLY): {
+        NUMBER_OP(*, int_multiply, vector_multiply);
+        DISPATCH();
+    }
+    
+    CASE(OP_DIVIDE): {
+        NUMBER_OP(/, int_divide, vector_divide);
+        DISPATCH();
+    }
+    
+    CASE(OP_MODULO): {
+        Value b = pop(interp);
+        Value a = pop(interp);
+        push(interp, IS_INT(a) && IS_INT(b)
+            ? int_modulo(AS_INT(a), AS_INT(b))
+            : NUMBER_VAL(fmod(AS_NUMBER(a), AS_NUMBER(b))));
+        DISPATCH();
+    }
+    
+    CASE(OP_EQUAL): {
+        Value b = pop(interp);
+        Value a = pop(interp);
+        push(interp, BOOL_VAL(values_equal(interp, a, b)));
+        DISPATCH();
+    }
+    
+    CASE(OP_NOT_EQUAL): {
+        Value b = pop(interp);
+        Value a = pop(interp);
+        push(interp, BOOL_VAL(!values_equal(interp, a, b)));
+        DISPATCH();
+    }
+    
+    CASE(OP_LESS): {
+        COMPARE_OP(<);
+        DISPATCH();
+    }
+    
+    CASE(OP_LESS_EQUAL): {
+        COMPARE_OP(<=);
+        DISPATCH();
+    }
+    
+    CASE(OP_GREATER): {
+        COMPARE_OP(>);
+        DISPATCH();
+    }
+    
+    CASE(OP_GREATER_EQUAL): {
+        COMPARE_OP(>=);
+        DISPATCH();
+    }
+    
+    CASE(OP_AND): {
+        Value b = pop(interp);
+        Value a = pop(interp);
+        push(interp, BOOL_VAL(value_is_truthy(a) && value_is_truthy(b)));
+        DISPATCH();
+    }
+    
+    CASE(OP_OR): {
+        Value b = pop(interp);
+        Value a = pop(interp);
+        push(interp, BOOL_VAL(value_is_truthy(a) || value_is_truthy(b)));
+        DISPATCH();
+    }
+    
+    CASE(OP_JUMP): {
+        uint16_t offset = READ_SHORT();
+        ip += offset;
+        DISPATCH();
+    }
+    
+    CASE(OP_JUMP_IF_FALSE): {
+        uint16_t offset = READ_SHORT();
+        if (!value_is_truthy(pop(interp))) ip += offset;
+        DISPATCH();
+    }
+    
+    CASE(OP_ITER_INIT): {
+        push(interp, iterator_start(interp, peek(interp, 0)));
+        DISPATCH();
+    }
+    
+    CASE(OP_ITER_NEXT): {
+        uint16_t offset = READ_SHORT();
+        Value* state = interp->stack_top - 2;
+        Value item;
+        
+        if (iterator_next(interp, state[0], &state[1], &item)) {
+            push(interp, item);
+        } else {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    
+    CASE(OP_RANGE_INIT): {
+        int arg_count = READ_BYTE();
+        Value* state = interp->stack_top - arg_count;
+        Value counter, end, step;
+        range_args(state, arg_count, &counter, &end, &step);
+        
+        state[0] = counter;
+        state[1] = end;
+        state[2] = step;
+        interp->stack_top = state + 3;
+        DISPATCH();
+    }
+    
+    CASE(OP_RANGE_NEXT): {
+        uint16_t offset = READ_SHORT();
+        Value* state = interp->stack_top - 3;
+        Value item;
+        
+        if (range_next(&state[0], state[1], state[2], &item)) {
+            push(interp, item);
+        } else {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    
+    CASE(OP_LOOP): {
+        uint16_t offset = READ_SHORT();
+        ip -= offset;
+        
+        // Loop back-edges and calls are the VM's GC safepoints
+        if (interp->gc_requested) {
+            SYNC_FRAME();
+            gc_collect(interp);
+        }
+        DISPATCH();
+    }
+    
+    CASE(OP_FUNCTION): {
+        Obj* proto = AS_OBJ(READ_CONSTANT());
+        Obj* func = allocate_object(interp, VALUE_FUNCTION);
+        func->data.function = proto->data.function;     // Shares the chunk, captures and name
+        
+        int count = proto->data.function.upvalue_count;
+        if (count > 0) {
+            UpvalueRef* captures = proto->data.function.captures;
+            func->data.function.upvalues = (Obj**)malloc(sizeof(Obj*) * count);
+            
+            for (int i = 0; i < count; i++) {
+                func->data.function.upvalues[i] = captures[i].is_local
+                    ? capture_upvalue(interp, &frame->scope->values[captures[i].index])
+                    : frame->function->data.function.upvalues[captures[i].index];
+            }
+        }
+        
+        push(interp, OBJ_VAL(func));
+        DISPATCH();
+    }
+    
+    CASE(OP_CALL): {
+        int arg_count = READ_BYTE();
+        
+        if (interp->gc_requested) {
+            SYNC_FRAME();
+            gc_collect(interp);
+        }
+        
+        SYNC_FRAME();
+        if (!call_value(interp, peek(interp, arg_count), arg_count)) return;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    
+    CASE(OP_RETURN): {
+        Value result = pop(interp);
+        
+        // Closes the upvalues of this call's captured locals
+        if (frame->scope != interp->global_scope) leave_frame_scope(interp, frame);
+        
+        interp->stack_top = frame->slots;
+        interp->frame_count--;
+        push(interp, result);
+        
+        // The outermost call leaves its result on the stack for run's caller
+        if (interp->frame_count == base_frame) {
+            return;
+        }
+        
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    
+    CASE(OP_CLASS): {
+        Obj* proto = AS_OBJ(READ_CONSTANT());
+        Obj* klass = new_class(interp, proto->data.class_obj.name, proto->data.class_obj.shape,
+            proto->data.class_obj.vtable);
+        push(interp, OBJ_VAL(klass));
+        DISPATCH();
+    }
+    
+    CASE(OP_CLASS_FIELD): {
+        int slot = READ_BYTE();
+        Value value = pop(interp);
+        Obj* klass = AS_OBJ(peek(interp, 0));
+        
+        gc_write_barrier(interp, klass, value);
+        klass->data.class_obj.defaults[slot] = value;
+        DISPATCH();
+    }
+    
+    CASE(OP_METHOD): {
+        int slot = READ_BYTE();
+        Value method = pop(interp);
+        Obj* klass = AS_OBJ(peek(interp, 0));
+        
+        gc_write_barrier(interp, klass, method);
+        klass->data.class_obj.methods[slot] = method;
+        DISPATCH();
+    }
+    
+    CASE(OP_INVOKE): {
+        Obj* key = AS_OBJ(READ_CONSTANT());
+        InlineCache* cache = &caches[READ_SHORT()];
+        int arg_count = READ_BYTE();
+        
+        if (interp->gc_requested) {
+            SYNC_FRAME();
+            gc_collect(interp);
+        }
+        
+        Value* receiver = interp->stack_top - arg_count - 1;
+        Value method = UNDEFINED_VAL;
+        
+        // Monomorphic hit: one vtable compare and one indexed load
+        if (receiver->type == VALUE_INSTANCE) {
+            Obj* klass = AS_OBJ(*receiver)->data.instance.class_ref;
+            if (klass->data.class_obj.vtable == cache->keys[0]) {
+                method = klass->data.class_obj.methods[cache->slots[0]];
+            }
+        }
+        if (IS_UNDEFINED(method)) method = find_method(interp, *receiver, key, cache);
+        
+        SYNC_FRAME();
+        if (method.type == VALUE_FUNCTION && AS_OBJ(method)->data.function.chunk) {
+            // The receiver stays in place as the first argument, bound to 'this'
+            if (!call_function(interp, AS_OBJ(method), receiver, arg_count + 1)) return;
+        } else if (method.type == VALUE_NATIVE_FUNCTION) {
+            // Built-in method (of a vector or color): the receiver is the first argument
+            interp->native_callee = AS_OBJ(method);
+            Value result = AS_OBJ(method)->data.native_function.native_fn(interp, receiver, arg_count + 1);
+            interp->stack_top = receiver;
+            push(interp, result);
+        } else {
+            // Not a method: call the field's value, without a receiver
+            if (IS_UNDEFINED(method)) method = get_field(interp, *receiver, key, NULL);
+            *receiver = method;
+            if (!call_value(interp, method, arg_count)) return;
+        }
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    
+    CASE(OP_NEW): {
+        int arg_count = READ_BYTE();
+        
+        // Classes have no constructors yet: the arguments are dropped
+        interp->stack_top -= arg_count;
+        interp->stack_top[-1] = new_instance(interp, interp->stack_top[-1]);
+        DISPATCH();
+    }
+    
+    CASE(OP_GET_FIELD): {
+        Obj* key = AS_OBJ(READ_CONSTANT());
+        InlineCache* cache = &caches[READ_SHORT()];
+        Value object = peek(interp, 0);
+        
+        // Monomorphic hit: one shape compare and one indexed load
+        if (object.type == VALUE_INSTANCE && AS_OBJ(object)->data.instance.shape == cache->keys[0]) {
+            interp->stack_top[-1] = AS_OBJ(object)->data.instance.slots[cache->slots[0]];
+        } else {
+            interp->stack_top[-1] = get_field(interp, object, key, cache);
+        }
+        DISPATCH();
+    }
+    
+    CASE(OP_SET_FIELD): {
+        Obj* key = AS_OBJ(READ_CONSTANT());
+        InlineCache* cache = &caches[READ_SHORT()];
+        Value value = pop(interp);
+        Value object = peek(interp, 0);
+        
+        if (object.type == VALUE_INSTANCE && AS_OBJ(object)->data.instance.shape == cache->keys[0]) {
+            gc_write_barrier(interp, AS_OBJ(object), value);
+            AS_OBJ(object)->data.instance.slots[cache->slots[0]] = value;
+        } else {
+            set_field(interp, object, key, value, cache);
+        }
+        
+        interp->stack_top[-1] = value;
+        DISPATCH();
+    }
+
+#if !KT_COMPUTED_GOTO
+    }
+    }
+#endif
+
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef SYNC_FRAME
+#undef LOAD_FRAME
+#undef NUMBER_OP
+#undef COMPARE_OP
+#undef TOUCH_MODULE
+#undef DISPATCH
+#undef CASE
+}
+
+// Drop the calls above base_frame that a runtime error left unfinished
+static void unwind(Interpreter* interp, int base_frame, Value* stack_top) {
+    while (interp->frame_count > base_frame) {
+        CallFrame* frame = &interp->frames[--interp->frame_count];
+        if (frame->scope != interp->global_scope) leave_frame_scope(interp, frame);
+    }
+    interp->stack_top = stack_top;
+}
+
+// Push a frame that runs script directly in the global scope
+static void push_script(Interpreter* interp, Obj* script) {
+    push(interp, OBJ_VAL(script));
+    CallFrame* frame = &interp->frames[interp->frame_count++];
+    frame->function = script;
+    frame->ip = script->data.function.chunk->code;
+    frame->slots = interp->stack_top - 1;
+    frame->scope = interp->global_scope;
+}
+
+// Execute a compiled script in the global scope; false if a runtime error
+// stopped it, in which case its unfinished calls are dropped
+bool vm_run(Interpreter* interp, Obj* script) {
+    interp->stack_top = interp->stack;
+    interp->locals_top = interp->locals;
+    interp->frame_count = 0;
+    
+    push_script(interp, script);
+    run(interp, 0);
+    
+    if (interp->frame_count != 0) {
+        unwind(interp, 0, interp->stack);
+        return false;
+    }
+    return true;
+}
+
+// Run an included module's compiled top level to completion, on top of the
+// calls (VM or tree walker) already in progress
+void vm_run_nested(Interpreter* interp, Obj* script) {
+    int base_frame = interp->frame_count;
+    if (base_frame >= KT_FRAMES_MAX) {
+        fprintf(stderr, "Stack overflow in %s\n", script->data.function.name);
+        return;
+    }
+    
+    push_script(interp, script);
+    run(interp, base_frame);
+    if (interp->frame_count == base_frame) pop(interp);
+}
+
+// Call a function value from C, on top of the calls already in progress,
+// and store its result. False (with a null result) if it did not finish.
+// The arguments are copied to the stack, which keeps them alive; the result
+// is not rooted.
+bool vm_call(Interpreter* interp, Value callee, Value* args, int arg_count, Value* result) {
+    int base_frame = interp->frame_count;
+    Value* stack_top = interp->stack_top;
+    *result = NULL_VAL;
+    
+    push(interp, callee);
+    for (int i = 0; i < arg_count; i++) push(interp, args[i]);
+    
+    if (!call_value(interp, callee, arg_count)) {
+        unwind(interp, base_frame, stack_top);
+        return false;
+    }
+    if (interp->frame_count > base_frame) run(interp, base_frame);
+    
+    if (interp->frame_count != base_frame) {
+        unwind(interp, base_frame, stack_top);
+        return false;
+    }
+    *result = pop(interp);
+    return true;
+}